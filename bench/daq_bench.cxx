@@ -0,0 +1,240 @@
+/*===========================================================================*\
+
+  file:   daq_bench.cxx
+
+  about:  End-to-end benchmark of the pipeline.  Synthetic workers for
+          every device listed in the bench config feed a WorkerList, an
+          EventBuilder builds events from them and hands the batches to
+          the writers.  After "duration" seconds of triggers at
+          "trigger_rate" the run is stopped and a JSON report is written
+          with the rate, bandwidth, drops and CPU time of each stage and
+          the trigger to writer latency percentiles.
+
+          usage: daq_bench bench.json report.json
+
+          The report always goes to a file, stdout carries the workers'
+          own logging.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+//--- other includes --------------------------------------------------------//
+#include <json11.hpp>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "config_cache.hh"
+#include "device_traits.hh"
+#include "event_builder.hh"
+#include "worker_list.hh"
+#include "writer_root.hh"
+#include "writer_online.hh"
+#include "worker_bench.hh"
+#include "writer_bench.hh"
+
+using namespace daq;
+
+// Adds a bench worker for each device of type T in the config.
+struct AddBenchWorkers {
+  WorkerList &workers;
+  std::string conf_file;
+  const BenchClock &clock;
+  const boost::property_tree::ptree &conf;
+  std::vector<std::shared_ptr<BenchCounters>> &counters;
+
+  template <typename T>
+  void apply() {
+    auto devices = conf.get_child_optional(
+        std::string("devices.") + device_traits<T>::name());
+
+    if (!devices) return;
+
+    for (auto &dev : *devices) {
+      auto worker = new WorkerBench<T>(dev.first, conf_file, clock);
+      auto worker_counters = worker->counters();
+      if (workers.PushBack(worker)) counters.push_back(worker_counters);
+    }
+  };
+};
+
+double ProcessCpuTime() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         1.0e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+// Value below which a fraction q of the sorted samples fall.
+double Percentile(const std::vector<double> &sorted, double q) {
+  if (sorted.empty()) return 0.0;
+
+  std::size_t idx = q * sorted.size();
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: daq_bench bench.json report.json" << std::endl;
+    return 1;
+  }
+
+  std::string conf_file(argv[1]);
+  std::string report_file(argv[2]);
+
+  auto run = ConfigCache::Instance().LoadRun(conf_file);
+  const boost::property_tree::ptree &conf = *run->tree;
+
+  double rate = conf.get<double>("trigger_rate", 1000.0);
+  double duration = conf.get<double>("duration", 10.0);
+
+  BenchClock clock(rate);
+  WorkerList workers;
+  std::vector<std::shared_ptr<BenchCounters>> counters;
+
+  AddBenchWorkers adder{workers, conf_file, clock, conf, counters};
+  for_each_device(adder);
+
+  if (workers.Size() == 0) {
+    std::cerr << "daq_bench: no devices in " << conf_file << std::endl;
+    return 1;
+  }
+
+  // The bench writer always runs, the real ones when asked for.
+  WriterBench bench_writer(conf_file, clock);
+  std::vector<WriterBase *> writers;
+  writers.push_back(&bench_writer);
+
+  std::unique_ptr<WriterRoot> root_writer;
+  if (conf.get<bool>("writers.root.in_use", false)) {
+    root_writer.reset(new WriterRoot(conf_file));
+    writers.push_back(root_writer.get());
+  }
+
+  std::unique_ptr<WriterOnline> online_writer;
+  if (conf.get<bool>("writers.online.in_use", false)) {
+    online_writer.reset(new WriterOnline(conf_file));
+    writers.push_back(online_writer.get());
+  }
+
+  double cpu_start = ProcessCpuTime();
+
+  EventBuilder builder(workers, writers, conf_file);
+
+  for (auto writer : writers) {
+    writer->StartWriter();
+  }
+
+  builder.StartBuilder();
+  workers.StartRun();
+  clock.Start();
+
+  usleep(duration * 1.0e6);
+  unsigned long long triggers = clock.TriggerCount();
+
+  builder.StopBuilder();
+  while (!builder.FinishedRun()) {
+    usleep(daq::long_sleep);
+  }
+
+  workers.StopRun();
+  for (auto writer : writers) {
+    writer->StopWriter();
+  }
+
+  double cpu_total = ProcessCpuTime() - cpu_start;
+
+  // Worker stage
+  json11::Json::array devices;
+  long long worker_events = 0, worker_dropped = 0, worker_bytes = 0;
+  long long built_event_bytes = 0;
+  double worker_cpu = 0.0;
+
+  for (auto &c : counters) {
+    worker_events += c->queued;
+    worker_dropped += c->dropped;
+    worker_bytes += c->queued * c->event_bytes;
+    worker_cpu += c->cpu_time;
+    built_event_bytes += c->event_bytes;
+
+    devices.push_back(json11::Json::object{
+        {"name", c->name},
+        {"type", c->type},
+        {"event_bytes", (double)c->event_bytes},
+        {"events", (double)c->queued},
+        {"dropped", (double)c->dropped},
+        {"cpu_s", c->cpu_time.load()}});
+  }
+
+  // Builder stage, its cpu is what the workers and the bench writer
+  // didn't use.
+  BuilderCounts counts = builder.GetCounts();
+  Livetime live = BusyControl::Instance().GetLivetime();
+  double builder_cpu = cpu_total - worker_cpu - bench_writer.cpu_time();
+  long long builder_bytes = counts.built * built_event_bytes;
+
+  // Writer stage
+  auto latency = bench_writer.latencies();
+
+  json11::Json::object report{
+      {"config", conf_file},
+      {"trigger_rate", rate},
+      {"duration_s", duration},
+      {"triggers", (double)triggers},
+      {"livetime", live.fraction()},
+      {"workers",
+       json11::Json::object{
+           {"events", (double)worker_events},
+           {"events_per_s", worker_events / duration},
+           {"mb_per_s", 1.0e-6 * worker_bytes / duration},
+           {"dropped", (double)worker_dropped},
+           {"cpu_s", worker_cpu},
+           {"devices", devices}}},
+      {"builder",
+       json11::Json::object{
+           {"events", (double)counts.built},
+           {"events_per_s", counts.built / duration},
+           {"mb_per_s", 1.0e-6 * builder_bytes / duration},
+           {"dropped",
+            (double)(counts.unsynced + counts.doubles + counts.overflow +
+                     counts.discarded)},
+           {"unsynced", (double)counts.unsynced},
+           {"doubles", (double)counts.doubles},
+           {"overflow", (double)counts.overflow},
+           {"discarded", (double)counts.discarded},
+           {"cpu_s", builder_cpu}}},
+      {"writers",
+       json11::Json::object{
+           {"events", (double)bench_writer.num_events()},
+           {"events_per_s", bench_writer.num_events() / duration},
+           {"mb_per_s", 1.0e-6 * bench_writer.num_bytes() / duration},
+           {"mismatched", (double)bench_writer.num_mismatched()},
+           {"cpu_s", bench_writer.cpu_time()}}},
+      {"latency_us",
+       json11::Json::object{
+           {"count", (double)latency.size()},
+           {"p50", Percentile(latency, 0.50)},
+           {"p99", Percentile(latency, 0.99)},
+           {"p999", Percentile(latency, 0.999)},
+           {"max", latency.empty() ? 0.0 : latency.back()}}}};
+
+  std::string out = json11::Json(report).dump();
+
+  std::ofstream file(report_file);
+  file << out << std::endl;
+
+  if (!file) {
+    std::cerr << "daq_bench: could not write " << report_file << std::endl;
+  }
+
+  // The builder's copy of the list owns the workers.
+  workers.Resize(0);
+
+  return file ? 0 : 1;
+}
@@ -0,0 +1,714 @@
+/*===========================================================================*\
+
+  file:   kernel_bench.cxx
+
+  about:  Times the per-event decode and correction kernels of the
+          workers, and the online writer's message packing, on a core of
+          their own.  Each kernel runs on a pool of synthetic raw events,
+          or on raw words recorded from a board, first for a number of
+          warmup events and then timed one event at a time.  The report
+          gives ns/event statistics, GB/s of raw input and cycles/sample.
+
+          With --check nothing is timed, instead every kernel is run next
+          to the frozen scalar reference in kernel_reference.hh and the
+          outputs are compared.
+
+          usage: kernel_bench [options] [kernel ...]
+
+            -n, --events N       timed events per kernel (200)
+            -w, --warmup N       untimed events before timing (20)
+            -c, --cpu N          core to pin to, -1 leaves it unpinned
+                                 (the core the bench started on)
+            -i, --input DEV=FILE raw words recorded from a board, DEV is
+                                 caen_1742, caen_5720, caen_5730,
+                                 sis_3350, sis_3302 or sis_3316
+            -k, --check          compare against the reference kernels
+            -t, --tolerance N    adc counts allowed between the two (0)
+            -s, --simd LEVEL     scalar, sse2 or avx2 for the Struck
+                                 unpack (the best the cpu runs)
+            -o, --out FILE       write the JSON report to FILE
+
+          kernels: caen_1742 caen_5720 caen_5730 drs4_cell drs4_peak
+                   drs4_time sis_3350 sis_3302 sis_3316 online_pack
+                   (default all)
+
+          Recorded files hold the words as the worker reads them: whole
+          V1742, DT5720 or DT5730 events one after the other, like the
+          payloads of their raw streams, and for the SIS boards every
+          channel's buffer in channel order, followed for the SIS3302 by
+          the two timestamp words.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//--- other includes --------------------------------------------------------//
+#include <json11.hpp>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "decode_kernels.hh"
+#include "struck_decode.hh"
+#include "writer_online.hh"
+#include "kernel_reference.hh"
+#include "raw_events.hh"
+
+using namespace daq;
+
+typedef std::vector<std::vector<uint>> raw_pool;
+
+// Differences found between a kernel and its reference.
+struct Mismatch {
+  long long count;
+  int max_diff;
+
+  Mismatch() : count(0), max_diff(0){};
+};
+
+struct Kernel {
+  std::string name;
+  double bytes;    // raw input per event
+  double samples;  // samples produced per event
+  int num_inputs;
+
+  std::function<void(int)> prepare;  // stages input i, not timed
+  std::function<void()> run;         // the timed part
+
+  // Runs input i through the kernel and the reference, empty if the
+  // kernel has no reference.
+  std::function<Mismatch(int, int)> check;
+};
+
+template <typename V, std::size_t N, std::size_t M>
+void Compare(const V (&a)[N][M], const V (&b)[N][M], int tolerance,
+             Mismatch &m) {
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < M; ++j) {
+      int diff = std::abs((int)a[i][j] - (int)b[i][j]);
+      m.max_diff = std::max(m.max_diff, diff);
+      if (diff > tolerance) ++m.count;
+    }
+  }
+}
+
+template <std::size_t N>
+void Compare(const ULong64_t (&a)[N], const ULong64_t (&b)[N], Mismatch &m) {
+  for (std::size_t i = 0; i < N; ++i) {
+    if (a[i] != b[i]) ++m.count;
+  }
+}
+
+double MeanBytes(const raw_pool &pool) {
+  double sum = 0.0;
+  for (auto &raw : pool) sum += raw.size() * sizeof(uint);
+  return sum / pool.size();
+}
+
+//--- inputs ----------------------------------------------------------------//
+
+raw_pool SyntheticPool(const std::string &dev, int num) {
+  int bits = (dev == "caen_1742" || dev == "caen_5720" || dev == "sis_3350")
+                 ? 12
+                 : (dev == "caen_5730") ? 14 : 16;
+  PulseGen pulse(bits, 42);
+  raw_pool pool;
+
+  for (int i = 0; i < num; ++i) {
+    if (dev == "caen_1742") {
+      pool.push_back(MakeRawCaen1742(pulse, i));
+    } else if (dev == "caen_5720") {
+      pool.push_back(MakeRawCaenStd<CAEN_5720_CH, CAEN_5720_LN>(pulse, i));
+    } else if (dev == "caen_5730") {
+      pool.push_back(MakeRawCaenStd<CAEN_5730_CH, CAEN_5730_LN>(pulse, i));
+    } else if (dev == "sis_3350") {
+      pool.push_back(MakeRawSis3350(pulse, i));
+    } else if (dev == "sis_3302") {
+      pool.push_back(MakeRawSis3302(pulse, i));
+    } else if (dev == "sis_3316") {
+      pool.push_back(MakeRawSis3316(pulse, i));
+    }
+  }
+
+  return pool;
+}
+
+// Splits a recorded file into events, returns an empty pool on failure.
+raw_pool RecordedPool(const std::string &dev, const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::vector<uint> words;
+  uint w;
+
+  while (in.read((char *)&w, sizeof(w))) words.push_back(w);
+
+  std::size_t size = 0;
+  if (dev == "sis_3350") size = SIS_3350_CH * kSis3350Stride;
+  if (dev == "sis_3302") size = SIS_3302_CH * kSis3302Stride + 2;
+  if (dev == "sis_3316") size = SIS_3316_CH * kSis3316Stride;
+
+  raw_pool pool;
+  std::size_t pos = 0;
+
+  while (pos < words.size()) {
+    // CAEN events carry their size in the first word.
+    std::size_t len =
+        (dev.find("caen_") == 0) ? words[pos] & 0x0fffffff : size;
+
+    if (len == 0 || pos + len > words.size()) break;
+
+    pool.emplace_back(words.begin() + pos, words.begin() + pos + len);
+    pos += len;
+  }
+
+  if (pos != words.size()) {
+    std::cerr << "kernel_bench: " << path << " does not hold whole " << dev
+              << " events" << std::endl;
+    pool.clear();
+  }
+
+  return pool;
+}
+
+//--- kernels ---------------------------------------------------------------//
+
+Kernel Caen1742Kernel(const raw_pool &raw) {
+  struct State {
+    const raw_pool &raw;
+    const std::vector<uint> *cur;
+    std::unique_ptr<caen_1742> out, ref;
+    uint cells[CAEN_1742_GR], ref_cells[CAEN_1742_GR];
+
+    explicit State(const raw_pool &raw)
+        : raw(raw), out(new caen_1742()), ref(new caen_1742()){};
+  };
+  auto st = std::make_shared<State>(raw);
+
+  Kernel k;
+  k.name = "caen_1742";
+  k.bytes = MeanBytes(raw);
+  k.samples = (CAEN_1742_CH + CAEN_1742_GR) * CAEN_1742_LN;
+  k.num_inputs = raw.size();
+
+  k.prepare = [st](int i) { st->cur = &st->raw[i]; };
+
+  k.run = [st]() {
+    DecodeCaen1742(st->cur->data(), st->cur->size(), *st->out, st->cells);
+  };
+
+  k.check = [st](int i, int tolerance) {
+    const std::vector<uint> &w = st->raw[i];
+    Mismatch m;
+
+    int rc = DecodeCaen1742(w.data(), w.size(), *st->out, st->cells);
+    int ref_rc = ref::DecodeCaen1742(w.data(), w.size(), *st->ref,
+                                     st->ref_cells);
+
+    if (rc != ref_rc) ++m.count;
+    if (!std::equal(st->cells, st->cells + CAEN_1742_GR, st->ref_cells)) {
+      ++m.count;
+    }
+
+    Compare(st->out->trace, st->ref->trace, tolerance, m);
+    Compare(st->out->trigger, st->ref->trigger, tolerance, m);
+    Compare(st->out->device_clock, st->ref->device_clock, m);
+    return m;
+  };
+
+  return k;
+}
+
+// The DT5720 and DT5730 share the standard CAEN event format.
+template <typename T>
+Kernel CaenStdKernel(const std::string &name, const raw_pool &raw,
+                     int (*decode)(const uint *, int, T &),
+                     int (*reference)(const uint *, int, T &)) {
+  struct State {
+    const raw_pool &raw;
+    const std::vector<uint> *cur;
+    std::unique_ptr<T> out, ref;
+
+    explicit State(const raw_pool &raw)
+        : raw(raw), out(new T()), ref(new T()){};
+  };
+  auto st = std::make_shared<State>(raw);
+
+  Kernel k;
+  k.name = name;
+  k.bytes = MeanBytes(raw);
+  k.samples = sizeof(T().trace) / sizeof(UShort_t);
+  k.num_inputs = raw.size();
+
+  k.prepare = [st](int i) { st->cur = &st->raw[i]; };
+
+  k.run = [st, decode]() {
+    decode(st->cur->data(), st->cur->size(), *st->out);
+  };
+
+  k.check = [st, decode, reference](int i, int tolerance) {
+    const std::vector<uint> &w = st->raw[i];
+    Mismatch m;
+
+    if (decode(w.data(), w.size(), *st->out) !=
+        reference(w.data(), w.size(), *st->ref)) {
+      ++m.count;
+    }
+
+    if (st->out->event_index != st->ref->event_index) ++m.count;
+    if (st->out->device_clock != st->ref->device_clock) ++m.count;
+
+    Compare(st->out->trace, st->ref->trace, tolerance, m);
+    return m;
+  };
+
+  return k;
+}
+
+// The three DRS4 corrections run on decoded V1742 events.
+Kernel Drs4Kernel(const std::string &which, const raw_pool &raw) {
+  struct State {
+    std::vector<caen_1742> events;
+    std::vector<std::vector<uint>> cells;
+    std::unique_ptr<caen_1742> work, ref;
+    const uint *cur_cells;
+    drs_correction table;
+    float sample_time;
+    float time[CAEN_1742_GR][CAEN_1742_LN];
+
+    State() : work(new caen_1742()), ref(new caen_1742()){};
+  };
+  auto st = std::make_shared<State>();
+
+  st->sample_time = 0.2;
+  std::mt19937 gen(7);
+  MakeDrs4Table(gen, st->sample_time, st->table);
+
+  for (auto &w : raw) {
+    std::vector<uint> cells(CAEN_1742_GR, 0);
+    st->events.emplace_back();
+    DecodeCaen1742(w.data(), w.size(), st->events.back(), &cells[0]);
+
+    // Keep the samples clear of the cell offsets.
+    for (auto &trace : st->events.back().trace) {
+      for (auto &s : trace) s += 100;
+    }
+
+    st->cells.push_back(cells);
+  }
+
+  // Same as the worker, the time axis comes from the first event.
+  Drs4TimeAxis(st->table, &st->cells[0][0], st->sample_time, st->time);
+
+  auto apply = [which](State &s, caen_1742 &data, const uint *cells,
+                       bool reference) {
+    if (which == "drs4_cell") {
+      reference ? ref::Drs4CellCorrection(data, s.table, cells)
+                : Drs4CellCorrection(data, s.table, cells);
+
+    } else if (which == "drs4_peak") {
+      reference ? ref::Drs4PeakCorrection(data, 30)
+                : Drs4PeakCorrection(data, 30);
+
+    } else {
+      reference ? ref::Drs4TimeCorrection(data, s.time, s.sample_time)
+                : Drs4TimeCorrection(data, s.time, s.sample_time);
+    }
+  };
+
+  Kernel k;
+  k.name = which;
+  k.bytes = sizeof(caen_1742().trace);
+  k.samples = CAEN_1742_CH * CAEN_1742_LN;
+  k.num_inputs = st->events.size();
+
+  k.prepare = [st](int i) {
+    std::memcpy(st->work->trace, st->events[i].trace, sizeof(st->work->trace));
+    st->cur_cells = &st->cells[i][0];
+  };
+
+  // Only the kernel chosen above is timed, not the dispatch.
+  if (which == "drs4_cell") {
+    k.run = [st]() {
+      Drs4CellCorrection(*st->work, st->table, st->cur_cells);
+    };
+  } else if (which == "drs4_peak") {
+    k.run = [st]() { Drs4PeakCorrection(*st->work, 30); };
+  } else {
+    k.run = [st]() {
+      Drs4TimeCorrection(*st->work, st->time, st->sample_time);
+    };
+  }
+
+  k.check = [st, apply](int i, int tolerance) {
+    *st->work = st->events[i];
+    *st->ref = st->events[i];
+
+    apply(*st, *st->work, &st->cells[i][0], false);
+    apply(*st, *st->ref, &st->cells[i][0], true);
+
+    Mismatch m;
+    Compare(st->work->trace, st->ref->trace, tolerance, m);
+    return m;
+  };
+
+  return k;
+}
+
+// The SIS boards share a layout of per channel buffers at a fixed stride.
+template <typename T, int S>
+Kernel SisKernel(const std::string &name, const raw_pool &raw,
+                 void (*decode)(const uint (*)[S], T &),
+                 void (*reference)(const uint (*)[S], T &)) {
+  struct State {
+    const raw_pool &raw;
+    const uint(*cur)[S];
+    std::unique_ptr<T> out, ref;
+
+    explicit State(const raw_pool &raw)
+        : raw(raw), out(new T()), ref(new T()){};
+  };
+  auto st = std::make_shared<State>(raw);
+
+  Kernel k;
+  k.name = name;
+  k.bytes = MeanBytes(raw);
+  k.samples = sizeof(T().trace) / sizeof(UShort_t);
+  k.num_inputs = raw.size();
+
+  k.prepare = [st](int i) {
+    st->cur = reinterpret_cast<const uint(*)[S]>(st->raw[i].data());
+  };
+
+  k.run = [st, decode]() { decode(st->cur, *st->out); };
+
+  k.check = [st, decode, reference](int i, int tolerance) {
+    auto w = reinterpret_cast<const uint(*)[S]>(st->raw[i].data());
+    decode(w, *st->out);
+    reference(w, *st->ref);
+
+    Mismatch m;
+    Compare(st->out->trace, st->ref->trace, tolerance, m);
+    Compare(st->out->device_clock, st->ref->device_clock, m);
+    return m;
+  };
+
+  return k;
+}
+
+// The SIS3302 timestamp follows the channel buffers.
+void DecodeSis3302Raw(const uint (*w)[kSis3302Stride], sis_3302 &out) {
+  DecodeSis3302(w, w[SIS_3302_CH], out);
+}
+
+void RefDecodeSis3302Raw(const uint (*w)[kSis3302Stride], sis_3302 &out) {
+  ref::DecodeSis3302(w, w[SIS_3302_CH], out);
+}
+
+Kernel OnlinePackKernel(const raw_pool &raw_1742, const raw_pool &raw_3350) {
+  struct State {
+    std::vector<event_data> events;
+    const event_data *cur;
+    json11::Json::object map;
+    std::string message;
+  };
+  auto st = std::make_shared<State>();
+
+  int num = std::min(raw_1742.size(), raw_3350.size());
+  for (int i = 0; i < num; ++i) {
+    uint cells[CAEN_1742_GR];
+    std::unique_ptr<caen_1742> caen(new caen_1742());
+    std::unique_ptr<sis_3350> sis(new sis_3350());
+
+    DecodeCaen1742(raw_1742[i].data(), raw_1742[i].size(), *caen, cells);
+    DecodeSis3350(
+        reinterpret_cast<const uint(*)[kSis3350Stride]>(raw_3350[i].data()),
+        *sis);
+
+    st->events.emplace_back();
+    st->events.back().caen_1742_vec.push_back(*caen);
+    st->events.back().sis_3350_vec.push_back(*sis);
+  }
+
+  Kernel k;
+  k.name = "online_pack";
+  k.bytes = sizeof(caen_1742) + sizeof(sis_3350);
+  k.samples = (CAEN_1742_CH + CAEN_1742_GR) * CAEN_1742_LN +
+              SIS_3350_CH * SIS_3350_LN;
+  k.num_inputs = st->events.size();
+
+  k.prepare = [st](int i) {
+    st->cur = &st->events[i];
+    st->map.clear();
+    st->map["event_number"] = i;
+  };
+
+  k.run = [st]() { st->message = PackOnlineEvent(*st->cur, st->map, -1); };
+
+  return k;
+}
+
+//--- harness ---------------------------------------------------------------//
+
+inline unsigned long long Cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+json11::Json TimeKernel(Kernel &k, int num_events, int num_warmup) {
+  for (int i = 0; i < num_warmup; ++i) {
+    k.prepare(i % k.num_inputs);
+    k.run();
+  }
+
+  std::vector<double> ns(num_events);
+  unsigned long long cycles = 0;
+
+  for (int i = 0; i < num_events; ++i) {
+    k.prepare(i % k.num_inputs);
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto c0 = Cycles();
+    k.run();
+    auto c1 = Cycles();
+    auto t1 = std::chrono::steady_clock::now();
+
+    ns[i] = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    cycles += c1 - c0;
+  }
+
+  std::sort(ns.begin(), ns.end());
+
+  double mean = 0.0, var = 0.0;
+  for (double t : ns) mean += t / num_events;
+  for (double t : ns) var += (t - mean) * (t - mean) / num_events;
+
+  json11::Json::object res{
+      {"kernel", k.name},
+      {"events", num_events},
+      {"bytes_per_event", k.bytes},
+      {"samples_per_event", k.samples},
+      {"ns_per_event",
+       json11::Json::object{{"mean", mean},
+                            {"median", ns[num_events / 2]},
+                            {"p99", ns[std::min<int>(0.99 * num_events,
+                                                     num_events - 1)]},
+                            {"min", ns.front()},
+                            {"max", ns.back()},
+                            {"stddev", std::sqrt(var)}}},
+      {"gb_per_s", k.bytes / mean},
+      {"msamples_per_s", 1.0e3 * k.samples / mean}};
+
+  // Time stamp counter ticks, the nominal clock on current x86 parts.
+  if (cycles != 0) {
+    res["cycles_per_sample"] = cycles / (k.samples * num_events);
+  }
+
+  return res;
+}
+
+json11::Json CheckKernel(Kernel &k, int tolerance, bool &passed) {
+  if (!k.check) {
+    return json11::Json::object{{"kernel", k.name}, {"reference", false}};
+  }
+
+  Mismatch total;
+  for (int i = 0; i < k.num_inputs; ++i) {
+    Mismatch m = k.check(i, tolerance);
+    total.count += m.count;
+    total.max_diff = std::max(total.max_diff, m.max_diff);
+  }
+
+  passed = passed && (total.count == 0);
+
+  return json11::Json::object{{"kernel", k.name},
+                              {"reference", true},
+                              {"events", k.num_inputs},
+                              {"mismatches", (double)total.count},
+                              {"max_diff", total.max_diff},
+                              {"passed", total.count == 0}};
+}
+
+int main(int argc, char *argv[]) {
+  int num_events = 200;
+  int num_warmup = 20;
+  int cpu = sched_getcpu();
+  int tolerance = 0;
+  bool check = false;
+  std::string out_file;
+  std::map<std::string, std::string> inputs;
+
+  static struct option long_opts[] = {
+      {"events", required_argument, 0, 'n'},
+      {"warmup", required_argument, 0, 'w'},
+      {"cpu", required_argument, 0, 'c'},
+      {"input", required_argument, 0, 'i'},
+      {"check", no_argument, 0, 'k'},
+      {"tolerance", required_argument, 0, 't'},
+      {"simd", required_argument, 0, 's'},
+      {"out", required_argument, 0, 'o'},
+      {0, 0, 0, 0}};
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:w:c:i:kt:s:o:", long_opts, 0)) != -1) {
+    std::string arg = optarg ? optarg : "";
+
+    switch (opt) {
+      case 'n':
+        num_events = std::max(1, std::stoi(arg));
+        break;
+      case 'w':
+        num_warmup = std::max(0, std::stoi(arg));
+        break;
+      case 'c':
+        cpu = std::stoi(arg);
+        break;
+      case 'i':
+        if (arg.find('=') == std::string::npos) {
+          std::cerr << "kernel_bench: --input wants DEV=FILE" << std::endl;
+          return 1;
+        }
+        inputs[arg.substr(0, arg.find('='))] = arg.substr(arg.find('=') + 1);
+        break;
+      case 'k':
+        check = true;
+        break;
+      case 't':
+        tolerance = std::stoi(arg);
+        break;
+      case 's': {
+        struck::SimdLevel level;
+        if (!struck::ParseSimdLevel(arg, level)) {
+          std::cerr << "kernel_bench: unknown simd level " << arg << std::endl;
+          return 1;
+        }
+        struck::SetSimdLevel(level);
+        break;
+      }
+      case 'o':
+        out_file = arg;
+        break;
+      default:
+        return 1;
+    }
+  }
+
+  std::vector<std::string> names(argv + optind, argv + argc);
+  if (names.empty()) {
+    names = {"caen_1742", "caen_5720", "caen_5730", "drs4_cell",
+             "drs4_peak", "drs4_time", "sis_3350",  "sis_3302",
+             "sis_3316",  "online_pack"};
+  }
+
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      std::cerr << "kernel_bench: could not pin to core " << cpu << std::endl;
+      cpu = -1;
+    }
+  }
+
+  // Raw events per device, the big SIS events get a smaller pool.
+  std::map<std::string, raw_pool> raw;
+  for (std::string dev : {"caen_1742", "caen_5720", "caen_5730", "sis_3350",
+                          "sis_3302", "sis_3316"}) {
+    if (inputs.count(dev)) {
+      raw[dev] = RecordedPool(dev, inputs[dev]);
+      if (raw[dev].empty()) return 1;
+
+    } else {
+      int num = (dev == "sis_3302" || dev == "sis_3316") ? 2 : 8;
+      raw[dev] = SyntheticPool(dev, num);
+    }
+  }
+
+  json11::Json::array results;
+  bool passed = true;
+
+  for (auto &name : names) {
+    Kernel k;
+
+    if (name == "caen_1742") {
+      k = Caen1742Kernel(raw["caen_1742"]);
+
+    } else if (name == "caen_5720") {
+      k = CaenStdKernel<caen_5720>(name, raw[name], DecodeCaenDT5720,
+                                   ref::DecodeCaenDT5720);
+
+    } else if (name == "caen_5730") {
+      k = CaenStdKernel<caen_5730>(name, raw[name], DecodeCaenDT5730,
+                                   ref::DecodeCaenDT5730);
+
+    } else if (name.find("drs4_") == 0) {
+      k = Drs4Kernel(name, raw["caen_1742"]);
+
+    } else if (name == "sis_3350") {
+      k = SisKernel<sis_3350, kSis3350Stride>(
+          name, raw[name], DecodeSis3350, ref::DecodeSis3350);
+
+    } else if (name == "sis_3302") {
+      k = SisKernel<sis_3302, kSis3302Stride>(
+          name, raw[name], DecodeSis3302Raw, RefDecodeSis3302Raw);
+
+    } else if (name == "sis_3316") {
+      k = SisKernel<sis_3316, kSis3316Stride>(
+          name, raw[name], DecodeSis3316, ref::DecodeSis3316);
+
+    } else if (name == "online_pack") {
+      k = OnlinePackKernel(raw["caen_1742"], raw["sis_3350"]);
+
+    } else {
+      std::cerr << "kernel_bench: unknown kernel " << name << std::endl;
+      return 1;
+    }
+
+    if (k.num_inputs == 0) continue;
+
+    if (check) {
+      results.push_back(CheckKernel(k, tolerance, passed));
+    } else {
+      results.push_back(TimeKernel(k, num_events, num_warmup));
+    }
+  }
+
+  json11::Json::object report{{"mode", check ? "check" : "time"},
+                              {"cpu", cpu},
+                              {"simd", struck::SimdLevelName(
+                                           struck::GetSimdLevel())},
+                              {"kernels", results}};
+
+  if (check) {
+    report["tolerance"] = tolerance;
+    report["passed"] = passed;
+  }
+
+  std::string out = json11::Json(report).dump();
+
+  if (out_file.empty()) {
+    std::cout << out << std::endl;
+  } else {
+    std::ofstream file(out_file);
+    file << out << std::endl;
+  }
+
+  return passed ? 0 : 1;
+}
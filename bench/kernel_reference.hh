@@ -0,0 +1,350 @@
+#ifndef DAQ_FAST_CORE_BENCH_KERNEL_REFERENCE_HH_
+#define DAQ_FAST_CORE_BENCH_KERNEL_REFERENCE_HH_
+
+/*===========================================================================*\
+
+  file:   kernel_reference.hh
+
+  about:  Frozen scalar copies of the decode and correction kernels, as
+          they were lifted out of the workers.  kernel_bench --check
+          compares the kernels in src/decode_kernels.cxx against these,
+          so leave them alone when optimizing the real ones.  The DT5720
+          and DT5730 were decoded by the CAEN library, their reference
+          unpacks word by word the way CAEN_DGTZ_DecodeEvent does.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "decode_kernels.hh"
+
+namespace daq {
+namespace ref {
+
+// Unpacks eight 12-bit samples from three words.
+inline void Unpack8x12(const uint *ln, uint chdata[8]) {
+  chdata[0] = ln[0] & 0xfff;
+  chdata[1] = (ln[0] >> 12) & 0xfff;
+  chdata[2] = ((ln[0] >> 24) & 0xff) | ((ln[1] & 0xf) << 8);
+  chdata[3] = (ln[1] >> 4) & 0xfff;
+  chdata[4] = (ln[1] >> 16) & 0xfff;
+  chdata[5] = ((ln[1] >> 28) & 0xf) | ((ln[2] & 0xff) << 4);
+  chdata[6] = (ln[2] >> 8) & 0xfff;
+  chdata[7] = (ln[2] >> 20) & 0xfff;
+}
+
+inline int DecodeCaen1742(const uint *buffer, int num_words, caen_1742 &bundle,
+                          uint startcells[CAEN_1742_GR]) {
+  const int nchannels = CAEN_1742_CH / CAEN_1742_GR;
+  uint chdata[8];
+
+  if (num_words < 4) return -1;
+
+  bundle.device_clock[0] = buffer[2];
+
+  int start_idx = 4;  // Skip main event header
+  int stop_idx = 4;
+
+  for (int grp_idx = 0; grp_idx < CAEN_1742_GR; ++grp_idx) {
+    // Skip if this group isn't present.
+    if (!(buffer[1] & (0x1 << grp_idx))) continue;
+
+    if (start_idx >= num_words) return -1;
+
+    // Grab the group header info.
+    uint header = buffer[start_idx++];
+    int data_size = header & 0xfff;
+    bool trg_saved = header & (0x1 << 12);
+    startcells[grp_idx] = (header >> 20) & 0x3ff;
+
+    stop_idx = start_idx + data_size;
+    if (trg_saved) stop_idx += data_size / 8;
+
+    // Leave room for the trigger time tag.
+    if (stop_idx >= num_words) return -1;
+
+    stop_idx = start_idx + data_size;
+    int sample = 0;
+
+    for (int i = start_idx; i < stop_idx; i += 3) {
+      Unpack8x12(&buffer[i], chdata);
+
+      for (int j = 0; j < 8; ++j) {
+        bundle.trace[j + grp_idx * nchannels][sample] = chdata[j];
+      }
+
+      ++sample;
+    }
+
+    start_idx = stop_idx;
+
+    // Now grab the trigger if it was digitized.
+    if (trg_saved) {
+      stop_idx = start_idx + (data_size / 8);
+      sample = 0;
+
+      for (int i = start_idx; i < stop_idx; i += 3) {
+        Unpack8x12(&buffer[i], chdata);
+
+        for (int j = 0; j < 8; ++j) {
+          bundle.trigger[grp_idx][sample++] = chdata[j];
+        }
+      }
+    }
+
+    // Skip the trigger time tag.
+    start_idx = stop_idx + 1;
+  }
+
+  return start_idx;
+}
+
+template <int N, int L>
+inline int DecodeCaenStd(const uint *buffer, int num_words,
+                         UShort_t (&trace)[N][L], ULong64_t &event_index,
+                         ULong64_t &time_tag) {
+  if (num_words < 4 || (buffer[0] >> 28) != 0xa) return -1;
+
+  int size = buffer[0] & 0x0fffffff;
+  if (size < 4 || size > num_words) return -1;
+
+  uint mask = (buffer[1] & 0xff) | ((buffer[2] >> 24) << 8);
+  event_index = buffer[2] & 0xffffff;
+  time_tag = buffer[3];
+
+  int num_ch = 0;
+  for (int ch = 0; ch < N; ++ch) {
+    if (mask & (0x1 << ch)) ++num_ch;
+  }
+
+  int len = num_ch ? 2 * ((size - 4) / num_ch) : 0;
+  int idx = 4;
+
+  for (int ch = 0; ch < N; ++ch) {
+    for (int i = 0; i < L; ++i) trace[ch][i] = 0;
+    if (!(mask & (0x1 << ch))) continue;
+
+    for (int i = 0; i < len; i += 2) {
+      if (i < L) trace[ch][i] = buffer[idx] & 0xffff;
+      if (i + 1 < L) trace[ch][i + 1] = buffer[idx] >> 16;
+      ++idx;
+    }
+  }
+
+  return size;
+}
+
+inline int DecodeCaenDT5720(const uint *buffer, int num_words,
+                            caen_5720 &bundle) {
+  return DecodeCaenStd(buffer, num_words, bundle.trace, bundle.event_index,
+                       bundle.device_clock);
+}
+
+inline int DecodeCaenDT5730(const uint *buffer, int num_words,
+                            caen_5730 &bundle) {
+  return DecodeCaenStd(buffer, num_words, bundle.trace, bundle.event_index,
+                       bundle.device_clock);
+}
+
+inline void DecodeSis3350(const uint trace[SIS_3350_CH][SIS_3350_LN / 2 + 4],
+                          sis_3350 &bundle) {
+  // little endian arch
+  for (int ch = 0; ch < SIS_3350_CH; ch++) {
+    bundle.device_clock[ch] = 0;
+    bundle.device_clock[ch] = trace[ch][1] & 0xfff;
+    bundle.device_clock[ch] |= (trace[ch][1] & 0xfff0000) >> 4;
+    bundle.device_clock[ch] |= (trace[ch][0] & 0xfffULL) << 24;
+    bundle.device_clock[ch] |= (trace[ch][0] & 0xfff0000ULL) << 20;
+
+    for (uint idx = 0; idx < SIS_3350_LN / 2; idx++) {
+      bundle.trace[ch][2 * idx] = trace[ch][idx + 4] & 0xfff;
+      bundle.trace[ch][2 * idx + 1] = (trace[ch][idx + 4] >> 16) & 0xfff;
+    }
+  }
+}
+
+inline void DecodeSis3302(const uint trace[SIS_3302_CH][SIS_3302_LN / 2],
+                          const uint timestamp[2], sis_3302 &bundle) {
+  // little endian arch
+  for (int ch = 0; ch < SIS_3302_CH; ch++) {
+    bundle.device_clock[ch] = 0;
+    bundle.device_clock[ch] = timestamp[1] & 0xfff;
+    bundle.device_clock[ch] |= (timestamp[1] & 0xfff0000) >> 4;
+    bundle.device_clock[ch] |= (timestamp[0] & 0xfffULL) << 24;
+    bundle.device_clock[ch] |= (timestamp[0] & 0xfff0000ULL) << 20;
+
+    std::copy((const ushort *)trace[ch],
+              (const ushort *)trace[ch] + SIS_3302_LN, bundle.trace[ch]);
+  }
+}
+
+inline void DecodeSis3316(const uint data[SIS_3316_CH][3 + SIS_3316_LN / 2],
+                          sis_3316 &bundle) {
+  // little endian arch
+  for (int ch = 0; ch < SIS_3316_CH; ch++) {
+    bundle.device_clock[ch] = 0;
+    bundle.device_clock[ch] = data[ch][1] & 0xffff;
+    bundle.device_clock[ch] |= data[ch][1] & (0xffff << 16);
+    bundle.device_clock[ch] |= (data[ch][0] & 0xffffULL << 16) << 32;
+
+    std::copy((const ushort *)(data[ch] + 3),
+              (const ushort *)(data[ch] + 3) + SIS_3316_LN, bundle.trace[ch]);
+  }
+}
+
+inline void Drs4CellCorrection(caen_1742 &data, const drs_correction &table,
+                               const uint startcells[CAEN_1742_GR]) {
+  const uint nchannels = CAEN_1742_CH / CAEN_1742_GR;
+
+  for (uint i = 0; i < CAEN_1742_CH; ++i) {
+    short startcell = startcells[i / nchannels];
+
+    for (uint j = 0; j < CAEN_1742_LN; ++j) {
+      data.trace[i][j] -= table.cell[i][(startcell + j) % 1024];
+      data.trace[i][j] -= table.nsample[i][j];
+    }
+  }
+}
+
+inline void Drs4PeakCorrection(caen_1742 &data, int threshold) {
+  const int nchannels = CAEN_1742_CH / CAEN_1742_GR;
+  int offset = 0;
+  uint i, j, k;
+  auto wf = data.trace;  // Shortened to clean up logic notation.
+
+  // Drop first sample automatically apparently.
+  for (i = 0; i < CAEN_1742_CH; ++i) wf[i][0] = wf[i][1];
+
+  // Now check the other waveform indexes.
+  for (i = 1; i < CAEN_1742_LN; ++i) {
+    for (j = 0; j < CAEN_1742_CH; ++j) {
+      // Reset if we are at the beginning of a new group.
+      if (j % nchannels == 0) offset = 0;
+
+      switch (i) {
+        case 1:
+          if (wf[j][i + 1] - wf[j][i] > threshold) offset++;
+          break;
+
+        case 2:
+          if ((wf[j][i + 1] - wf[j][i - 1] > threshold) &&
+              (wf[j][i + 1] - wf[j][i] > threshold))
+            offset++;
+          break;
+
+        case CAEN_1742_LN - 2:
+          if (wf[j][i - 1] - wf[j][i] > threshold) offset++;
+          break;
+
+        case CAEN_1742_LN - 1:
+          if (wf[j][i - 1] - wf[j][i] > threshold) offset++;
+          break;
+
+        default:
+          if ((wf[j][i - 1] - wf[j][i] > threshold) &&
+              ((wf[j][i + 1] - wf[j][i] > threshold) ||
+               (wf[j][i + 2] - wf[j][i] > threshold))) {
+            offset++;
+          }
+          break;
+      }
+
+      if (offset == nchannels) {
+        for (k = j - nchannels + 1; k < j + 1; ++k) {
+          switch (i) {
+            case 1:
+              wf[k][0] = wf[k][2];
+              wf[k][1] = wf[k][2];
+              break;
+
+            case 2:
+              wf[k][0] = wf[k][3];
+              wf[k][1] = wf[k][3];
+              wf[k][2] = wf[k][3];
+              break;
+
+            case CAEN_1742_LN - 1:
+              wf[k][i] = wf[k][i - 1];
+              break;
+
+            case CAEN_1742_LN - 2:
+              wf[k][i] = wf[k][i - 1];
+              wf[k][i + 1] = wf[k][i - 1];
+              break;
+
+            default:
+              if (wf[k][i + 1] - wf[k][i] > threshold) {
+                wf[k][i] = 0.5 * (wf[k][i + 1] + wf[k][i - 1]);
+
+              } else if (wf[k][i + 2] - wf[k][i] > threshold) {
+                wf[k][i] = 0.5 * (wf[k][i + 2] + wf[k][i - 1]);
+                wf[k][i + 1] = wf[k][i];
+              }
+              break;
+          }
+        }  // k
+      }    // peak fix
+    }      // j
+  }        // i
+}
+
+inline void Drs4TimeAxis(const drs_correction &table,
+                         const uint startcells[CAEN_1742_GR], float sample_time,
+                         float time[CAEN_1742_GR][CAEN_1742_LN]) {
+  for (uint i = 0; i < CAEN_1742_GR; ++i) {
+    // Set a initial time reference
+    float t0 = table.time[i][startcells[i] % CAEN_1742_LN];
+    time[i][0] = 0.0;
+
+    for (uint j = 1; j < CAEN_1742_LN; ++j) {
+      float dt = table.time[i][(startcells[i] + j) % CAEN_1742_LN] - t0;
+
+      if (dt > 0) {
+        time[i][j] = time[i][j - 1] + dt;
+
+      } else {
+        time[i][j] = time[i][j - 1] + dt + CAEN_1742_LN * sample_time;
+      }
+
+      t0 = table.time[i][(startcells[i] + j) % CAEN_1742_LN];
+    }
+  }
+}
+
+inline void Drs4TimeCorrection(caen_1742 &data,
+                               const float time[CAEN_1742_GR][CAEN_1742_LN],
+                               float sample_time) {
+  float wf[CAEN_1742_LN];
+
+  // Now do a linear interpolation to the correct time points.
+  for (uint i = 0; i < CAEN_1742_CH; ++i) {
+    uint grp_idx = i / (CAEN_1742_CH / CAEN_1742_GR);
+    uint k = 0;
+
+    wf[0] = data.trace[i][0];
+
+    for (uint j = 1; j < CAEN_1742_LN; ++j) {
+      // Find the next sample in time order.
+      while ((k < CAEN_1742_LN - 2) && (time[grp_idx][k + 1] < j * sample_time))
+        ++k;
+
+      float dv = data.trace[i][k + 1] - data.trace[i][k];
+      float dt = time[grp_idx][k + 1] - time[grp_idx][k];
+      float vcorr = (float)dv / dt * (j * sample_time - time[grp_idx][k]);
+
+      wf[j] = data.trace[i][k] + vcorr;
+    }
+
+    for (uint j = 0; j < CAEN_1742_LN; ++j) {
+      data.trace[i][j] = wf[j];
+    }
+  }
+}
+
+}  // ::ref
+}  // ::daq
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef DAQ_FAST_CORE_BENCH_RAW_EVENTS_HH_
+#define DAQ_FAST_CORE_BENCH_RAW_EVENTS_HH_
+
+/*===========================================================================*\
+
+  file:   raw_events.hh
+
+  about:  Synthetic raw buffers in the layouts the boards deliver, for
+          driving the decode kernels without hardware.  Every channel
+          gets a gaussian pulse at a random position on a baseline, with
+          noise, and the headers carry the event number as timestamp.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "decode_kernels.hh"
+
+namespace daq {
+
+// Word strides of the per channel buffers the SIS workers read into.
+const int kSis3350Stride = SIS_3350_LN / 2 + 4;
+const int kSis3302Stride = SIS_3302_LN / 2;
+const int kSis3316Stride = 3 + SIS_3316_LN / 2;
+
+class PulseGen {
+ public:
+  PulseGen(int bits, unsigned seed)
+      : max_((1 << bits) - 1), gen_(seed), noise_(0.0, 2.0){};
+
+  // Picks a new pulse position and height for the next trace.
+  void NextTrace(int len) {
+    std::uniform_real_distribution<double> pos(0.1 * len, 0.8 * len);
+    std::uniform_real_distribution<double> height(0.1 * max_, 0.4 * max_);
+
+    t0_ = pos(gen_);
+    height_ = height(gen_);
+    width_ = std::max(2.0, len / 200.0);
+  };
+
+  ushort operator()(int i) {
+    double x = (i - t0_) / width_;
+    double v = 0.5 * max_ - height_ * std::exp(-0.5 * x * x) + noise_(gen_);
+    return (v < 0) ? 0 : (v > max_) ? max_ : (ushort)v;
+  };
+
+  std::mt19937 &gen() { return gen_; };
+
+ private:
+  int max_;
+  double t0_, height_, width_;
+  std::mt19937 gen_;
+  std::normal_distribution<double> noise_;
+};
+
+// A V1742 event with all groups and the digitized triggers.
+inline std::vector<uint> MakeRawCaen1742(PulseGen &pulse, uint event) {
+  const int nchannels = CAEN_1742_CH / CAEN_1742_GR;
+  const uint data_size = CAEN_1742_LN * nchannels * 12 / 32;
+
+  std::vector<uint> raw(4, 0);
+  raw[1] = (1 << CAEN_1742_GR) - 1;
+  raw[2] = event;
+  raw[3] = event;
+
+  std::uniform_int_distribution<uint> cell(0, 1023);
+  ushort s[CAEN_1742_GR][nchannels][CAEN_1742_LN];
+
+  for (int grp = 0; grp < CAEN_1742_GR; ++grp) {
+    for (int ch = 0; ch < nchannels; ++ch) {
+      pulse.NextTrace(CAEN_1742_LN);
+      for (int i = 0; i < CAEN_1742_LN; ++i) s[grp][ch][i] = pulse(i);
+    }
+  }
+
+  for (int grp = 0; grp < CAEN_1742_GR; ++grp) {
+    raw.push_back((cell(pulse.gen()) << 20) | (0x1 << 12) | data_size);
+
+    // Eight channels of a sample in three words, then the trigger trace
+    // as eight consecutive samples in three words.
+    for (int pass = 0; pass < 2; ++pass) {
+      int num = (pass == 0) ? CAEN_1742_LN : CAEN_1742_LN / nchannels;
+
+      for (int i = 0; i < num; ++i) {
+        uint c[8];
+        for (int j = 0; j < 8; ++j) {
+          c[j] = (pass == 0) ? s[grp][j][i] : s[grp][0][8 * i + j];
+        }
+
+        raw.push_back(c[0] | (c[1] << 12) | ((c[2] & 0xff) << 24));
+        raw.push_back((c[2] >> 8) | (c[3] << 4) | (c[4] << 16) |
+                      ((c[5] & 0xf) << 28));
+        raw.push_back((c[5] >> 4) | (c[6] << 8) | (c[7] << 20));
+      }
+    }
+
+    raw.push_back(event);  // trigger time tag
+  }
+
+  raw[0] = 0xa0000000 | raw.size();
+  return raw;
+}
+
+// A DT5720 or DT5730 event in the standard format with every channel
+// enabled, samples two to a word.
+template <int N, int L>
+inline std::vector<uint> MakeRawCaenStd(PulseGen &pulse, uint event) {
+  std::vector<uint> raw(4, 0);
+  uint mask = (1 << N) - 1;
+
+  raw[1] = mask & 0xff;
+  raw[2] = ((mask >> 8) << 24) | (event & 0xffffff);
+  raw[3] = event;  // trigger time tag
+
+  for (int ch = 0; ch < N; ++ch) {
+    pulse.NextTrace(L);
+    for (int i = 0; i < L; i += 2) {
+      raw.push_back(pulse(i) | (pulse(i + 1) << 16));
+    }
+  }
+
+  raw[0] = 0xa0000000 | raw.size();
+  return raw;
+}
+
+// Splits a 48-bit timestamp into the two words of the SIS3350/3302.
+inline void PackSisTimestamp(unsigned long long t, uint &w0, uint &w1) {
+  w1 = (t & 0xfff) | ((t << 4) & 0xfff0000);
+  w0 = ((t >> 24) & 0xfff) | ((t >> 20) & 0xfff0000);
+}
+
+inline std::vector<uint> MakeRawSis3350(PulseGen &pulse, uint event) {
+  std::vector<uint> raw(SIS_3350_CH * kSis3350Stride, 0);
+
+  for (int ch = 0; ch < SIS_3350_CH; ++ch) {
+    uint *w = &raw[ch * kSis3350Stride];
+    PackSisTimestamp(event, w[0], w[1]);
+
+    pulse.NextTrace(SIS_3350_LN);
+    for (int i = 0; i < SIS_3350_LN / 2; ++i) {
+      w[i + 4] = pulse(2 * i) | (pulse(2 * i + 1) << 16);
+    }
+  }
+
+  return raw;
+}
+
+// The last two words hold the shared timestamp.
+inline std::vector<uint> MakeRawSis3302(PulseGen &pulse, uint event) {
+  std::vector<uint> raw(SIS_3302_CH * kSis3302Stride + 2, 0);
+
+  for (int ch = 0; ch < SIS_3302_CH; ++ch) {
+    uint *w = &raw[ch * kSis3302Stride];
+
+    pulse.NextTrace(SIS_3302_LN);
+    for (int i = 0; i < SIS_3302_LN / 2; ++i) {
+      w[i] = pulse(2 * i) | (pulse(2 * i + 1) << 16);
+    }
+  }
+
+  PackSisTimestamp(event, raw[raw.size() - 2], raw[raw.size() - 1]);
+  return raw;
+}
+
+inline std::vector<uint> MakeRawSis3316(PulseGen &pulse, uint event) {
+  std::vector<uint> raw(SIS_3316_CH * kSis3316Stride, 0);
+
+  for (int ch = 0; ch < SIS_3316_CH; ++ch) {
+    uint *w = &raw[ch * kSis3316Stride];
+    w[0] = (ch << 4) | 0x0;
+    w[1] = event;
+    w[2] = 0xe000000 | (SIS_3316_LN / 2);
+
+    pulse.NextTrace(SIS_3316_LN);
+    for (int i = 0; i < SIS_3316_LN / 2; ++i) {
+      w[i + 3] = pulse(2 * i) | (pulse(2 * i + 1) << 16);
+    }
+  }
+
+  return raw;
+}
+
+// A plausible DRS4 calibration: small cell offsets and cell times
+// jittered around the nominal sample period.
+inline void MakeDrs4Table(std::mt19937 &gen, float sample_time,
+                          drs_correction &table) {
+  std::uniform_int_distribution<int> cell(-40, 40);
+  std::uniform_int_distribution<int> nsample(-3, 3);
+  std::uniform_real_distribution<float> jitter(-0.3, 0.3);
+
+  for (int ch = 0; ch < CAEN_1742_CH; ++ch) {
+    for (int i = 0; i < 1024; ++i) {
+      table.cell[ch][i] = cell(gen);
+      table.nsample[ch][i] = nsample(gen);
+    }
+  }
+
+  for (int grp = 0; grp < CAEN_1742_GR; ++grp) {
+    for (int i = 0; i < 1024; ++i) {
+      table.time[grp][i] = (i + jitter(gen)) * sample_time;
+    }
+  }
+}
+
+}  // ::daq
+
+#endif
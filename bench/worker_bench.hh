@@ -0,0 +1,266 @@
+#ifndef DAQ_FAST_CORE_BENCH_WORKER_BENCH_HH_
+#define DAQ_FAST_CORE_BENCH_WORKER_BENCH_HH_
+
+/*===========================================================================*\
+
+  file:   worker_bench.hh
+
+  about:  Synthetic workers for the pipeline benchmark.  A WorkerBench<T>
+          produces events of any device struct from a shared BenchClock,
+          so every worker in a list sees the same trigger sequence and
+          the event builder can sync them.  Each event carries its
+          trigger number in system_clock, which lets the benchmark
+          writer recover the trigger time and measure the latency.
+
+          Per device settings live under the device's entry in the
+          bench config:
+
+          "devices": {
+              "sis_3316": {
+                  "bench_3316": {"record_length":1024, "readout_us":50}
+              }
+          }
+
+          record_length is the number of samples per channel filled
+          with a pulse (the structs keep their compiled size) and
+          readout_us delays each event after its trigger.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <time.h>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "worker_base.hh"
+
+namespace daq {
+
+// CPU time used by the calling thread, in seconds.
+inline double ThreadCpuTime() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+// Crate-wide trigger clock, trigger k arrives k / rate seconds after Start.
+class BenchClock {
+ public:
+  explicit BenchClock(double rate) : rate_(rate), running_(false){};
+
+  void Start() {
+    t0_ = std::chrono::steady_clock::now();
+    running_.store(true, std::memory_order_release);
+  };
+
+  bool running() const { return running_.load(std::memory_order_acquire); };
+  double rate() const { return rate_; };
+
+  // Triggers that arrived at least delay_us ago.
+  unsigned long long TriggerCount(double delay_us = 0.0) const {
+    using namespace std::chrono;
+    if (!running()) return 0;
+
+    double dt = duration<double>(steady_clock::now() - t0_).count();
+    dt -= 1.0e-6 * delay_us;
+
+    return (dt < 0.0) ? 0 : (unsigned long long)(dt * rate_) + 1;
+  };
+
+  std::chrono::steady_clock::time_point TriggerTime(
+      unsigned long long trigger) const {
+    using namespace std::chrono;
+    return t0_ + duration_cast<steady_clock::duration>(
+                     duration<double>(trigger / rate_));
+  };
+
+ private:
+  double rate_;
+  std::atomic<bool> running_;
+  std::chrono::steady_clock::time_point t0_;
+};
+
+// Totals of one bench worker, kept apart from the worker so they can be
+// read after the worker list has freed it.
+struct BenchCounters {
+  std::string name;
+  std::string type;
+  std::size_t event_bytes;
+  std::atomic<long long> queued;
+  std::atomic<long long> dropped;  // on a full queue
+  std::atomic<double> cpu_time;
+
+  BenchCounters(std::string name, std::string type, std::size_t event_bytes)
+      : name(name), type(type), event_bytes(event_bytes), queued(0),
+        dropped(0), cpu_time(0.0){};
+};
+
+template <typename T>
+class WorkerBench : public WorkerBase<T> {
+ public:
+  WorkerBench(std::string name, std::string conf_file,
+              const BenchClock &clock);
+
+  ~WorkerBench() {
+    // Stop the thread before the event pool goes away.
+    this->thread_live_ = this->go_time_ = false;
+    if (this->work_thread_.joinable()) {
+      try {
+        this->work_thread_.join();
+      } catch (...) {
+        std::cout << key_ << ": thread had race condition joining."
+                  << std::endl;
+      }
+    }
+  };
+
+  void LoadConfig();
+  T PopEvent();
+
+  std::shared_ptr<BenchCounters> counters() { return counters_; };
+
+ private:
+  static const int kPoolSize = 8;
+
+  std::string key_;
+  const BenchClock &clock_;
+  std::shared_ptr<BenchCounters> counters_;
+
+  int record_length_;
+  double readout_us_;
+  unsigned long long next_trigger_;
+  std::vector<T> pool_;  // pre-filled events, copied out per trigger
+
+  void WorkLoop();
+
+  // Fills every sample array of an event with a pulse.
+  class Filler {
+   public:
+    Filler(T &event, int record_length, std::mt19937 &gen)
+        : event_(event), record_length_(record_length), gen_(gen){};
+
+    template <typename M>
+    void operator()(const char *, M T::*member) {
+      Fill(event_.*member);
+    };
+
+   private:
+    T &event_;
+    int record_length_;
+    std::mt19937 &gen_;
+
+    template <std::size_t N>
+    void Fill(UShort_t (&trace)[N]) {
+      std::normal_distribution<double> noise(0.0, 2.0);
+      int len = std::min<int>(N, record_length_);
+      double t0 = 0.3 * len;
+      double width = std::max(2.0, len / 100.0);
+
+      for (int i = 0; i < len; ++i) {
+        double x = (i - t0) / width;
+        trace[i] = 2000 - 1000 * std::exp(-0.5 * x * x) + noise(gen_);
+      }
+    };
+
+    template <typename V, std::size_t N, std::size_t M>
+    void Fill(V (&arr)[N][M]) {
+      for (std::size_t i = 0; i < N; ++i) {
+        Fill(arr[i]);
+      }
+    };
+
+    // Clocks and counters are set per event.
+    template <typename V>
+    void Fill(V &){};
+  };
+};
+
+template <typename T>
+WorkerBench<T>::WorkerBench(std::string name, std::string conf_file,
+                            const BenchClock &clock)
+    : WorkerBase<T>(name, conf_file),
+      key_(std::string("devices.") + device_traits<T>::name() + "." + name),
+      clock_(clock),
+      counters_(std::make_shared<BenchCounters>(
+          name, device_traits<T>::name(), sizeof(T))) {
+  LoadConfig();
+}
+
+template <typename T>
+void WorkerBench<T>::LoadConfig() {
+  const boost::property_tree::ptree &conf = this->ReadConfig();
+
+  record_length_ = conf.get<int>(key_ + ".record_length", 1 << 30);
+  readout_us_ = conf.get<double>(key_ + ".readout_us", 0.0);
+  next_trigger_ = 0;
+
+  std::mt19937 gen(std::hash<std::string>()(key_));
+
+  pool_.assign(kPoolSize, T());
+  for (auto &event : pool_) {
+    Filler filler(event, record_length_, gen);
+    device_traits<T>::fields(filler);
+  }
+}
+
+template <typename T>
+void WorkerBench<T>::WorkLoop() {
+  while (this->thread_live_) {
+    double cpu_start = ThreadCpuTime();
+
+    while (this->go_time_) {
+      if (clock_.TriggerCount(readout_us_) > next_trigger_) {
+        T &event = pool_[next_trigger_ % kPoolSize];
+        event.system_clock = next_trigger_++;
+
+        if (!this->QueueBlocked()) {
+          this->QueueEvent(event);
+          ++counters_->queued;
+        } else {
+          ++counters_->dropped;
+        }
+
+      } else {
+        std::this_thread::yield();
+        usleep(daq::short_sleep);
+      }
+    }
+
+    double cpu = counters_->cpu_time;
+    counters_->cpu_time = cpu + ThreadCpuTime() - cpu_start;
+
+    std::this_thread::yield();
+    usleep(daq::long_sleep);
+  }
+}
+
+template <typename T>
+T WorkerBench<T>::PopEvent() {
+  std::lock_guard<std::mutex> lock(this->queue_mutex_);
+
+  if (this->data_queue_.empty()) {
+    this->LogWarning("popped an empty event");
+    return T();
+  }
+
+  T data = this->data_queue_.front();
+  this->data_queue_.pop();
+
+  // Publish the new queue size.
+  this->UpdateQueueStatus();
+
+  return data;
+}
+
+}  // ::daq
+
+#endif
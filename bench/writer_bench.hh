@@ -0,0 +1,118 @@
+#ifndef DAQ_FAST_CORE_BENCH_WRITER_BENCH_HH_
+#define DAQ_FAST_CORE_BENCH_WRITER_BENCH_HH_
+
+/*===========================================================================*\
+
+  file:   writer_bench.hh
+
+  about:  The benchmark's sink.  It takes every batch the event builder
+          sends, records how long each event took from its trigger to
+          reaching the writers, and counts the bytes that went by.
+          Events whose devices disagree on the trigger number are
+          counted as mismatched.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "device_traits.hh"
+#include "writer_base.hh"
+#include "worker_bench.hh"
+
+namespace daq {
+
+class WriterBench : public WriterBase {
+ public:
+  WriterBench(std::string conf_file, const BenchClock &clock)
+      : WriterBase(conf_file, std::string("WriterBench")), clock_(clock),
+        num_events_(0), num_bytes_(0), num_mismatched_(0), cpu_time_(0.0){};
+
+  ~WriterBench() { StopDispatch(); };
+
+  void LoadConfig(){};
+  void StartWriter(){};
+  void StopWriter(){};
+  void EndOfBatch(bool){};
+
+  void PushData(const std::vector<event_data> &data_buffer) {
+    double cpu_start = ThreadCpuTime();
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+
+    for (auto &event : data_buffer) {
+      EventScan scan(event);
+      for_each_device(scan);
+
+      if (!scan.found) continue;
+
+      std::chrono::duration<double, std::micro> dt =
+          now - clock_.TriggerTime(scan.trigger);
+
+      latency_us_.push_back(dt.count());
+      num_bytes_ += scan.bytes;
+      num_mismatched_ += scan.mismatched ? 1 : 0;
+      ++num_events_;
+    }
+
+    cpu_time_ += ThreadCpuTime() - cpu_start;
+  };
+
+  long long num_events() { return num_events_; };
+  long long num_bytes() { return num_bytes_; };
+  long long num_mismatched() { return num_mismatched_; };
+  double cpu_time() { return cpu_time_; };
+
+  // Latencies in microseconds, sorted.
+  std::vector<double> latencies() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    std::vector<double> sorted(latency_us_);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+  };
+
+ private:
+  const BenchClock &clock_;
+
+  long long num_events_;
+  long long num_bytes_;
+  long long num_mismatched_;
+  double cpu_time_;
+  std::vector<double> latency_us_;
+
+  // Collects the trigger number and size of one built event.
+  struct EventScan {
+    const event_data &event;
+    bool found;
+    bool mismatched;
+    unsigned long long trigger;
+    std::size_t bytes;
+
+    explicit EventScan(const event_data &event)
+        : event(event), found(false), mismatched(false), trigger(0),
+          bytes(0){};
+
+    template <typename T>
+    void apply() {
+      for (auto &data : device_traits<T>::vec(event)) {
+        if (!found) {
+          trigger = data.system_clock;
+          found = true;
+        } else if (data.system_clock != trigger) {
+          mismatched = true;
+        }
+        bytes += sizeof(T);
+      }
+    };
+  };
+};
+
+}  // ::daq
+
+#endif
@@ -61,12 +61,11 @@ about:  Contains the data structures for several hardware devices in a single
 #include <sys/time.h>
 
 //--- other includes --------------------------------------------------------//
-#include <boost/variant.hpp>
 #include <zmq.hpp>
 #include "TFile.h"
 
 //--- projects includes -----------------------------------------------------//
-#include "worker_base.hh"
+#include "common_base.hh"
 
 namespace daq {
 
@@ -95,6 +94,7 @@ struct sis_3316 {
 };
 
 struct caen_1785 {
+  ULong64_t event_index;
   ULong64_t system_clock;
   ULong64_t device_clock[CAEN_1785_CH];
   UShort_t value[CAEN_1785_CH];
@@ -116,12 +116,16 @@ struct caen_1742 {
 struct caen_5720 {
   ULong64_t event_index;
   ULong64_t system_clock;
+  ULong64_t device_clock;
+  ULong64_t host_clock;
   UShort_t trace[CAEN_5720_CH][CAEN_5720_LN];
 };
 
 struct caen_5730 {
   ULong64_t event_index;
   ULong64_t system_clock;
+  ULong64_t device_clock;
+  ULong64_t host_clock;
   UShort_t trace[CAEN_5730_CH][CAEN_5730_LN];
 };
 
@@ -144,18 +148,6 @@ struct event_data {
   std::vector<caen_5730> caen_5730_vec;
 };
 
-// Typedef for all workers - needed by in WorkerList
-typedef boost::variant<WorkerBase<sis_3350> *,
-                       WorkerBase<sis_3302> *,
-                       WorkerBase<caen_1785> *,
-                       WorkerBase<caen_6742> *,
-                       WorkerBase<drs4> *,
-                       WorkerBase<caen_1742> *,
-                       WorkerBase<sis_3316> *,
-		       WorkerBase<caen_5720> *,
-		       WorkerBase<caen_5730> *>
-worker_ptr_types;
-
 // A useful define guard for I/O with the vme bus.
 extern int vme_dev;
 extern std::string vme_path;
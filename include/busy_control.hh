@@ -0,0 +1,150 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_BUSY_CONTROL_HH_
+#define DAQ_FAST_CORE_INCLUDE_BUSY_CONTROL_HH_
+
+/*===========================================================================*\
+
+  file:   busy_control.hh
+
+  about:  Raises a hardware busy while the software falls behind the
+          trigger rate.  Each worker queue and the builder queue report
+          their depth, and once any of them passes the high water mark
+          the daq is busy until all of them are back under the low water
+          mark.  The marks are fractions of each queue's size, set in
+          the run config:
+
+          {
+              "busy": {
+                  "in_use":true,
+                  "high_water_mark":0.8,
+                  "low_water_mark":0.5
+              }
+          }
+
+          Devices wired into the trigger veto drive the busy through an
+          output register given in their own config, e.g. the TRG-OUT
+          of a V1742 or DT57xx forced by the front panel IO control, or
+          the SIS3316 LEMO CO through LEMO_OUT_CO_SELECT,
+
+          "busy_output": {
+              "register":"0x811c",
+              "mask":"0xc000",
+              "busy":"0xc000",
+              "idle":"0x4000"
+          }
+
+          The bits under mask are set to busy or idle, the rest of the
+          register is kept.  Time spent busy is counted per run, so the
+          writers can store the livetime with the data.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+
+//--- other includes --------------------------------------------------------//
+#include <boost/property_tree/ptree.hpp>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "metrics.hh"
+
+namespace daq {
+
+// Run and busy time of the current or last run.
+struct Livetime {
+  long long run_ns;
+  long long busy_ns;
+
+  double fraction() const {
+    return run_ns > 0 ? 1.0 - (double)busy_ns / run_ns : 1.0;
+  };
+};
+
+// A device register that follows the busy, read from "busy_output".
+struct BusyOutput {
+  bool in_use;
+  uint reg;
+  uint mask;
+  uint busy;
+  uint idle;
+
+  BusyOutput() : in_use(false), reg(0), mask(0), busy(0), idle(0){};
+
+  // The masked register value for the given state.
+  uint Apply(uint value, bool is_busy) const {
+    return (value & ~mask) | ((is_busy ? busy : idle) & mask);
+  };
+};
+
+// Reads "busy_output" from a device config, not in use if absent.
+BusyOutput ReadBusyOutput(const boost::property_tree::ptree &conf);
+
+class BusyControl : public CommonBase {
+ public:
+  static BusyControl &Instance();
+
+  // Applied by the event builder from the run config.
+  void SetWatermarks(bool in_use, double high, double low);
+
+  bool in_use() const { return in_use_; };
+  double high_water_mark() const { return high_; };
+  double low_water_mark() const { return low_; };
+
+  // Whether any queue is holding the daq busy.
+  bool busy() const { return num_holding_.load() > 0; };
+
+  // Bracket the time the livetime is measured over.
+  void StartRun();
+  void StopRun();
+
+  Livetime GetLivetime();
+
+ private:
+  friend class BusySource;
+
+  BusyControl();
+
+  std::atomic<bool> in_use_;
+  std::atomic<double> high_;
+  std::atomic<double> low_;
+  std::atomic<int> num_holding_;
+
+  // Guards the timing below, only taken when the busy changes.
+  std::mutex time_mutex_;
+  bool running_;
+  long long run_start_;
+  long long run_stop_;
+  long long busy_since_;
+  long long busy_ns_;  // during the run, up to the last release
+
+  Counter &busy_time_;
+  Gauge &asserted_;
+
+  void Hold();
+  void Release();
+
+  // Busy time since busy_since_ that falls in the run, if busy now.
+  long long OpenBusyTime(long long now);
+};
+
+// One queue's share of the busy.  Update it with the queue's lock held
+// whenever the queue depth changes.
+class BusySource {
+ public:
+  BusySource() : holding_(false){};
+  ~BusySource() { Release(); };
+
+  void Update(size_t depth, size_t max_size);
+
+  // Drops this queue's hold, e.g. when the queue is flushed for good.
+  void Release();
+
+ private:
+  bool holding_;
+};
+
+}  // ::daq
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_CLOCK_FIT_HH_
+#define DAQ_FAST_CORE_INCLUDE_CLOCK_FIT_HH_
+
+/*===========================================================================*\
+
+  file:   clock_fit.hh
+
+  about:  Device trigger time tags and their relation to the host clock.
+          A TimeTagClock extends a time tag that wraps at a fixed number
+          of bits into a 64-bit count of ticks, using the host time of
+          each event to catch wraps missed between sparse triggers.
+
+          A ClockFit keeps a straight line fit of a board's time, in ns,
+          against the host time it was read at,
+
+              device_ns = host_ns * (1 + drift) + offset,
+
+          over the last "window" events, so the tags of boards that drift
+          apart can be brought onto the shared host time line.  Each fit
+          publishes <name>.clock_drift_ppb and <name>.clock_residual_ns,
+          and the difference in drift between two boards is how fast
+          they walk away from each other.  Device configs turn it on with
+
+          "clock_fit": {
+              "in_use":true,
+              "window":1000
+          }
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//--- other includes --------------------------------------------------------//
+#include <boost/property_tree/ptree.hpp>
+
+//--- project includes ------------------------------------------------------//
+#include "metrics.hh"
+
+namespace daq {
+
+class TimeTagClock {
+ public:
+  // A tag of bits width counting ticks of tick_ns.
+  TimeTagClock(int bits = 31, double tick_ns = 8.0) { SetTag(bits, tick_ns); };
+
+  void SetTag(int bits, double tick_ns);
+
+  // Starts over, for a new run the board's tag is reset.
+  void Reset() { started_ = false; };
+
+  // The extended tag of an event read at host_ns.
+  uint64_t Extend(uint64_t tag, long long host_ns);
+
+  double tick_ns() const { return tick_ns_; };
+
+ private:
+  uint64_t mask_;
+  double tick_ns_;
+  bool started_;
+  uint64_t last_;  // last extended tag
+  long long last_host_ns_;
+};
+
+class ClockFit {
+ public:
+  ClockFit(const std::string &name, int window = 1000);
+
+  // Reads "clock_fit" from a device config, returns whether it is in use.
+  bool Configure(const boost::property_tree::ptree &conf);
+
+  void Reset();
+
+  // Adds an event, refitting every so often.
+  void Add(long long host_ns, long long device_ns);
+
+  // The host time of a device time under the last fit, or -1 before it.
+  long long HostTime(long long device_ns);
+
+ private:
+  int window_;
+  std::vector<long long> host_ns_;
+  std::vector<long long> device_ns_;
+  int next_;       // slot the next point goes in
+  int num_added_;  // since the last fit
+
+  std::mutex fit_mutex_;  // guards the fit, read by other threads
+  bool has_fit_;
+  double slope_;
+  double host_mean_;
+  double device_mean_;
+
+  Gauge &drift_;
+  Gauge &residual_;
+
+  void Fit();
+};
+
+}  // ::daq
+
+#endif
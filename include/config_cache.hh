@@ -0,0 +1,120 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_CONFIG_CACHE_HH_
+#define DAQ_FAST_CORE_INCLUDE_CONFIG_CACHE_HH_
+
+/*===========================================================================*\
+
+  file:   config_cache.hh
+
+  about:  Parses each config file once and hands out the result as a
+          shared, read-only ptree.  A file is parsed again only when its
+          size or mtime changes on disk, and the cached tree is kept if
+          the new contents are equal, so comparing the pointers returned
+          by two Load calls tells whether a config really changed.
+
+          The run config is also validated into a typed RunConfig for
+          the event builder and writers.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <ctime>
+
+//--- other includes --------------------------------------------------------//
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+//--- project includes ------------------------------------------------------//
+#include "common_base.hh"
+#include "raw_stream.hh"
+#include "flow_control.hh"
+
+namespace daq {
+
+typedef std::shared_ptr<const boost::property_tree::ptree> conf_ptr;
+
+// Run level settings shared by the event builder and the writers.
+struct RunConfig {
+  std::string logfile;
+
+  int batch_size;       // events per batch handed to the writers
+  int max_event_time;   // us allowed to gather a single event
+  int init_threads;     // threads used to configure devices, 0 for one each
+
+  std::string root_file;
+  std::string root_tree;
+  bool root_sync;
+
+  std::string online_port;
+  int online_high_water_mark;
+  int online_max_trace_length;
+
+  std::string metrics_port;  // metrics exporter address, empty for none
+
+  RawStreamSettings raw_stream;  // recording or replay of raw buffers
+
+  // Limits of the queues between stages, see flow_control.hh.
+  QueueLimits worker_queue;
+  QueueLimits builder_queue;
+  QueueLimits writer_queue;
+  int writer_batches;  // batches queued for each writer's dispatch thread
+
+  // Queue fill fractions that raise and clear the busy, see busy_control.hh.
+  bool busy_in_use;
+  double busy_high_water_mark;
+  double busy_low_water_mark;
+
+  conf_ptr tree;  // the parsed file, for device lists and other sections
+};
+
+class ConfigCache : public CommonBase {
+ public:
+  // The cache shared by every worker and writer.
+  static ConfigCache &Instance();
+
+  // Returns the parsed config file.  Throws if it can't be read or parsed.
+  conf_ptr Load(const std::string &conf_file);
+
+  // Returns the validated run config, rebuilt only when the file changes.
+  std::shared_ptr<const RunConfig> LoadRun(const std::string &conf_file);
+
+  // Checks whether the file now differs from a previously loaded tree.
+  bool Changed(const std::string &conf_file, const conf_ptr &prev);
+
+  // Lists the paths of values that differ between two trees,
+  // e.g. "channel.0.gain".
+  static std::vector<std::string> Diff(const boost::property_tree::ptree &a,
+                                       const boost::property_tree::ptree &b);
+
+  // Forgets all cached files.
+  void Clear();
+
+ private:
+  ConfigCache() : CommonBase(std::string("ConfigCache")){};
+
+  struct Entry {
+    conf_ptr conf;
+    time_t mtime_sec;
+    long mtime_nsec;
+    long size;
+    std::shared_ptr<const RunConfig> run;
+  };
+
+  std::map<std::string, Entry> cache_;
+  std::mutex cache_mutex_;
+
+  std::shared_ptr<const RunConfig> BuildRun(const conf_ptr &conf);
+
+  // Reads the queue limits of one stage under path, keeping the given
+  // defaults for anything missing or invalid.
+  QueueLimits ReadQueueLimits(const boost::property_tree::ptree &conf,
+                              const std::string &path, QueueLimits limits);
+};
+
+}  // ::daq
+
+#endif
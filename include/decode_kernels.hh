@@ -0,0 +1,129 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_DECODE_KERNELS_HH_
+#define DAQ_FAST_CORE_INCLUDE_DECODE_KERNELS_HH_
+
+/*===========================================================================*\
+
+  file:   decode_kernels.hh
+
+  about:  The per-event loops of the workers, pulled out of GetEvent so
+          they can be timed and checked away from the hardware.  Each
+          kernel takes the raw words as the board delivers them and
+          fills the device struct, or corrects a filled struct in place.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <cstdint>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+
+namespace daq {
+
+// DRS4 calibration read from the V1742 flash.
+typedef struct {
+  int16_t cell[CAEN_1742_CH][1024];
+  int8_t  nsample[CAEN_1742_CH][1024];
+  float   time[CAEN_1742_GR][1024];
+} drs_correction;
+
+// The calibration and correction settings of a V1742, as plain data so
+// it can be kept in a raw stream for replay.
+typedef struct {
+  drs_correction table;
+  float time[CAEN_1742_GR][CAEN_1742_LN];  // set once has_time_axis
+  float sample_time;                       // ns
+  bool has_time_axis;
+  bool cell_corrections;
+  bool peak_corrections;
+  bool time_corrections;
+  int peak_threshold;
+} drs_setup;
+
+// Unpacks a V1742 event of num_words words, the 12-bit samples of each
+// group are packed eight to three words.  Sets the start cell of every
+// group present, returns the number of words used or -1 if the event
+// runs past num_words.
+int DecodeCaen1742(const uint *buffer, int num_words, caen_1742 &bundle,
+                   uint startcells[CAEN_1742_GR]);
+
+// V1785 data words hold one 12-bit value each, from the high or the low
+// range, and the board sends channels in the order 0, 4, 1, 5, 2, 6, 3, 7.
+inline bool Caen1785IsValue(uint word, bool read_low_adc) {
+  return (((word >> 24) & 0x7) == 0x0) &&
+         (((word >> 17) & 0x1) != read_low_adc);
+}
+
+// Fills the values of the chosen range from the words read, keeping the
+// first eight, and the event index from the 24-bit event counter in the
+// end of block word, 0 if there is none.  Returns the number of values.
+int DecodeCaen1785(const uint *words, int num_words, bool read_low_adc,
+                   caen_1785 &bundle);
+
+// Finds the next whole event, header through end of block, in words read
+// off the V1785 output buffer in one block, starting at pos.  Words
+// outside an event and headers with no end of block where their count
+// says it should be are skipped.  Sets [begin, end) to the event and pos
+// past it, or returns false with pos at the first word of an event cut
+// off by the end of the block.
+bool Caen1785NextEvent(const uint *words, int num_words, int &pos,
+                       int &begin, int &end);
+
+// DT5720 and DT5730 events in the standard format: a four word header,
+// then each enabled channel's samples in turn, two to a word.  Disabled
+// channels and samples past the record length read back as 0.  Sets the
+// event index and device_clock to the trigger time tag word as read,
+// the worker extends it past rollovers.  Returns the number of words
+// used or -1 if the event is malformed or runs past num_words.
+int DecodeCaenDT5720(const uint *buffer, int num_words, caen_5720 &bundle);
+int DecodeCaenDT5730(const uint *buffer, int num_words, caen_5730 &bundle);
+
+// Words in the standard format event starting at buffer, from the size
+// in its header.  Events in a block follow one another, so this steps
+// through it.  Returns -1 with no header there or if the event runs past
+// num_words.
+int CaenStdEventSize(const uint *buffer, int num_words);
+
+// SIS3350 channels hold a four word header, then two 12-bit samples
+// per word.  The channel version decodes one, wherever it was read to.
+void DecodeSis3350Channel(const uint *words, ULong64_t &device_clock,
+                          UShort_t *trace);
+void DecodeSis3350(const uint trace[SIS_3350_CH][SIS_3350_LN / 2 + 4],
+                   sis_3350 &bundle);
+
+// SIS3302 channels are plain 16-bit samples, the timestamp is shared.
+void DecodeSis3302(const uint trace[SIS_3302_CH][SIS_3302_LN / 2],
+                   const uint timestamp[2], sis_3302 &bundle);
+
+// SIS3316 channels hold a three word header, then 16-bit samples.
+void DecodeSis3316(const uint data[SIS_3316_CH][3 + SIS_3316_LN / 2],
+                   sis_3316 &bundle);
+
+// Subtracts off an average inherent bias in the chip based on the sampling
+// start index in the domino ring cycle.
+void Drs4CellCorrection(caen_1742 &data, const drs_correction &table,
+                        const uint startcells[CAEN_1742_GR]);
+
+// Check each channel for spikes above threshold and remove it if present
+// in all channels for a group.
+void Drs4PeakCorrection(caen_1742 &data, int threshold);
+
+// Builds the true sample times of each group from the calibration.
+void Drs4TimeAxis(const drs_correction &table,
+                  const uint startcells[CAEN_1742_GR], float sample_time,
+                  float time[CAEN_1742_GR][CAEN_1742_LN]);
+
+// Runs the enabled corrections, the time axis is built from the first
+// event it sees.
+void Drs4ApplyCorrections(caen_1742 &data, drs_setup &setup,
+                          const uint startcells[CAEN_1742_GR]);
+
+// Interpolates values to on evenly spaced grid, sample_time (ns) apart,
+// from the unevenly sampled values reported by the DRS4.
+void Drs4TimeCorrection(caen_1742 &data,
+                        const float time[CAEN_1742_GR][CAEN_1742_LN],
+                        float sample_time);
+
+}  // ::daq
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_DEVICE_TRAITS_HH_
+#define DAQ_FAST_CORE_INCLUDE_DEVICE_TRAITS_HH_
+
+/*===========================================================================*\
+
+  file:   device_traits.hh
+
+  about:  Compile-time description of the device structs in common.hh.
+          Each struct gets a device_traits specialization naming it,
+          locating its vector in event_data and listing its members.
+          Writers and the worker list iterate over device_types instead
+          of carrying a hand-written block per device, so integrating
+          new hardware means adding its struct to the list below and
+          writing one traits specialization.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <vector>
+#include <type_traits>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+
+namespace daq {
+
+// A compile-time list of device structs.
+template <typename... Ts>
+struct device_list {};
+
+// Every device struct held in event_data.
+typedef device_list<sis_3350,
+                    sis_3302,
+                    caen_1785,
+                    caen_6742,
+                    drs4,
+                    caen_1742,
+                    sis_3316,
+                    caen_5720,
+                    caen_5730>
+device_types;
+
+// Calls f.apply<T>() for every device struct T in the list, in order.
+template <typename F>
+inline void for_each_device(F &, device_list<>) {}
+
+template <typename F, typename T, typename... Ts>
+inline void for_each_device(F &f, device_list<T, Ts...>) {
+  f.template apply<T>();
+  for_each_device(f, device_list<Ts...>());
+}
+
+template <typename F>
+inline void for_each_device(F &f) {
+  for_each_device(f, device_types());
+}
+
+// Each specialization provides:
+//   name()        - key under "devices" in the run config
+//   online_name() - prefix used for the device in online monitor messages
+//   config_keys() - all "devices" keys whose entries are stored as T
+//   vec(data)     - the event_data vector holding T
+//   fields(f)     - calls f(name, &T::member) on each member in order
+template <typename T>
+struct device_traits;
+
+template <>
+struct device_traits<sis_3350> {
+  static const char *name() { return "sis_3350"; }
+  static const char *online_name() { return "sis_3350"; }
+  static std::vector<std::string> config_keys() { return {"sis_3350"}; }
+
+  static std::vector<sis_3350> &vec(event_data &d) { return d.sis_3350_vec; }
+  static const std::vector<sis_3350> &vec(const event_data &d) {
+    return d.sis_3350_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("system_clock", &sis_3350::system_clock);
+    f("device_clock", &sis_3350::device_clock);
+    f("trace", &sis_3350::trace);
+  }
+};
+
+template <>
+struct device_traits<sis_3302> {
+  static const char *name() { return "sis_3302"; }
+  static const char *online_name() { return "sis_3302"; }
+  static std::vector<std::string> config_keys() { return {"sis_3302"}; }
+
+  static std::vector<sis_3302> &vec(event_data &d) { return d.sis_3302_vec; }
+  static const std::vector<sis_3302> &vec(const event_data &d) {
+    return d.sis_3302_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("system_clock", &sis_3302::system_clock);
+    f("device_clock", &sis_3302::device_clock);
+    f("trace", &sis_3302::trace);
+  }
+};
+
+template <>
+struct device_traits<sis_3316> {
+  static const char *name() { return "sis_3316"; }
+  static const char *online_name() { return "sis_3316"; }
+  static std::vector<std::string> config_keys() { return {"sis_3316"}; }
+
+  static std::vector<sis_3316> &vec(event_data &d) { return d.sis_3316_vec; }
+  static const std::vector<sis_3316> &vec(const event_data &d) {
+    return d.sis_3316_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("system_clock", &sis_3316::system_clock);
+    f("device_clock", &sis_3316::device_clock);
+    f("trace", &sis_3316::trace);
+  }
+};
+
+template <>
+struct device_traits<caen_1785> {
+  static const char *name() { return "caen_1785"; }
+  static const char *online_name() { return "caen_1785"; }
+  static std::vector<std::string> config_keys() { return {"caen_1785"}; }
+
+  static std::vector<caen_1785> &vec(event_data &d) { return d.caen_1785_vec; }
+  static const std::vector<caen_1785> &vec(const event_data &d) {
+    return d.caen_1785_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("event_index", &caen_1785::event_index);
+    f("system_clock", &caen_1785::system_clock);
+    f("device_clock", &caen_1785::device_clock);
+    f("value", &caen_1785::value);
+  }
+};
+
+template <>
+struct device_traits<caen_6742> {
+  static const char *name() { return "caen_6742"; }
+  static const char *online_name() { return "caen_6742"; }
+  static std::vector<std::string> config_keys() { return {"caen_6742"}; }
+
+  static std::vector<caen_6742> &vec(event_data &d) { return d.caen_6742_vec; }
+  static const std::vector<caen_6742> &vec(const event_data &d) {
+    return d.caen_6742_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("system_clock", &caen_6742::system_clock);
+    f("device_clock", &caen_6742::device_clock);
+    f("trace", &caen_6742::trace);
+  }
+};
+
+template <>
+struct device_traits<caen_1742> {
+  static const char *name() { return "caen_1742"; }
+  static const char *online_name() { return "caen_1742"; }
+  static std::vector<std::string> config_keys() { return {"caen_1742"}; }
+
+  static std::vector<caen_1742> &vec(event_data &d) { return d.caen_1742_vec; }
+  static const std::vector<caen_1742> &vec(const event_data &d) {
+    return d.caen_1742_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("system_clock", &caen_1742::system_clock);
+    f("device_clock", &caen_1742::device_clock);
+    f("trace", &caen_1742::trace);
+    f("trigger", &caen_1742::trigger);
+  }
+};
+
+template <>
+struct device_traits<caen_5720> {
+  static const char *name() { return "caen_5720"; }
+  static const char *online_name() { return "caen5720"; }
+  static std::vector<std::string> config_keys() { return {"caen_5720"}; }
+
+  static std::vector<caen_5720> &vec(event_data &d) { return d.caen_5720_vec; }
+  static const std::vector<caen_5720> &vec(const event_data &d) {
+    return d.caen_5720_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("event_index", &caen_5720::event_index);
+    f("system_clock", &caen_5720::system_clock);
+    f("device_clock", &caen_5720::device_clock);
+    f("host_clock", &caen_5720::host_clock);
+    f("trace", &caen_5720::trace);
+  }
+};
+
+template <>
+struct device_traits<caen_5730> {
+  static const char *name() { return "caen_5730"; }
+  static const char *online_name() { return "caen5730"; }
+  static std::vector<std::string> config_keys() { return {"caen_5730"}; }
+
+  static std::vector<caen_5730> &vec(event_data &d) { return d.caen_5730_vec; }
+  static const std::vector<caen_5730> &vec(const event_data &d) {
+    return d.caen_5730_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("event_index", &caen_5730::event_index);
+    f("system_clock", &caen_5730::system_clock);
+    f("device_clock", &caen_5730::device_clock);
+    f("host_clock", &caen_5730::host_clock);
+    f("trace", &caen_5730::trace);
+  }
+};
+
+template <>
+struct device_traits<drs4> {
+  static const char *name() { return "drs4"; }
+  static const char *online_name() { return "drs4"; }
+  static std::vector<std::string> config_keys() { return {"drs4"}; }
+
+  static std::vector<drs4> &vec(event_data &d) { return d.drs4_vec; }
+  static const std::vector<drs4> &vec(const event_data &d) {
+    return d.drs4_vec;
+  }
+
+  template <typename F>
+  static void fields(F &f) {
+    f("system_clock", &drs4::system_clock);
+    f("device_clock", &drs4::device_clock);
+    f("trace", &drs4::trace);
+  }
+};
+
+// ROOT leaf type codes for the member element types.
+template <typename E>
+struct leaf_code;
+
+template <>
+struct leaf_code<ULong64_t> {
+  static char value() { return 'l'; }
+};
+
+template <>
+struct leaf_code<UShort_t> {
+  static char value() { return 's'; }
+};
+
+template <>
+struct leaf_code<Double_t> {
+  static char value() { return 'D'; }
+};
+
+// Appends the array extents of M, e.g. "[4][1024]", to a leaf name.
+template <typename M, unsigned R = std::rank<M>::value>
+struct leaf_dims {
+  static void append(std::string &leaf) {
+    leaf += "[" + std::to_string(std::extent<M>::value) + "]";
+    leaf_dims<typename std::remove_extent<M>::type>::append(leaf);
+  }
+};
+
+template <typename M>
+struct leaf_dims<M, 0> {
+  static void append(std::string &) {}
+};
+
+// Builds the ROOT leaf list for a device struct from its fields, e.g.
+// "system_clock/l:device_clock[4]/l:trace[4][1024]/s".
+class LeafListBuilder {
+ public:
+  template <typename S, typename M>
+  void operator()(const char *name, M S::*) {
+    if (!leaves_.empty()) leaves_ += ":";
+
+    leaves_ += name;
+    leaf_dims<M>::append(leaves_);
+    leaves_ += "/";
+    leaves_ += leaf_code<typename std::remove_all_extents<M>::type>::value();
+  }
+
+  const std::string &leaves() const { return leaves_; }
+
+ private:
+  std::string leaves_;
+};
+
+template <typename T>
+inline std::string leaf_list() {
+  LeafListBuilder builder;
+  device_traits<T>::fields(builder);
+  return builder.leaves();
+}
+
+}  // ::daq
+
+#endif
@@ -12,17 +12,28 @@
 #include <queue>
 
 //--- other includes --------------------------------------------------------//
-#include <boost/variant.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
 //--- projects includes -----------------------------------------------------//
 #include "common.hh"
+#include "metrics.hh"
+#include "busy_control.hh"
 #include "worker_list.hh"
 #include "writer_root.hh"
 
 namespace daq {
 
+// Running totals of the events passing through an EventBuilder.
+struct BuilderCounts {
+  long long built;      // events queued for the writers
+  long long sent;       // events pushed to the writers
+  long long unsynced;   // triggers dropped because a worker missed them
+  long long doubles;    // triggers dropped as double events
+  long long overflow;   // events dropped by the builder queue policy
+  long long discarded;  // events left in the workers when a drain gave up
+};
+
 // This class pulls data form all the workers.
 class EventBuilder : public CommonBase {
  public:
@@ -50,10 +61,15 @@ class EventBuilder : public CommonBase {
     }
   }
 
-  // Intended to be called by master frontend at start of run.
-  void StartBuilder() { go_time_ = true; };
+  // Intended to be called by master frontend at start of run.  It flushes
+  // the workers, dropping every event they hold, so start the workers
+  // after it, not before.  The builder's threads outlive a run, so the
+  // same builder takes the next one once FinishedRun.
+  void StartBuilder();
 
-  // Intended to be called by master frontend at end of run.
+  // Intended to be called by master frontend at end of run.  The workers
+  // are stopped and every event they already read is built and written
+  // before FinishedRun.
   void StopBuilder() { quitting_time_ = true; };
 
   // Load the configurable parameters from a json file, same as used by master.
@@ -65,8 +81,6 @@ class EventBuilder : public CommonBase {
   //     "max_event_time":1200,
   //     "devices":
   //     {
-  //         "fake": {
-  //       },
   //         "sis_3350": {
   //         },
   //         "sis_3302": {
@@ -103,6 +117,19 @@ class EventBuilder : public CommonBase {
   //     "trigger_control": {
   //         "live_time":"10000000",
   //         "dead_time":"1"
+  //     },
+  //     "metrics": {
+  //         "port":"tcp://127.0.0.1:42050"
+  //     },
+  //     "flow_control": {
+  //         "workers": {"queue_size":100, "policy":"block"},
+  //         "builder": {"queue_size":50, "policy":"drop_newest"},
+  //         "writers": {"queue_size":5, "policy":"drop_newest"}
+  //     },
+  //     "busy": {
+  //         "in_use":true,
+  //         "high_water_mark":0.8,
+  //         "low_water_mark":0.5
   //     }
   // }
   void LoadConfig();
@@ -111,13 +138,17 @@ class EventBuilder : public CommonBase {
   // to the writers.
   bool FinishedRun() { return finished_run_; };
 
+  // Snapshot of the event totals since the builder was created.
+  BuilderCounts GetCounts();
+
  private:
   // Simple variable declarations
   std::string conf_file_;
   long long batch_start_;
   int max_event_time_;
   int batch_size_;
-  const int kMaxQueueSize = 50;
+  QueueGate gate_;  // limits pull_data_que_, see flow_control.hh
+  BusySource busy_source_;  // pull_data_que_'s share of the busy
 
   std::atomic<bool> thread_live_;
   std::atomic<bool> go_time_;
@@ -126,6 +157,21 @@ class EventBuilder : public CommonBase {
   std::atomic<bool> got_last_event_;
   std::atomic<bool> quitting_time_;
   std::atomic<bool> finished_run_;
+  std::atomic<bool> building_;  // BuilderLoop is in a pass, see BeginPass
+  const long long kDrainTimeout = 2000000000;  // ns to empty the workers
+
+  // Totals live in the metrics registry, GetCounts reports them
+  // relative to the values when this builder was made.
+  Counter &num_built_;
+  Counter &num_sent_;
+  Counter &num_unsynced_;
+  Counter &num_doubles_;
+  Counter &num_overflow_;
+  Counter &num_discarded_;
+  BuilderCounts counts_at_start_;
+
+  Histogram &build_time_;
+  Gauge &queue_depth_;
 
   // Data accumulation variables
   WorkerList workers_;
@@ -152,6 +198,14 @@ class EventBuilder : public CommonBase {
   // Send the last batch after receiving quitting_time_ = true.
   void SendLastBatch();
 
+  // Builds what the stopped workers still hold, sending batches as it
+  // goes so a blocked builder queue keeps moving.
+  void DrainWorkers();
+
+  // Stops the workers, drains the run to the writers and leaves the
+  // threads idle for the next StartBuilder.
+  void EndRun();
+
   // Worker control functions.
   void StopWorkers();
   void StartWorkers();
@@ -159,6 +213,9 @@ class EventBuilder : public CommonBase {
   // Thread the polls workers and packs events.
   void BuilderLoop();
 
+  // Marks the start of a BuilderLoop pass, false once the run is off.
+  bool BeginPass();
+
   // Thread that listens for triggers.
   void ControlLoop();
 };
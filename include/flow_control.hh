@@ -0,0 +1,138 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_FLOW_CONTROL_HH_
+#define DAQ_FAST_CORE_INCLUDE_FLOW_CONTROL_HH_
+
+/*===========================================================================*\
+
+  file:   flow_control.hh
+
+  about:  Limits on the queues between the stages of the daq, the worker
+          queues, the builder's queue of finished events and the online
+          writer's queue.  Each stage has a size and a policy for what
+          happens to an event arriving at a full queue:
+
+          "block"        the upstream stage waits.  Workers stop reading
+                         their device, so the hardware fills up and goes
+                         busy and the loss shows up as deadtime.
+          "drop_newest"  the arriving event is dropped.
+          "drop_oldest"  the oldest queued event makes room for it.
+          "prescale"     past half full only one in "prescale" arriving
+                         events is queued, and a full queue drops newest.
+
+          Every drop is counted in the stage's metrics.  The run config
+          sets them per stage, e.g.
+
+          {
+              "flow_control": {
+                  "workers": {"queue_size":100, "policy":"block"},
+                  "builder": {"queue_size":50, "policy":"drop_newest"},
+                  "writers": {"queue_size":5, "policy":"prescale",
+                              "prescale":10, "max_batches":8}
+              }
+          }
+
+          The writers limits apply to the online writer's events.  Each
+          writer also queues up to "max_batches" batches for its own
+          thread, and the builder waits on a writer whose batches are
+          all still queued.  The builder's queue_size is raised to the
+          run's batch_size if it is smaller, as batches are only sent
+          from a queue holding that many events.
+
+          Dropping at the workers loses an event on some boards and not
+          on others, which the builder then throws out as unsynced, so
+          they block by default.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <string>
+#include <cstddef>
+
+namespace daq {
+
+enum class QueuePolicy { kBlock, kDropNewest, kDropOldest, kPrescale };
+
+struct QueueLimits {
+  int max_size;
+  QueuePolicy policy;
+  int prescale;  // one in prescale is kept past half full, for kPrescale
+
+  QueueLimits(int size = 100, QueuePolicy p = QueuePolicy::kBlock, int n = 10)
+      : max_size(size), policy(p), prescale(n){};
+};
+
+// Reads a policy name as used in the run config, false if unknown.
+inline bool ParseQueuePolicy(const std::string &name, QueuePolicy &policy) {
+  if (name == "block") {
+    policy = QueuePolicy::kBlock;
+  } else if (name == "drop_newest") {
+    policy = QueuePolicy::kDropNewest;
+  } else if (name == "drop_oldest") {
+    policy = QueuePolicy::kDropOldest;
+  } else if (name == "prescale") {
+    policy = QueuePolicy::kPrescale;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+// What the producer does with a new event.
+enum class QueueAction {
+  kPush,        // queue it
+  kDropOldest,  // pop the front, then queue it
+  kDropNewest,  // drop it
+  kWait         // hold it until there is room
+};
+
+// Applies a QueueLimits to one queue.  Not thread safe, call it under
+// the lock guarding the queue.
+class QueueGate {
+ public:
+  QueueGate() : num_seen_(0){};
+  explicit QueueGate(const QueueLimits &limits)
+      : limits_(limits), num_seen_(0){};
+
+  void SetLimits(const QueueLimits &limits) {
+    limits_ = limits;
+    num_seen_ = 0;
+  };
+
+  const QueueLimits &limits() const { return limits_; };
+
+  // Whether a producer should wait before adding to a queue of size.
+  bool Blocked(size_t size) const {
+    return limits_.policy == QueuePolicy::kBlock && size >= max_size();
+  };
+
+  // Decides the fate of an event arriving at a queue of size.
+  QueueAction Admit(size_t size) {
+    if (limits_.policy == QueuePolicy::kPrescale && size < max_size() &&
+        2 * size >= max_size()) {
+      bool keep = (num_seen_++ % limits_.prescale) == 0;
+      return keep ? QueueAction::kPush : QueueAction::kDropNewest;
+    }
+
+    if (size < max_size()) return QueueAction::kPush;
+
+    switch (limits_.policy) {
+      case QueuePolicy::kBlock:
+        return QueueAction::kWait;
+      case QueuePolicy::kDropOldest:
+        return QueueAction::kDropOldest;
+      default:
+        return QueueAction::kDropNewest;
+    }
+  };
+
+ private:
+  QueueLimits limits_;
+  unsigned long long num_seen_;
+
+  // The config only takes sizes of at least one.
+  size_t max_size() const { return (size_t)limits_.max_size; };
+};
+
+}  // ::daq
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_METRICS_HH_
+#define DAQ_FAST_CORE_INCLUDE_METRICS_HH_
+
+/*===========================================================================*\
+
+  file:   metrics.hh
+
+  about:  Live counters, gauges and latency histograms for the pipeline.
+          Every metric is created once by name in the Metrics registry
+          and then updated through a reference with relaxed atomics, so
+          the data path never takes a lock.  The registry serializes a
+          snapshot of all metrics as JSON, served on a zmq REP socket
+          when "metrics.port" is set in the run config:
+
+          "metrics": {"port":"tcp://127.0.0.1:42050"}
+
+          Any request on the socket is answered with the snapshot.  Names
+          are "<owner>.<metric>", e.g. "sis_0.readout_ns".
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//--- other includes --------------------------------------------------------//
+#include <json11.hpp>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+
+namespace daq {
+
+class Counter {
+ public:
+  Counter() : value_(0){};
+
+  void Add(long long n = 1) { value_.fetch_add(n, std::memory_order_relaxed); };
+  long long value() const { return value_.load(std::memory_order_relaxed); };
+
+ private:
+  std::atomic<long long> value_;
+};
+
+class Gauge {
+ public:
+  Gauge() : value_(0){};
+
+  void Set(long long v) { value_.store(v, std::memory_order_relaxed); };
+  long long value() const { return value_.load(std::memory_order_relaxed); };
+
+ private:
+  std::atomic<long long> value_;
+};
+
+// Log-linear buckets in the manner of HdrHistogram: values below
+// kSubBuckets get a bucket each, above that each power of two is split
+// into kSubBuckets linear buckets, which keeps every value to within
+// 1/kSubBuckets over the full 64-bit range.
+class Histogram {
+ public:
+  static const int kSubBits = 4;
+  static const int kSubBuckets = 1 << kSubBits;
+  static const int kNumBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+  Histogram();
+
+  void Record(long long value) {
+    if (value < 0) value = 0;
+
+    counts_[Index(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    long long prev = max_.load(std::memory_order_relaxed);
+    while (value > prev &&
+           !max_.compare_exchange_weak(prev, value, std::memory_order_relaxed))
+      ;
+  };
+
+  // Count, mean, max and percentiles of the values recorded so far.
+  json11::Json Snapshot() const;
+
+  static int Index(unsigned long long value) {
+    if (value < kSubBuckets) return value;
+
+    int shift = (63 - __builtin_clzll(value)) - kSubBits;
+    return (shift + 1) * kSubBuckets + (value >> shift) - kSubBuckets;
+  };
+
+  // Largest value that lands in a bucket.
+  static unsigned long long UpperEdge(int index);
+
+ private:
+  std::atomic<unsigned long long> counts_[kNumBuckets];
+  std::atomic<long long> count_;
+  std::atomic<long long> sum_;
+  std::atomic<long long> max_;
+};
+
+// Nanoseconds on the steady clock, for timing stages into a Histogram.
+inline long long MetricsNow() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+class Metrics : public CommonBase {
+ public:
+  // The registry shared by every worker, builder and writer.
+  static Metrics &Instance();
+
+  ~Metrics();
+
+  // Return the metric of that name, creating it on first use.  The
+  // reference stays valid for the life of the program.
+  Counter &GetCounter(const std::string &name);
+  Gauge &GetGauge(const std::string &name);
+  Histogram &GetHistogram(const std::string &name);
+
+  // All metrics as one json object keyed by name.
+  std::string Dump();
+
+  // Serves Dump() on a zmq REP socket at port, restarting the exporter
+  // if it was on another port.
+  void StartExporter(const std::string &port);
+  void StopExporter();
+
+ private:
+  Metrics() : CommonBase(std::string("Metrics")), exporter_live_(false){};
+
+  std::map<std::string, std::unique_ptr<Counter>> counters_;
+  std::map<std::string, std::unique_ptr<Gauge>> gauges_;
+  std::map<std::string, std::unique_ptr<Histogram>> histograms_;
+  std::mutex registry_mutex_;
+
+  std::string port_;
+  std::atomic<bool> exporter_live_;
+  std::thread exporter_thread_;
+
+  void ExporterLoop(std::string port);
+};
+
+}  // ::daq
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_RAW_STREAM_HH_
+#define DAQ_FAST_CORE_INCLUDE_RAW_STREAM_HH_
+
+/*===========================================================================*\
+
+  file:   raw_stream.hh
+
+  about:  Per-worker files of the raw device buffers, as read off the
+          hardware and before any decoding.  When a run is recorded
+          every worker writes <dir>/<name>.raw, and in replay mode the
+          factory builds replay workers that decode those files through
+          the same kernels as the hardware workers, e.g.
+
+          {
+              "raw_stream": {
+                  "mode":"record",
+                  "dir":"data/raw/run_00247/",
+                  "pace":"recorded",
+                  "loop":false
+              }
+          }
+
+          "mode" is "off", "record" or "replay".  A replay "pace" of
+          "recorded" keeps the original spacing of the events while
+          "fast" hands them over as quickly as the builder takes them.
+
+          A stream is a file header followed by records, each a
+          raw_record_header and num_bytes of payload.  Setup records
+          carry whatever a decoder needs besides the event words, like
+          the V1742 calibration, and precede the first event.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace daq {
+
+enum class RawStreamMode { kOff, kRecord, kReplay };
+
+struct RawStreamSettings {
+  RawStreamMode mode;
+  std::string dir;  // holds one <name>.raw per worker
+  bool paced;       // replay at the recorded event spacing
+  bool loop;        // replay the stream again once it ends
+
+  RawStreamSettings()
+      : mode(RawStreamMode::kOff), dir("data/raw/"), paced(true),
+        loop(false){};
+};
+
+// Applied by WorkerFactory::AddWorkers before any worker is made.
+void SetRawStreamSettings(const RawStreamSettings &settings);
+RawStreamSettings GetRawStreamSettings();
+
+// The stream file of a worker under the current settings.
+std::string RawStreamPath(const std::string &worker_name);
+
+const char kRawStreamMagic[8] = {'D', 'A', 'Q', 'R', 'A', 'W', '0', '1'};
+
+enum RawRecordKind : uint32_t { kRawEvent = 0, kRawSetup = 1 };
+
+struct raw_file_header {
+  char magic[8];
+  char type[24];  // device_traits name of the worker's struct
+  char name[32];  // worker name
+};
+
+struct raw_record_header {
+  uint64_t time_ns;       // since the stream was opened
+  uint64_t system_clock;  // the event's system_clock, as the worker set it
+  uint32_t kind;          // RawRecordKind
+  uint32_t num_bytes;     // payload that follows
+};
+
+struct RawRecord {
+  raw_record_header header;
+  std::vector<char> payload;
+};
+
+class RawStreamWriter {
+ public:
+  RawStreamWriter() : num_records_(0){};
+  ~RawStreamWriter() { Close(); };
+
+  // Truncates path and writes the file header, false on failure.
+  bool Open(const std::string &path, const std::string &type,
+            const std::string &name);
+  void Close();
+
+  // Appends a record stamped with the time since Open.
+  bool Write(RawRecordKind kind, const void *data, size_t num_bytes,
+             uint64_t system_clock);
+
+  long long num_records() const { return num_records_; };
+  bool is_open() const { return out_.is_open(); };
+
+ private:
+  std::vector<char> out_buffer_;  // must outlive out_
+  std::ofstream out_;
+  long long t0_;
+  long long num_records_;
+};
+
+class RawStreamReader {
+ public:
+  // Opens path and checks the header, false if it isn't a raw stream.
+  bool Open(const std::string &path);
+  void Close();
+
+  // Reads the next record, false at the end of the stream.
+  bool Next(RawRecord &record);
+
+  // Starts over at the first record.
+  void Rewind();
+
+  const raw_file_header &header() const { return header_; };
+
+ private:
+  std::ifstream in_;
+  raw_file_header header_;
+};
+
+}  // ::daq
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_READOUT_BUFFER_HH_
+#define DAQ_FAST_CORE_INCLUDE_READOUT_BUFFER_HH_
+
+/*===========================================================================*\
+
+  file:   readout_buffer.hh
+
+  about:  Memory that block transfers land in.  Each worker owns its
+          buffer, mapped page aligned, touched up front so a transfer
+          never waits on a page fault, and locked so it stays resident.
+          Huge pages cut the TLB misses of multi-MB transfers.  Device
+          configs can change how it is mapped, e.g.
+
+          "readout_memory": {
+              "hugepages":true,
+              "mlock":true
+          }
+
+          Both default to true.  Without reserved huge pages the buffer
+          falls back to normal pages, marked for transparent huge pages,
+          and a buffer over the memlock limit is left unlocked.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <cstddef>
+#include <sys/types.h>
+
+//--- other includes --------------------------------------------------------//
+#include <boost/property_tree/ptree.hpp>
+
+namespace daq {
+
+struct ReadoutMemory {
+  bool hugepages;
+  bool mlock;
+
+  ReadoutMemory() : hugepages(true), mlock(true){};
+
+  bool operator==(const ReadoutMemory &other) const {
+    return hugepages == other.hugepages && mlock == other.mlock;
+  };
+};
+
+// Reads "readout_memory" from a device config.
+ReadoutMemory ReadReadoutMemory(const boost::property_tree::ptree &conf);
+
+class ReadoutBuffer {
+ public:
+  ReadoutBuffer()
+      : data_(nullptr), size_(0), bytes_(0), hugepages_(false),
+        locked_(false){};
+  ~ReadoutBuffer() { Free(); };
+
+  ReadoutBuffer(const ReadoutBuffer &) = delete;
+  ReadoutBuffer &operator=(const ReadoutBuffer &) = delete;
+
+  // Maps room for num_words, dropping any earlier mapping.  Returns false
+  // if no memory could be had at all.
+  bool Allocate(size_t num_words, const ReadoutMemory &memory);
+  void Free();
+
+  uint *data() { return data_; };
+  size_t size() const { return size_; };
+
+  // The settings it was last mapped with.
+  const ReadoutMemory &memory() const { return memory_; };
+
+  // How the allocation went, both may have fallen back.
+  bool hugepages() const { return hugepages_; };
+  bool locked() const { return locked_; };
+
+ private:
+  uint *data_;
+  size_t size_;   // words asked for
+  size_t bytes_;  // mapped
+  ReadoutMemory memory_;
+  bool hugepages_;
+  bool locked_;
+};
+
+}  // ::daq
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_STRUCK_DECODE_HH_
+#define DAQ_FAST_CORE_INCLUDE_STRUCK_DECODE_HH_
+
+/*===========================================================================*\
+
+  file:   struck_decode.hh
+
+  about:  The data formats the Struck digitizers share, decoded from the
+          words as read off the bus straight into an event's arrays.
+
+          The SIS3350 and SIS3302 pack a 48-bit timestamp into four 12-bit
+          fields over two words, the SIS3316 its timestamp into 16-bit
+          fields.  Samples come two to a word, 12 bits in the low end of
+          each half for the SIS3350 and whole halves for the SIS3302 and
+          SIS3316.
+
+          The 12-bit unpack has SSE2 and AVX2 versions next to the scalar
+          one.  The best the cpu runs is picked the first time it is used,
+          SetSimdLevel overrides that, e.g. for the kernel bench.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <cstring>
+#include <string>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+
+namespace daq {
+
+namespace struck {
+
+enum class SimdLevel { kScalar, kSse2, kAvx2 };
+
+// The best level this cpu and build support.
+SimdLevel DetectSimdLevel();
+
+// The level in use, the detected one unless set.
+SimdLevel GetSimdLevel();
+void SetSimdLevel(SimdLevel level);
+
+const char *SimdLevelName(SimdLevel level);
+
+// Reads "scalar", "sse2" or "avx2", false if unknown.
+bool ParseSimdLevel(const std::string &name, SimdLevel &level);
+
+// 48-bit timestamp in 12-bit fields, lowest in the low half of w1, then
+// its high half, then the halves of w0 (SIS3350, SIS3302).
+inline ULong64_t Timestamp12(uint w0, uint w1) {
+  return (w1 & 0xfff) | ((w1 & 0xfff0000) >> 4) | ((w0 & 0xfffULL) << 24) |
+         ((w0 & 0xfff0000ULL) << 20);
+}
+
+// Timestamp in 16-bit fields, w1 in the low 32 bits and the high half
+// of w0 in the top 16, as SIS3316 events have always been stored.
+inline ULong64_t Timestamp16(uint w0, uint w1) {
+  return w1 | ((w0 & 0xffff0000ULL) << 32);
+}
+
+// Two 12-bit samples per word, one in the low bits of each half.
+void Unpack12(const uint *words, int num_words, UShort_t *samples);
+
+// Two 16-bit samples per word, low half first.  A plain copy on a little
+// endian host, which memcpy already does with the widest moves it has.
+inline void Unpack16(const uint *words, int num_words, UShort_t *samples) {
+  std::memcpy(samples, words, num_words * sizeof(uint));
+}
+
+}  // ::struck
+
+}  // ::daq
+
+#endif
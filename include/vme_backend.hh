@@ -0,0 +1,106 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_VME_BACKEND_HH_
+#define DAQ_FAST_CORE_INCLUDE_VME_BACKEND_HH_
+
+/*===========================================================================*\
+
+  file:   vme_backend.hh
+
+  about:  The bus access used by WorkerVme.  The default backend talks to
+          the crate through the sis3100 driver calls, and the run config
+          can swap in a simulated crate instead, e.g.
+
+          {
+              "vme_backend": {
+                  "type":"sim",
+                  "trigger_rate":100.0,
+                  "latency_us":2.0,
+                  "bandwidth_mbps":40.0
+              }
+          }
+
+          All addresses are full A32 addresses and return codes follow
+          the sis3100 calls, 0 on success.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <memory>
+#include <sys/types.h>
+
+//--- other includes --------------------------------------------------------//
+#include <boost/property_tree/ptree.hpp>
+
+namespace daq {
+
+// Returned by the sis3100 calls when a transfer ends in a VME bus error,
+// which is also how boards with BERR enabled end a block read early.
+const int kVmeBusError = 0x211;
+
+// Block transfer flavours used by the workers.
+enum class VmeBlockMode {
+  k2eVme,       // 2eVME
+  k2eVmeFifo,   // 2eVME, fixed address
+  kDma32Fifo,   // BLT32, fixed address
+  kMblt64,      // MBLT64
+  kMblt64Fifo,  // MBLT64, fixed address
+};
+
+// One transfer of a chained block read, num_got is filled in.
+struct VmeBlock {
+  uint addr;
+  uint *data;
+  uint num_words;
+  uint num_got;
+};
+
+class VmeBackend {
+ public:
+  virtual ~VmeBackend(){};
+
+  // Returns a device handle for the calls below, negative on failure.
+  virtual int Open() = 0;
+  virtual void Close(int dev) = 0;
+
+  virtual int ReadD32(int dev, uint addr, uint *data) = 0;
+  virtual int WriteD32(int dev, uint addr, uint data) = 0;
+  virtual int ReadD16(int dev, uint addr, ushort *data) = 0;
+  virtual int WriteD16(int dev, uint addr, ushort data) = 0;
+
+  // Reads up to num_words 32-bit words, num_got is set to the count read.
+  virtual int ReadBlock(int dev, VmeBlockMode mode, uint addr, uint *data,
+                        uint num_words, uint *num_got) = 0;
+
+  // Reads a list of blocks as one chained transfer, stopping at the first
+  // that fails.  Without driver support for DMA chains they go back to
+  // back on the open device.
+  virtual int ReadBlockChain(int dev, VmeBlockMode mode, VmeBlock *blocks,
+                             int num_blocks);
+};
+
+// Talks to a real crate through /dev/sis1100_00remote (daq::vme_path).
+class Sis3100Backend : public VmeBackend {
+ public:
+  int Open();
+  void Close(int dev);
+
+  int ReadD32(int dev, uint addr, uint *data);
+  int WriteD32(int dev, uint addr, uint data);
+  int ReadD16(int dev, uint addr, ushort *data);
+  int WriteD16(int dev, uint addr, ushort data);
+
+  int ReadBlock(int dev, VmeBlockMode mode, uint addr, uint *data,
+                uint num_words, uint *num_got);
+};
+
+// The backend used by all vme workers, the sis3100 one by default.
+VmeBackend &GetVmeBackend();
+
+// Replaces the backend, only while no vme worker is running.
+void SetVmeBackend(std::shared_ptr<VmeBackend> backend);
+
+// Selects the backend from the "vme_backend" section of a run config.
+void LoadVmeBackend(const boost::property_tree::ptree &run_conf);
+
+}  // ::daq
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_VME_SIM_HH_
+#define DAQ_FAST_CORE_INCLUDE_VME_SIM_HH_
+
+/*===========================================================================*\
+
+  file:   vme_sim.hh
+
+  about:  A software VME crate for running the vme workers without
+          hardware.  The crate holds a model of every vme device listed
+          under "devices" in the run config, placed at the device's
+          "base_address".  The models keep a register map and implement
+          the trigger, bank and readout logic the workers rely on, and
+          fill their buffers with synthetic pulses.
+
+          Triggers come from a single crate-wide clock at "trigger_rate",
+          so every board sees the same trigger sequence.  Each transaction
+          costs "latency_us", block transfers add their size divided by
+          "bandwidth_mbps", and opening the device costs "open_latency_us".
+          "noise" sets the sample noise in adc counts.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <chrono>
+
+//--- project includes ------------------------------------------------------//
+#include "common.hh"
+#include "vme_backend.hh"
+
+namespace daq {
+
+class SimCrate;
+
+// A pool of pre-generated pulses, so producing an event is a copy.
+class SimTraces {
+ public:
+  SimTraces(int length, int bits, double noise, unsigned seed);
+
+  // A pulse for the given trigger and channel.
+  const ushort *trace(unsigned long long trigger, int ch) const;
+  int length() const { return length_; }
+
+ private:
+  static const int kPoolSize = 16;
+
+  int length_;
+  std::vector<std::vector<ushort>> pool_;
+};
+
+// One board in the crate.  Unhandled registers behave as plain memory.
+class SimBoard {
+ public:
+  SimBoard(SimCrate &crate, uint window) : crate_(crate), window_(window){};
+  virtual ~SimBoard(){};
+
+  // Size of the board's address space.
+  uint window() const { return window_; }
+
+  virtual int Read(uint offset, uint &data);
+  virtual int Write(uint offset, uint data);
+  virtual int ReadBlock(uint offset, uint *data, uint num_words,
+                        uint &num_got);
+
+ protected:
+  SimCrate &crate_;
+  uint window_;
+  std::map<uint, uint> regs_;
+
+  // Copies a header and 16-bit samples as packed words, returns a bus
+  // error if more was asked for than the event holds.
+  int CopyEvent(const std::vector<uint> &header, const ushort *samples,
+                int num_samples, uint *data, uint num_words, uint &num_got);
+};
+
+// Dual bank digitizer, bank switching and per-channel readout FSM.
+class SimSis3316 : public SimBoard {
+ public:
+  explicit SimSis3316(SimCrate &crate);
+
+  int Read(uint offset, uint &data);
+  int Write(uint offset, uint data);
+  int ReadBlock(uint offset, uint *data, uint num_words, uint &num_got);
+
+ private:
+  SimTraces traces_;
+  int armed_bank_;
+  unsigned long long arm_trigger_;
+  int latched_bank_;
+  unsigned long long latched_trigger_;
+  int channel_;
+};
+
+// Single event digitizers rearmed after every readout.
+class SimSis3302 : public SimBoard {
+ public:
+  explicit SimSis3302(SimCrate &crate);
+
+  int Read(uint offset, uint &data);
+  int Write(uint offset, uint data);
+  int ReadBlock(uint offset, uint *data, uint num_words, uint &num_got);
+
+ private:
+  SimTraces traces_;
+  bool armed_;
+  unsigned long long arm_trigger_;
+  unsigned long long latched_trigger_;
+};
+
+class SimSis3350 : public SimBoard {
+ public:
+  explicit SimSis3350(SimCrate &crate);
+
+  int Read(uint offset, uint &data);
+  int Write(uint offset, uint data);
+  int ReadBlock(uint offset, uint *data, uint num_words, uint &num_got);
+
+ private:
+  SimTraces traces_;
+  bool armed_;
+  unsigned long long arm_trigger_;
+  unsigned long long latched_trigger_;
+  uint num_events_;  // events in memory, one after the other per channel
+
+  // In multi event mode the board stays armed for up to the max number
+  // of events, otherwise for one.
+  bool multi_event() { return regs_[0x10] & 0x20; }
+  uint EventCount();
+};
+
+// Peak sensing adc with a multi-event output buffer.
+class SimCaen1785 : public SimBoard {
+ public:
+  explicit SimCaen1785(SimCrate &crate);
+
+  int Read(uint offset, uint &data);
+  int Write(uint offset, uint data);
+
+  // Streams the buffered events, ending in BERR once they run out.
+  int ReadBlock(uint offset, uint *data, uint num_words, uint &num_got);
+
+ private:
+  static const int kBufferDepth = 32;
+  static const uint kEventWords = 2 * CAEN_1785_CH + 2;
+  unsigned long long consumed_;
+  uint pos_;  // next word of the current event in a block read
+
+  int Pending();
+
+  // Word idx of the current event, not valid datum past its end.
+  uint EventWord(uint idx);
+};
+
+// DRS4 digitizer with a multi-event buffer read out in BERR terminated
+// blocks.
+class SimCaen1742 : public SimBoard {
+ public:
+  explicit SimCaen1742(SimCrate &crate);
+
+  int Read(uint offset, uint &data);
+  int Write(uint offset, uint data);
+  int ReadBlock(uint offset, uint *data, uint num_words, uint &num_got);
+
+ private:
+  static const int kBufferDepth = 128;
+
+  SimTraces traces_;
+  bool running_;
+  unsigned long long consumed_;
+  std::vector<uint> event_;
+  uint pos_;
+
+  int Pending();
+  void BuildEvent(unsigned long long trigger);
+};
+
+class SimCrate : public VmeBackend, public CommonBase {
+ public:
+  // Returned for accesses no board answers, same as the sis3100 driver.
+  static const int kBusError = kVmeBusError;
+
+  SimCrate();
+
+  // Sets the timing from "vme_backend" and adds a board model for each
+  // vme device under "devices".
+  void LoadConfig(const boost::property_tree::ptree &run_conf);
+
+  // Places a model of a device type ("sis_3316", ...) at base_address.
+  bool AddBoard(const std::string &type, uint base_address);
+
+  // Number of triggers seen since the crate was configured.
+  unsigned long long TriggerCount();
+
+  // Value of a device clock running at clock_hz when a trigger arrived.
+  unsigned long long ClockAt(unsigned long long trigger, double clock_hz);
+
+  double noise() const { return noise_; }
+
+  int Open();
+  void Close(int dev);
+
+  int ReadD32(int dev, uint addr, uint *data);
+  int WriteD32(int dev, uint addr, uint data);
+  int ReadD16(int dev, uint addr, ushort *data);
+  int WriteD16(int dev, uint addr, ushort data);
+
+  int ReadBlock(int dev, VmeBlockMode mode, uint addr, uint *data,
+                uint num_words, uint *num_got);
+
+  // A chain pays the transaction latency once.
+  int ReadBlockChain(int dev, VmeBlockMode mode, VmeBlock *blocks,
+                     int num_blocks);
+
+ private:
+  std::map<uint, std::unique_ptr<SimBoard>> boards_;
+  std::mutex crate_mutex_;
+  std::chrono::steady_clock::time_point t0_;
+
+  double trigger_rate_;     // Hz
+  double latency_us_;       // per transaction
+  double open_latency_us_;  // per open of the device
+  double bandwidth_mbps_;   // block transfers
+  double noise_;            // adc counts
+
+  // Finds the board whose window holds addr, sets offset within it.
+  SimBoard *FindBoard(uint addr, uint &offset);
+
+  // Holds the caller for the modelled bus time.
+  void Wait(double us);
+};
+
+}  // ::daq
+
+#endif
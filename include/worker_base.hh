@@ -20,6 +20,7 @@
 #include <mutex>
 #include <thread>
 #include <string>
+#include <memory>
 
 //--- other includes --------------------------------------------------------//
 #include <boost/property_tree/ptree.hpp>
@@ -27,24 +28,95 @@
 
 //--- project includes ------------------------------------------------------//
 #include "common_base.hh"
+#include "config_cache.hh"
+#include "metrics.hh"
+#include "raw_stream.hh"
+#include "flow_control.hh"
+#include "busy_control.hh"
+#include "device_traits.hh"
 
 namespace daq {
 
+// Queue state of every worker in a WorkerList, stored as contiguous
+// arrays so the event builder can check all workers in a single scan.
+// Each worker owns one slot and publishes to it whenever its queue
+// changes; a worker has an event when its num_events slot is non-zero.
+struct WorkerStatus {
+  static const int kMaxWorkers = 64;
+
+  alignas(64) std::atomic<int> num_events[kMaxWorkers];
+
+  WorkerStatus() {
+    for (int i = 0; i < kMaxWorkers; ++i) {
+      num_events[i] = 0;
+    }
+  };
+};
+
+// Type-erased interface to a worker, lets the WorkerList hold and control
+// workers of every data type without knowing their data structs.
+class WorkerInterface : public CommonBase {
+ public:
+  explicit WorkerInterface(std::string name)
+      : CommonBase(name), status_(nullptr), slot_(0) {};
+
+  virtual ~WorkerInterface() {};
+
+  virtual void StartThread() = 0;
+  virtual void StopThread() = 0;
+  virtual void StartWorker() = 0;
+  virtual void StopWorker() = 0;
+  virtual void FlushEvents() = 0;
+  virtual void LoadConfig() = 0;
+
+  // Reprograms the device only if its config file changed since the last
+  // LoadConfig, returns whether it did.  Call between runs.
+  virtual bool ReloadConfig() = 0;
+
+  virtual int num_events() = 0;
+  virtual bool HasEvent() = 0;
+
+  // Sets the size and overflow policy of the event queue.
+  virtual void SetQueueLimits(const QueueLimits &limits) = 0;
+
+  // Pops the oldest event into its device vector in bundle.
+  virtual void PopEventInto(event_data &bundle) = 0;
+
+  // Assigns the status slot this worker publishes its queue state to.
+  void SetStatusSlot(WorkerStatus *status, int slot) {
+    status_ = status;
+    slot_ = slot;
+  };
+
+ protected:
+  WorkerStatus *status_;  // shared with the owning WorkerList
+  int slot_;              // index of this worker in status_
+};
+
 template <typename T>
-class WorkerBase : public CommonBase {
+class WorkerBase : public WorkerInterface {
  public:
   // Ctor params:
   //   name - used in naming the output data and monitor specific worker
   //   conf_file - used to load important configurable device parameters
   WorkerBase(std::string name, std::string conf_file)
-      : thread_live_(true),
+      : WorkerInterface(name),
+        name_(name),
         conf_file_(conf_file),
+        thread_live_(true),
         go_time_(false),
         has_event_(false),
-        CommonBase(name) {
+        busy_out_state_(-1),
+        events_read_(Metrics::Instance().GetCounter(name + ".events_read")),
+        events_dropped_(
+            Metrics::Instance().GetCounter(name + ".events_dropped")),
+        blocked_time_(Metrics::Instance().GetCounter(name + ".blocked_ns")),
+        t_blocked_(-1),
+        queue_depth_(Metrics::Instance().GetGauge(name + ".queue_depth")),
+        readout_time_(Metrics::Instance().GetHistogram(name + ".readout_ns")),
+        decode_time_(Metrics::Instance().GetHistogram(name + ".decode_ns")) {
     // Change the logfile if there is one in the config.
-    boost::property_tree::ptree conf;
-    boost::property_tree::read_json(conf_file_, conf);
+    const boost::property_tree::ptree &conf = ReadConfig();
     SetLogFile(conf.get<std::string>("logfile", logfile_));
   };
 
@@ -72,6 +144,8 @@ class WorkerBase : public CommonBase {
                   << std::endl;
       }
     }
+    OpenRawStream();
+
     std::cout << "Launching worker thread. " << std::endl;
     work_thread_ = std::thread(&WorkerBase<T>::WorkLoop, this);
   };
@@ -87,6 +161,11 @@ class WorkerBase : public CommonBase {
                   << std::endl;
       }
     }
+
+    if (raw_out_) {
+      LogMessage("recorded %lli raw records", raw_out_->num_records());
+      raw_out_.reset();
+    }
   };
 
   // Exit work loop to idle loop.
@@ -105,14 +184,40 @@ class WorkerBase : public CommonBase {
   };
   bool HasEvent() { return has_event_; };
 
+  void SetQueueLimits(const QueueLimits &limits) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    gate_.SetLimits(limits);
+  };
+
   // Pops all stale events on the device.
   void FlushEvents() {
     queue_mutex_.lock();
+    events_dropped_.Add(data_queue_.size());
     while (!data_queue_.empty()) {
       data_queue_.pop();
     }
+    UpdateQueueStatus();
     queue_mutex_.unlock();
-    has_event_ = false;
+  };
+
+  void PopEventInto(event_data &bundle) {
+    device_traits<T>::vec(bundle).push_back(PopEvent());
+  };
+
+  bool ReloadConfig() {
+    conf_ptr prev = loaded_conf_;
+    conf_ptr conf = ConfigCache::Instance().Load(conf_file_);
+
+    if (prev && (conf == prev)) return false;
+
+    if (prev) {
+      for (auto &key : ConfigCache::Diff(*prev, *conf)) {
+        LogMessage("config changed: %s", key.c_str());
+      }
+    }
+
+    LoadConfig();
+    return true;
   };
 
   // Abstract functions to be implented by descendants.
@@ -120,9 +225,9 @@ class WorkerBase : public CommonBase {
   virtual T PopEvent() = 0;  // T is the classes archetypal data struct
 
  protected:
-  const int max_queue_size_ = 100;
   std::string name_;               // given hardware name
   std::string conf_file_;          // configuration file
+  conf_ptr loaded_conf_;           // config the device was last set up with
   std::atomic<bool> thread_live_;  // keeps paused thread alive
   std::atomic<bool> go_time_;      // controls data taking
   std::atomic<bool> has_event_;    // useful for event building
@@ -130,8 +235,145 @@ class WorkerBase : public CommonBase {
 
   std::queue<T> data_queue_;  // stack to hold device events
   std::mutex queue_mutex_;    // mutex to protect data
+  QueueGate gate_;            // limits data_queue_, see flow_control.hh
+  BusySource busy_source_;    // data_queue_'s share of the busy
+  BusyOutput busy_output_;    // device output following the busy, if any
+  int busy_out_state_;        // last state written to it, -1 before any
   std::thread work_thread_;   // thread to launch work loop
 
+  // Live metrics, see metrics.hh.
+  Counter &events_read_;       // events read off the device
+  Counter &events_dropped_;    // events flushed or refused by the queue
+  Counter &blocked_time_;      // ns the device was left unread on a full queue
+  long long t_blocked_;        // MetricsNow when the block began, -1 if none
+  Gauge &queue_depth_;         // events waiting for the builder
+  Histogram &readout_time_;    // ns to pull an event off the device
+  Histogram &decode_time_;     // ns to unpack it into T
+
+  // Open while the run is recorded, see raw_stream.hh.
+  std::unique_ptr<RawStreamWriter> raw_out_;
+
+  // Returns the parsed config file and records it as the one in use, so
+  // LoadConfig implementations should read their settings through this.
+  const boost::property_tree::ptree &ReadConfig() {
+    loaded_conf_ = ConfigCache::Instance().Load(conf_file_);
+
+    busy_output_ = ReadBusyOutput(*loaded_conf_);
+    busy_out_state_ = -1;
+
+    return *loaded_conf_;
+  };
+
+  // Whether the queue is full under the block policy.  WorkLoops check
+  // this before reading the device and leave it alone while true, so a
+  // slow builder holds the hardware busy instead of losing events here.
+  bool QueueBlocked() {
+    // WorkLoops call this once a pass, from the thread that owns the
+    // device, so it is also where the busy output is kept up to date.
+    UpdateBusyOutput();
+
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    bool blocked = gate_.Blocked(data_queue_.size());
+
+    if (blocked && t_blocked_ < 0) {
+      t_blocked_ = MetricsNow();
+
+    } else if (!blocked && t_blocked_ >= 0) {
+      blocked_time_.Add(MetricsNow() - t_blocked_);
+      t_blocked_ = -1;
+    }
+
+    return blocked;
+  };
+
+  // Pushes a new event on the queue, or drops it or the oldest one as
+  // the queue policy says, and publishes the queue state.
+  void QueueEvent(const T &bundle) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    events_read_.Add();
+
+    switch (gate_.Admit(data_queue_.size())) {
+      case QueueAction::kDropNewest:
+        events_dropped_.Add();
+        return;
+
+      case QueueAction::kDropOldest:
+        data_queue_.pop();
+        events_dropped_.Add();
+        break;
+
+      default:
+        // A blocked queue still takes an event that is already read.
+        break;
+    }
+
+    data_queue_.push(bundle);
+    UpdateQueueStatus();
+  };
+
+  // Opens this worker's raw stream when the run is being recorded.
+  void OpenRawStream() {
+    raw_out_.reset();
+    if (GetRawStreamSettings().mode != RawStreamMode::kRecord) return;
+
+    std::string path = RawStreamPath(name_);
+    raw_out_.reset(new RawStreamWriter());
+
+    if (!raw_out_->Open(path, device_traits<T>::name(), name_)) {
+      LogError("could not open raw stream %s", path.c_str());
+      raw_out_.reset();
+    }
+  };
+
+  // Records a buffer as read from the device, call before decoding it.
+  // The first record of a stream is preceded by RecordRawSetup.
+  void RecordRaw(const void *data, size_t num_bytes,
+                 unsigned long long system_clock) {
+    if (!raw_out_) return;
+
+    if (raw_out_->num_records() == 0) {
+      RecordRawSetup();
+    }
+
+    if (!raw_out_->Write(kRawEvent, data, num_bytes, system_clock)) {
+      LogError("failed writing raw stream, recording stopped");
+      raw_out_.reset();
+    }
+  };
+
+  // Sets the busy output to the daq busy when that changed.
+  void UpdateBusyOutput() {
+    if (!busy_output_.in_use) return;
+
+    int busy = BusyControl::Instance().busy() ? 1 : 0;
+    if (busy != busy_out_state_) {
+      busy_out_state_ = busy;
+      SetBusyOutput(busy == 1);
+    }
+  };
+
+  // Writes the busy_output register, for devices that have one.
+  virtual void SetBusyOutput(bool) {
+    LogWarning("device has no busy output, ignoring busy_output");
+    busy_output_.in_use = false;
+  };
+
+  // Workers whose decoding depends on more than the event words write
+  // that state here as a kRawSetup record.
+  virtual void RecordRawSetup(){};
+
+  // Publishes the queue occupancy, call with queue_mutex_ held.
+  void UpdateQueueStatus() {
+    int size = data_queue_.size();
+    has_event_ = size > 0;
+    queue_depth_.Set(size);
+    busy_source_.Update(size, gate_.limits().max_size);
+
+    if (status_ != nullptr) {
+      status_->num_events[slot_].store(size, std::memory_order_release);
+    }
+  };
+
   // Constantly checks for an pulls new data onto the data_queue_.
   // Though it can be interrupted by setting go_time_ = false or
   // killed by thread_live_ = false.
@@ -10,17 +10,12 @@
 
 //--- project includes ------------------------------------------------------//
 #include "worker_vme.hh"
+#include "decode_kernels.hh"
 #include "common.hh"
 
 // This class pulls data from a caen_1742 device.
 namespace daq {
 
-typedef struct {
-  int16_t cell[CAEN_1742_CH][1024];
-  int8_t  nsample[CAEN_1742_CH][1024];
-  float   time[CAEN_1742_GR][1024];
-} drs_correction;
-
 class WorkerCaen1742 : public WorkerVme<caen_1742> {
 
  public:
@@ -96,6 +91,9 @@ private:
   bool drs_cell_corrections_;
   bool drs_peak_corrections_;
   bool drs_time_corrections_;
+  bool drs_loaded_;
+  drs_setup drs_;  // calibration read from the flash on first use
+  caen_1742 bundle_;  // read into before it is queued
 
   std::chrono::high_resolution_clock::time_point t0_;
 
@@ -110,23 +108,14 @@ private:
 
   // A function that runs through the three different DRS4 corrections
   // remove effects produce by imperfection in the domino sampling process.
-  int ApplyDataCorrection(caen_1742 &data, const std::vector<uint> &startcells);
-
-  // Subtracts off an average inherent bias in the chip based on the sampling
-  // start index in the domino ring cycle.
-  int CellCorrection(caen_1742 &data, 
-		     const drs_correction &table, 
-		     const std::vector<uint> &startcells);
-
-  // Check each channel for spikes above threshold and remove it if present
-  // in all channels for a group.
-  int PeakCorrection(caen_1742 &data, const drs_correction &table);
-
-  // Interpolates values to on evenly spaced grid from the unevenly sampled
-  // values reported by the DRS4
-  int TimeCorrection(caen_1742 &data, 
-		     const drs_correction &table, 
-		     const std::vector<uint> &startcells);
+  int ApplyDataCorrection(caen_1742 &data, const uint startcells[CAEN_1742_GR]);
+
+  // Reads the calibration from the flash if not done yet and brings the
+  // correction settings up to date.
+  void LoadDrsSetup();
+
+  // The DRS4 setup goes into raw streams, replay needs it to decode.
+  void RecordRawSetup();
 
   // Readout correction data from the board.
   int GetCorrectionData(drs_correction &table);
@@ -2,6 +2,7 @@
 #define DAQ_FAST_CORE_INCLUDE_WORKER_CAEN1785_HH_
 
 //--- std includes ----------------------------------------------------------//
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
@@ -10,9 +11,10 @@
 
 //--- project includes ------------------------------------------------------//
 #include "worker_vme.hh"
+#include "decode_kernels.hh"
 #include "common.hh"
 
-// This class pulls data from a sis_3350 device.
+// This class pulls data from a caen_1785 device.
 namespace daq {
 
 class WorkerCaen1785 : public WorkerVme<caen_1785> {
@@ -27,20 +29,43 @@ public:
   // {
   // 	"device":"/dev/sis1100_00remote",
   // 	"base_address":"0x02000000",
-  // 	"read_low_adc":true
+  // 	"read_low_adc":true,
+  // 	"readout":"mblt64"
   // }
+  //
+  // "readout" is "single" to read each event a word at a time, or "blt32"
+  // or "mblt64" to read all buffered events in one BERR terminated block.
   void LoadConfig();
 
   // Thread that collects data from the device.
   void WorkLoop();
 
+  // Starts the event counter and block parsing over for a new run.
+  void StartThread() {
+    counter_started_ = false;
+    num_carried_ = 0;
+    WorkerVme<caen_1785>::StartThread();
+  };
+
   // Return the oldest event to the event builder/frontend.
   caen_1785 PopEvent();
   
 private:
   
+  // The output buffer spans 0x0000 - 0x07ff.
+  static const int kOutputWords = 0x800 / 4;
+
   std::chrono::high_resolution_clock::time_point t0_;
   bool read_low_adc_;
+
+  bool block_readout_;
+  VmeBlockMode block_mode_;
+  int num_carried_;  // words of an event cut off by the last block, which
+                    // the next block is read in behind
+
+  bool counter_started_;
+  ULong64_t event_index_;  // the board's 24-bit event counter, extended
+  Counter &events_lost_;   // gaps in the event counter
   
   // Ask device if it has an event.
   bool EventAvailable();
@@ -51,8 +76,26 @@ private:
     Write16(0x1034, 0x4);
   };
 
-  // Read out the event data and add it to the queue.
-  void GetEvent(caen_1785 &bundle);
+  // Reads one event from the output buffer into the readout buffer and
+  // decodes it into bundle.  False if there is no readout buffer.
+  bool GetEvent(caen_1785 &bundle);
+
+  // Reads the output buffer in one block and queues every whole event
+  // in it.  Returns the number of events queued.
+  int GetEvents();
+
+  // Milliseconds since the worker started.
+  ULong64_t SystemClock();
+
+  // Extends the event index past the counter's wrap, counting any events
+  // the board skipped since the last one.
+  void SetEventIndex(caen_1785 &bundle);
+
+  // The range read goes into raw streams, replay needs it to decode.
+  void RecordRawSetup() {
+    uint32_t setup = read_low_adc_;
+    raw_out_->Write(kRawSetup, &setup, sizeof(setup), 0);
+  };
 
 };
 
@@ -36,6 +36,7 @@ public:
   //         "sampling_rate":1.0,
   //         "pretrigger_delay":50,
   // 	"use_drs4_corrections":true,
+  //    "blt_events":1,
   // 	"channel_offset":[
   // 	    0.15,
   // 	    0.15,
@@ -70,6 +71,8 @@ private:
   int device_;
   uint size_, bsize_;
   char *buffer_;
+  uint num_block_events_;  // events in buffer_
+  caen_6742 bundle_;       // decoded into before it is queued
 
   std::chrono::high_resolution_clock::time_point t0_;
 
@@ -80,8 +83,11 @@ private:
   // Ask the device if it has data.
   bool EventAvailable();
 
-  // Read out the data and add it to the queue.
-  bool GetEvent(caen_6742 &bundle);
+  // Decodes event index of the last block read, false if it is invalid.
+  bool GetEvent(caen_6742 &bundle, uint index);
+
+  // Read-modify-writes the busy_output register.
+  void SetBusyOutput(bool busy);
 
 };
 
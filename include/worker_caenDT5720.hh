@@ -14,11 +14,7 @@ class WorkerCaenDT5720 : public WorkerCaenUSBBase<caen_5720> {
   void LoadConfig();
 
  protected:
-  caen_5720 GetEvent() override;
-
- private:
-  CAEN_DGTZ_UINT16_EVENT_t* event_;
-  char* event_ptr_;
+  caen_5720 GetEvent(const uint* event, int num_words) override;
 };
 }  //::daq
 
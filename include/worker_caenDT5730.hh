@@ -14,11 +14,7 @@ class WorkerCaenDT5730 : public WorkerCaenUSBBase<caen_5730> {
   void LoadConfig();
 
  protected:
-  caen_5730 GetEvent() override;
-
- private:
-  CAEN_DGTZ_UINT16_EVENT_t* event_;
-  char* event_ptr_;
+  caen_5730 GetEvent(const uint* event, int num_words) override;
 };
 }  //::daq
 
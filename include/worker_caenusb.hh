@@ -2,19 +2,31 @@
 #define DAQ_FAST_CORE_INCLUDE_WORKER_CAENUSBBASE_HH_
 
 //--- std includes ----------------------------------------------------------//
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
 
 //--- other includes --------------------------------------------------------//
 #include "CAENDigitizer.h"
 
 //--- project includes ------------------------------------------------------//
 #include "worker_base.hh"
+#include "decode_kernels.hh"
+#include "clock_fit.hh"
 #include "common.hh"
 
 namespace daq {
 
 /**
  * base class for caen usb digitizers
+ *
+ * A readout thread owns the device and transfers blocks into a ring of
+ * "readout_buffers" buffers (default 2), while the work thread decodes
+ * the blocks already read.  The next USB transfer is then in flight
+ * while the last one is decoded.
  */
 template <typename T>
 class WorkerCaenUSBBase : public WorkerBase<T> {
@@ -22,10 +34,12 @@ class WorkerCaenUSBBase : public WorkerBase<T> {
   WorkerCaenUSBBase(std::string name, std::string conf)
       : WorkerBase<T>(name, conf),
         device_(0),
-        size_(0),
-        bsize_(0),
-        buffer_(nullptr) {
-    LoadConfig();
+        extended_time_tag_(false),
+        clock_fit_(name),
+        clock_fit_in_use_(false),
+        num_buffers_(2),
+        reading_(false) {
+    OpenDevice();
   }
 
   virtual ~WorkerCaenUSBBase() {
@@ -35,12 +49,41 @@ class WorkerCaenUSBBase : public WorkerBase<T> {
     }
   }
 
+  // Reads the config and programs what every board shares.  The device
+  // LoadConfig calls it first, so a reload sees the current file.
   void LoadConfig() override;
 
+  // Start and join the readout thread along with the work thread.
+  void StartThread() override;
+  void StopThread() override;
+
+  // Also drops the blocks read but not yet decoded, waiting out the one
+  // being decoded so none of its events are queued after the flush.
+  void FlushEvents() override;
+
   T PopEvent() override;
 
  protected:
-  virtual T GetEvent() = 0;
+  // Decodes the num_words of one event in a block.  Called from the work
+  // thread, so it must not call into the library while the readout
+  // thread may be using the device.
+  virtual T GetEvent(const uint* event, int num_words) = 0;
+
+  // Opens the board named by "device_id", once, in the ctor.
+  void OpenDevice();
+
+  // Programs "record_length" and "channel_mask" from the config, by
+  // default the max_len samples and num_ch channels of T.  Call first
+  // thing in the device LoadConfig, the post trigger and the buffers
+  // depend on the record length.
+  void LoadChannelSetup(uint32_t num_ch, uint32_t max_len);
+
+  // Allocates the readout buffers.  Call from the device LoadConfig once
+  // the record length is set, they are sized for it and the BLT size.
+  void AllocateBuffers();
+
+  // Frees them, the threads must be stopped.
+  void FreeBuffers();
 
   virtual void StartAcquisition() {
     if (CAEN_DGTZ_SWStartAcquisition(device_)) {
@@ -56,28 +99,76 @@ class WorkerCaenUSBBase : public WorkerBase<T> {
 
   void WorkLoop() override;
 
+  // Read-modify-writes the busy_output register.  Called from the
+  // readout thread, which does all the device access during a run.
+  void SetBusyOutput(bool busy) override;
+
+  // The tag width goes into raw streams, replay needs it to decode.
+  void RecordRawSetup() override {
+    uint32_t setup = extended_time_tag_ ? 48 : 31;
+    this->raw_out_->Write(kRawSetup, &setup, sizeof(setup), 0);
+  };
+
   boost::property_tree::ptree conf_;
 
   std::chrono::high_resolution_clock::time_point t0_;
 
   int device_;
 
-  uint32_t size_, bsize_;
-  char* buffer_;
-
   CAEN_DGTZ_BoardInfo_t board_info_;
-  CAEN_DGTZ_EventInfo_t event_info_;
+
+  // The trigger time tag, 31 bits unless a device class extends it to
+  // 48 with the header's pattern bits.
+  TimeTagClock time_tag_;
+  bool extended_time_tag_;
 
  private:
-  bool EventAvailable();
+  struct ReadoutBlock {
+    char* buffer;
+    uint32_t size;        // allocated
+    uint32_t bsize;       // read
+    uint32_t num_events;  // in the data read
+    long long host_ns;    // MetricsNow when the read returned
+  };
+
+  ClockFit clock_fit_;
+  bool clock_fit_in_use_;
+
+  int num_buffers_;
+  std::vector<ReadoutBlock> blocks_;
+
+  // Indices into blocks_, each block is in one queue or held by a thread.
+  std::mutex block_mutex_;
+  std::deque<int> free_blocks_;
+  std::deque<int> full_blocks_;
+
+  // Held by the work thread while it decodes a block.
+  std::mutex decode_mutex_;
+
+  std::thread readout_thread_;
+  std::atomic<bool> reading_;  // ReadoutLoop may still fill a block
+
+  // Pops the front of a block queue, -1 if it is empty.
+  int TakeBlock(std::deque<int>& blocks);
+  void PutBlock(std::deque<int>& blocks, int idx);
+
+  // Transfers whatever the device holds, false if there were no events.
+  bool ReadBlock(ReadoutBlock& block);
+
+  // Decodes and queues every event of a block, found from the size in
+  // each event's header rather than the library, which the readout
+  // thread is using.
+  void DecodeBlock(const ReadoutBlock& block);
+
+  // Reads blocks while the run is on.
+  void ReadoutLoop();
 };
 
 template <typename T>
-void WorkerCaenUSBBase<T>::LoadConfig() {
-  boost::property_tree::read_json(this->conf_file_, conf_);
-
+void WorkerCaenUSBBase<T>::OpenDevice() {
   CAEN_DGTZ_ErrorCode ret;
 
+  conf_ = this->ReadConfig();
   int id = conf_.get<int>("device_id");
 
   if (ret = CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_USB, id, 0, 0, &device_)) {
@@ -98,6 +189,11 @@ void WorkerCaenUSBBase<T>::LoadConfig() {
     this->LogMessage("Found caen %s.", board_info_.ModelName);
     this->LogMessage("Serial Number: %i.", board_info_.SerialNumber);
   }
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::LoadConfig() {
+  conf_ = this->ReadConfig();
 
   this->LogMessage("set sw trigger mode");
   if (CAEN_DGTZ_SetSWTriggerMode(device_, CAEN_DGTZ_TRGMODE_ACQ_ONLY)) {
@@ -109,10 +205,28 @@ void WorkerCaenUSBBase<T>::LoadConfig() {
     this->LogError("failed to enable ext trigger");
   }
 
-  if (CAEN_DGTZ_SetMaxNumEventsBLT(device_, 1)) {
+  // Each ReadData costs a USB round trip, so at high rates a block of
+  // several events is read at once.
+  int blt_events = conf_.get<int>("blt_events", 1);
+  if (blt_events < 1 || blt_events > 1023) {
+    this->LogWarning("blt_events %i is invalid, using 1", blt_events);
+    blt_events = 1;
+  }
+
+  if (CAEN_DGTZ_SetMaxNumEventsBLT(device_, blt_events)) {
     this->LogError("failed to set max BLT events");
   }
 
+  time_tag_.SetTag(31, conf_.get<double>("time_tag_ns", 8.0));
+  extended_time_tag_ = false;
+  clock_fit_in_use_ = clock_fit_.Configure(conf_);
+
+  num_buffers_ = conf_.get<int>("readout_buffers", 2);
+  if (num_buffers_ < 1 || num_buffers_ > 16) {
+    this->LogWarning("readout_buffers %i is invalid, using 2", num_buffers_);
+    num_buffers_ = 2;
+  }
+
   // rest of stuff should be done in base class
   // set acquisition mode, allocate buffers,
   // device specific settings, etc
@@ -121,20 +235,160 @@ void WorkerCaenUSBBase<T>::LoadConfig() {
 }
 
 template <typename T>
-void WorkerCaenUSBBase<T>::WorkLoop() {
-  CAEN_DGTZ_ErrorCode ret;
+void WorkerCaenUSBBase<T>::StartThread() {
+  // The board restarts its time tag along with the acquisition.
+  time_tag_.Reset();
+  clock_fit_.Reset();
+
+  reading_ = true;
+  WorkerBase<T>::StartThread();
+
+  if (readout_thread_.joinable()) {
+    try {
+      readout_thread_.join();
+    } catch (...) {
+      this->LogError("readout thread had race condition joining");
+    }
+  }
+
+  readout_thread_ = std::thread(&WorkerCaenUSBBase<T>::ReadoutLoop, this);
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::StopThread() {
+  this->thread_live_ = false;
+
+  if (readout_thread_.joinable()) {
+    try {
+      readout_thread_.join();
+    } catch (const std::system_error& e) {
+      this->LogError("readout thread had race condition joining");
+    }
+  }
+
+  WorkerBase<T>::StopThread();
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::FlushEvents() {
+  {
+    std::lock_guard<std::mutex> decode_lock(decode_mutex_);
+    std::lock_guard<std::mutex> lock(block_mutex_);
+
+    for (int idx : full_blocks_) {
+      this->events_dropped_.Add(blocks_[idx].num_events);
+      free_blocks_.push_back(idx);
+    }
+
+    full_blocks_.clear();
+  }
+
+  WorkerBase<T>::FlushEvents();
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::LoadChannelSetup(uint32_t num_ch,
+                                            uint32_t max_len) {
+  // The board only sends the enabled channels and record_length samples
+  // of each, the decoder zeroes the rest of the trace.
+  uint32_t record_length = conf_.get<uint32_t>("record_length", max_len);
+  if (record_length < 2 || record_length > max_len || record_length % 2) {
+    this->LogWarning("record_length %u is invalid, using %u", record_length,
+                     max_len);
+    record_length = max_len;
+  }
 
+  uint32_t all_channels = (1 << num_ch) - 1;
+  uint32_t mask = std::stoul(
+      conf_.get<std::string>("channel_mask", std::to_string(all_channels)),
+      nullptr, 0);
+
+  if (mask == 0 || (mask & ~all_channels)) {
+    this->LogWarning("channel_mask 0x%x is invalid, using 0x%x", mask,
+                     all_channels);
+    mask = all_channels;
+  }
+
+  if (CAEN_DGTZ_SetRecordLength(device_, record_length)) {
+    this->LogError("failed to set record length to %u", record_length);
+  }
+
+  if (CAEN_DGTZ_SetChannelEnableMask(device_, mask)) {
+    this->LogError("failed to set channel enable mask to 0x%x", mask);
+  }
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::AllocateBuffers() {
+  FreeBuffers();
+
+  std::lock_guard<std::mutex> lock(block_mutex_);
+
+  for (int i = 0; i < num_buffers_; ++i) {
+    ReadoutBlock block;
+    block.buffer = nullptr;
+    block.size = block.bsize = block.num_events = 0;
+    block.host_ns = 0;
+
+    if (CAEN_DGTZ_MallocReadoutBuffer(device_, &block.buffer, &block.size)) {
+      this->LogError("failed to allocate readout buffer.");
+      break;
+    }
+
+    blocks_.push_back(block);
+    free_blocks_.push_back(i);
+  }
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::FreeBuffers() {
+  std::lock_guard<std::mutex> lock(block_mutex_);
+
+  for (auto& block : blocks_) {
+    if (CAEN_DGTZ_FreeReadoutBuffer(&block.buffer)) {
+      this->LogError("failed to free readout buffer");
+    }
+  }
+
+  blocks_.clear();
+  free_blocks_.clear();
+  full_blocks_.clear();
+}
+
+template <typename T>
+int WorkerCaenUSBBase<T>::TakeBlock(std::deque<int>& blocks) {
+  std::lock_guard<std::mutex> lock(block_mutex_);
+  if (blocks.empty()) return -1;
+
+  int idx = blocks.front();
+  blocks.pop_front();
+  return idx;
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::PutBlock(std::deque<int>& blocks, int idx) {
+  std::lock_guard<std::mutex> lock(block_mutex_);
+  blocks.push_back(idx);
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::ReadoutLoop() {
   t0_ = std::chrono::high_resolution_clock::now();
 
   StartAcquisition();
   while (this->thread_live_) {
     while (this->go_time_) {
-      if (EventAvailable()) {
-        T bundle = GetEvent();
-
-        std::lock_guard<std::mutex> lock(this->queue_mutex_);
-        this->data_queue_.push(bundle);
-        this->has_event_ = true;
+      // With every block waiting on the decoder the device fills up, as
+      // it does while the queue is blocked.
+      int idx = this->QueueBlocked() ? -1 : TakeBlock(free_blocks_);
+
+      if (idx >= 0) {
+        if (ReadBlock(blocks_[idx])) {
+          PutBlock(full_blocks_, idx);
+        } else {
+          PutBlock(free_blocks_, idx);
+          usleep(daq::short_sleep);
+        }
       } else {
         std::this_thread::yield();
         usleep(daq::short_sleep);
@@ -145,6 +399,90 @@ void WorkerCaenUSBBase<T>::WorkLoop() {
     usleep(daq::long_sleep);
   }
   StopAcquisition();
+
+  reading_ = false;
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::WorkLoop() {
+  while (true) {
+    // Blocks read before a stop are still decoded, so the end of a run
+    // drains like the other workers.  Checked before taking a block, so
+    // once the readout thread is done an empty queue stays empty.
+    bool done = !this->thread_live_ && !reading_;
+
+    std::unique_lock<std::mutex> decode_lock(decode_mutex_);
+    int idx = TakeBlock(full_blocks_);
+
+    if (idx >= 0) {
+      DecodeBlock(blocks_[idx]);
+      PutBlock(free_blocks_, idx);
+      continue;
+    }
+
+    decode_lock.unlock();
+    if (done) break;
+
+    std::this_thread::yield();
+    usleep(this->go_time_ ? daq::short_sleep : daq::long_sleep);
+  }
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::DecodeBlock(const ReadoutBlock& block) {
+  const uint* words = (const uint*)block.buffer;
+  int num_words = block.bsize / sizeof(uint);
+  int pos = 0;
+
+  for (uint32_t i = 0; i < block.num_events; ++i) {
+    long long t_read = MetricsNow();
+
+    int size = CaenStdEventSize(words + pos, num_words - pos);
+    if (size < 0) {
+      this->LogError("event %u of %u in the block is malformed", i,
+                     block.num_events);
+      this->events_dropped_.Add(block.num_events - i);
+      break;
+    }
+
+    const uint* event = words + pos;
+    pos += size;
+
+    T bundle = GetEvent(event, size);
+
+    uint64_t tag = bundle.device_clock;
+    if (extended_time_tag_) {
+      tag |= (uint64_t)((event[1] >> 8) & 0xffff) << 32;
+    }
+
+    bundle.host_clock = block.host_ns;
+    bundle.device_clock = time_tag_.Extend(tag, block.host_ns);
+
+    if (clock_fit_in_use_) {
+      clock_fit_.Add(block.host_ns, bundle.device_clock * time_tag_.tick_ns());
+    }
+
+    this->decode_time_.Record(MetricsNow() - t_read);
+
+    // Each event's own words, so a replay can decode them alone.
+    this->RecordRaw(event, size * sizeof(uint), bundle.system_clock);
+    this->QueueEvent(bundle);
+  }
+}
+
+template <typename T>
+void WorkerCaenUSBBase<T>::SetBusyOutput(bool busy) {
+  const BusyOutput &out = this->busy_output_;
+  uint32_t msg = 0;
+
+  if (CAEN_DGTZ_ReadRegister(device_, out.reg, &msg)) {
+    this->LogError("failed to read busy output register 0x%x", out.reg);
+    return;
+  }
+
+  if (CAEN_DGTZ_WriteRegister(device_, out.reg, out.Apply(msg, busy))) {
+    this->LogError("failed to write busy output register 0x%x", out.reg);
+  }
 }
 
 template <typename T>
@@ -161,30 +499,39 @@ T WorkerCaenUSBBase<T>::PopEvent() {
     return empty_structure;
 
   } else {
-    // Check if this is that last event.
-    if (this->data_queue_.size() == 1) this->has_event_ = false;
-
     // Copy the data.
     T data = this->data_queue_.front();
     this->data_queue_.pop();
 
+    // Publish the new queue size.
+    this->UpdateQueueStatus();
+
     return data;
   }
 }
 
 template <typename T>
-bool WorkerCaenUSBBase<T>::EventAvailable() {
+bool WorkerCaenUSBBase<T>::ReadBlock(ReadoutBlock& block) {
+  long long t_start = MetricsNow();
+
+  block.bsize = 0;
   if (CAEN_DGTZ_ReadData(device_, CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT,
-                         buffer_, &bsize_)) {
+                         block.buffer, &block.bsize)) {
     this->LogError("failed to read data");
   }
+  block.host_ns = MetricsNow();
 
-  uint32_t num_events;
-  if (CAEN_DGTZ_GetNumEvents(device_, buffer_, bsize_, &num_events)) {
+  block.num_events = 0;
+  if (CAEN_DGTZ_GetNumEvents(device_, block.buffer, block.bsize,
+                             &block.num_events)) {
     this->LogError("failed to get num events");
   }
 
-  return num_events > 0;
+  if (block.num_events > 0) {
+    this->readout_time_.Record(MetricsNow() - t_start);
+  }
+
+  return block.num_events > 0;
 }
 
 }  // ::daq
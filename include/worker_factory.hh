@@ -0,0 +1,96 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_WORKER_FACTORY_HH_
+#define DAQ_FAST_CORE_INCLUDE_WORKER_FACTORY_HH_
+
+/*===========================================================================*\
+
+  file:   worker_factory.hh
+
+  about:  A registry of worker types keyed by the name used under
+          "devices" in the run config.  Each worker registers itself
+          at static initialization with a WorkerRegistrar, so a frontend
+          only knows the worker types it was linked (or loaded) with.
+          Extra workers can be built as shared objects and listed in
+          the run config, e.g.
+
+          {
+              "worker_plugins":["lib/libworker_sis3316.so"],
+              "devices": {
+                  "sis_3316": {
+                      "sis_0":"sis_3316_0.json"
+                  }
+              }
+          }
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+
+//--- project includes ------------------------------------------------------//
+#include "worker_base.hh"
+
+namespace daq {
+
+class WorkerList;
+
+class WorkerFactory : public CommonBase {
+ public:
+  typedef std::function<WorkerInterface *(std::string, std::string)> creator;
+
+  // The single factory shared by all workers and plugins.
+  static WorkerFactory &Instance();
+
+  // Adds a worker type, returns false if the type is already registered.
+  // Runs during static initialization, so it must not log.
+  bool Register(const std::string &type, creator create);
+
+  // Checks whether a worker type is known.
+  bool HasType(const std::string &type);
+
+  // Returns the registered worker types.
+  std::vector<std::string> Types();
+
+  // Allocates a new worker of the given type, nullptr if unknown.
+  WorkerInterface *Create(const std::string &type, const std::string &name,
+                          const std::string &conf_file);
+
+  // Opens a shared object, whose registrars add its worker types.
+  bool LoadPlugin(const std::string &path);
+
+  // Loads the "worker_plugins" and appends a worker for every entry under
+  // "devices" in the run config.  Relative device config paths are taken
+  // from conf_dir.  The workers are constructed in parallel on
+  // "init_threads" threads (default one per device), and this returns
+  // once all of them are configured.  Returns the number of workers
+  // actually created and added to the list.
+  int AddWorkers(const std::string &conf_file, WorkerList &workers);
+
+ private:
+  WorkerFactory() : CommonBase(std::string("WorkerFactory")){};
+
+  std::map<std::string, creator> creators_;
+  std::vector<void *> plugins_;
+  std::mutex factory_mutex_;
+};
+
+// Registers a worker class with the factory, e.g. in worker_sis3316.cxx
+//   static WorkerRegistrar<WorkerSis3316> sis3316_registrar("sis_3316");
+template <typename W>
+class WorkerRegistrar {
+ public:
+  explicit WorkerRegistrar(const std::string &type) {
+    WorkerFactory::Instance().Register(type, &WorkerRegistrar<W>::Create);
+  };
+
+ private:
+  static WorkerInterface *Create(std::string name, std::string conf_file) {
+    return new W(name, conf_file);
+  };
+};
+
+}  // ::daq
+
+#endif
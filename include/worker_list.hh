@@ -16,12 +16,16 @@
 
 //--- std includes ----------------------------------------------------------//
 #include <vector>
-
-//--- other includes --------------------------------------------------------//
-#include <boost/variant.hpp>
+#include <memory>
+#include <limits>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <exception>
 
 //--- project includes ------------------------------------------------------//
 #include "common.hh"
+#include "device_traits.hh"
 #include "worker_sis3302.hh"
 #include "worker_sis3316.hh"
 #include "worker_sis3350.hh"
@@ -37,7 +41,9 @@ namespace daq {
 class WorkerList : public CommonBase {
  public:
   // ctor
-  WorkerList() : CommonBase(std::string("WorkerList")){};
+  WorkerList()
+      : CommonBase(std::string("WorkerList")),
+        status_(std::make_shared<WorkerStatus>()){};
 
   // dtor - the WorkerList takes ownership of workers appended to
   // its worker vector.  They can be freed externally, but we need to
@@ -75,14 +81,38 @@ class WorkerList : public CommonBase {
   // Checks if any workers have more than a single event.
   bool AnyWorkersHaveMultiEvent();
 
+  // Finds the fewest and most queued events over all workers in a single
+  // scan of the status block.
+  void GetEventCounts(int &min_events, int &max_events);
+
   // Copies event data into bundle.
   void GetEventData(event_data &bundle);
 
   // Flush all stale events.  Each worker has no events after this.
   void FlushEventData();
 
-  // Add a newly allocated worker to the current list.
-  void PushBack(worker_ptr_types worker) { workers_.push_back(worker); }
+  // Add a newly allocated worker to the current list, which takes
+  // ownership of it.  Returns false and deletes the worker if the list
+  // already holds kMaxWorkers.
+  bool PushBack(WorkerInterface *worker);
+
+  // Queue a worker to be constructed by InitWorkers.  The creator should
+  // allocate the worker, which configures the device in its ctor.
+  void PushBackDeferred(std::function<WorkerInterface *()> create) {
+    pending_.push_back(create);
+  };
+
+  // Constructs all queued workers concurrently on a pool of num_threads
+  // threads (one per worker if 0) and waits for every one of them.  Vme
+  // transactions still go one at a time through vme_mutex, so boards on
+  // a crate interleave their bus traffic and overlap their many sleeps.
+  // Workers are appended in the order they were queued.  Returns the
+  // number of workers actually added to the list.
+  int InitWorkers(int num_threads = 0);
+
+  // Reprograms only the workers whose config files changed since they
+  // were last configured.  Call between runs, returns the number reloaded.
+  int ReloadConfig();
 
   // Deallocates each worker.
   void FreeList();
@@ -93,7 +123,13 @@ class WorkerList : public CommonBase {
 
  private:
   // This is the actual worker list.
-  std::vector<worker_ptr_types> workers_;
+  std::vector<WorkerInterface *> workers_;
+
+  // Queue state published by the workers, shared by copies of the list.
+  std::shared_ptr<WorkerStatus> status_;
+
+  // Workers waiting to be constructed by InitWorkers.
+  std::vector<std::function<WorkerInterface *()> > pending_;
 };
 
 }  // ::daq
@@ -0,0 +1,282 @@
+#ifndef DAQ_FAST_CORE_INCLUDE_WORKER_REPLAY_HH_
+#define DAQ_FAST_CORE_INCLUDE_WORKER_REPLAY_HH_
+
+/*===========================================================================*\
+
+  file:   worker_replay.hh
+
+  about:  Workers that stand in for the hardware when "raw_stream.mode"
+          is "replay".  Each reads the stream its hardware counterpart
+          recorded under the same name and decodes the raw buffers with
+          the same kernels, so the builder and writers see the original
+          events without a crate.  The factory makes them under the
+          device type prefixed by "replay:", e.g. "replay:sis_3316".
+
+          The DT5720 and DT5730 record each event's words as they sit
+          in the readout block, the V6742 is recorded but decoded by
+          the CAEN library, which needs the board, so it can't be
+          replayed.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//--- project includes ------------------------------------------------------//
+#include "worker_base.hh"
+#include "raw_stream.hh"
+#include "decode_kernels.hh"
+#include "clock_fit.hh"
+#include "common.hh"
+
+namespace daq {
+
+// Turns the payloads of a worker's raw stream back into events.  Each
+// replayable device has a specialization in worker_replay.cxx with
+//   Setup(payload)         - takes a kRawSetup record
+//   Decode(payload, data)  - decodes a kRawEvent record, false if the
+//                            payload doesn't fit the device
+template <typename T>
+class RawDecoder;
+
+template <>
+class RawDecoder<sis_3350> {
+ public:
+  void Setup(const std::vector<char> &){};
+  bool Decode(const std::vector<char> &payload, sis_3350 &bundle);
+};
+
+template <>
+class RawDecoder<sis_3302> {
+ public:
+  void Setup(const std::vector<char> &){};
+  bool Decode(const std::vector<char> &payload, sis_3302 &bundle);
+};
+
+template <>
+class RawDecoder<sis_3316> {
+ public:
+  void Setup(const std::vector<char> &){};
+  bool Decode(const std::vector<char> &payload, sis_3316 &bundle);
+};
+
+template <>
+class RawDecoder<caen_1785> {
+ public:
+  RawDecoder() : read_low_adc_(false){};
+
+  void Setup(const std::vector<char> &payload);
+  bool Decode(const std::vector<char> &payload, caen_1785 &bundle);
+
+ private:
+  bool read_low_adc_;
+};
+
+template <>
+class RawDecoder<caen_1742> {
+ public:
+  RawDecoder() : has_setup_(false){};
+
+  void Setup(const std::vector<char> &payload);
+  bool Decode(const std::vector<char> &payload, caen_1742 &bundle);
+
+ private:
+  bool has_setup_;
+  drs_setup drs_;
+};
+
+// The time tags are extended from the stream alone, without the host
+// time, which isn't recorded.  The setup record gives the tag width, 31
+// bits for streams recorded without one.
+template <>
+class RawDecoder<caen_5720> {
+ public:
+  RawDecoder() : extended_time_tag_(false){};
+
+  void Setup(const std::vector<char> &payload);
+  bool Decode(const std::vector<char> &payload, caen_5720 &bundle);
+
+ private:
+  TimeTagClock time_tag_;
+  bool extended_time_tag_;
+};
+
+template <>
+class RawDecoder<caen_5730> {
+ public:
+  RawDecoder() : extended_time_tag_(false){};
+
+  void Setup(const std::vector<char> &payload);
+  bool Decode(const std::vector<char> &payload, caen_5730 &bundle);
+
+ private:
+  TimeTagClock time_tag_;
+  bool extended_time_tag_;
+};
+
+template <typename T>
+class WorkerReplay : public WorkerBase<T> {
+ public:
+  // The conf file is the device's usual one, only its logfile is used.
+  WorkerReplay(std::string name, std::string conf);
+
+  // Opens the stream recorded under this worker's name.
+  void LoadConfig();
+
+  // Hands out the recorded events, paced or as fast as they are taken.
+  void WorkLoop();
+
+  T PopEvent();
+
+ private:
+  RawStreamReader reader_;
+  RawDecoder<T> decoder_;
+  RawRecord record_;
+  T bundle_;  // decoded into in place, like the hardware workers do
+  bool paced_;
+  bool loop_;
+  bool stream_ok_;
+
+  // Waits until the event is due at the recorded pace, or until the
+  // builder has room for it when running fast or blocked.  False if the
+  // run stopped while waiting.
+  bool WaitForTurn(long long t_event, long long t_first, long long t_start);
+};
+
+template <typename T>
+WorkerReplay<T>::WorkerReplay(std::string name, std::string conf)
+    : WorkerBase<T>(name, conf), stream_ok_(false) {
+  LoadConfig();
+}
+
+template <typename T>
+void WorkerReplay<T>::LoadConfig() {
+  RawStreamSettings settings = GetRawStreamSettings();
+  std::string path = RawStreamPath(this->name_);
+
+  paced_ = settings.paced;
+  loop_ = settings.loop;
+  stream_ok_ = reader_.Open(path);
+
+  if (!stream_ok_) {
+    this->LogError("could not open raw stream %s", path.c_str());
+
+  } else if (std::string(reader_.header().type) != device_traits<T>::name()) {
+    this->LogError("raw stream %s holds %s data, not %s", path.c_str(),
+                   reader_.header().type, device_traits<T>::name());
+    stream_ok_ = false;
+
+  } else {
+    this->LogMessage("replaying %s", path.c_str());
+  }
+}
+
+template <typename T>
+void WorkerReplay<T>::WorkLoop() {
+  long long num_events = 0;
+  long long t_first = -1, t_start = 0;
+  bool at_end = !stream_ok_;
+
+  // Every run replays the stream from the top.
+  if (stream_ok_) reader_.Rewind();
+
+  while (this->thread_live_) {
+    while (this->go_time_ && !at_end) {
+      if (!reader_.Next(record_)) {
+        if (loop_ && num_events > 0) {
+          reader_.Rewind();
+          t_first = -1;
+          continue;
+        }
+
+        this->LogMessage("raw stream ended after %lli events", num_events);
+        at_end = true;
+        break;
+      }
+
+      if (record_.header.kind == kRawSetup) {
+        decoder_.Setup(record_.payload);
+        continue;
+
+      } else if (record_.header.kind != kRawEvent) {
+        continue;
+      }
+
+      if (t_first < 0) {
+        t_first = record_.header.time_ns;
+        t_start = MetricsNow();
+      }
+
+      if (!WaitForTurn(record_.header.time_ns, t_first, t_start)) break;
+
+      long long t_read = MetricsNow();
+      bundle_.system_clock = record_.header.system_clock;
+
+      if (decoder_.Decode(record_.payload, bundle_)) {
+        this->decode_time_.Record(MetricsNow() - t_read);
+        this->QueueEvent(bundle_);
+        ++num_events;
+
+      } else {
+        this->LogError("skipping a raw record of %u bytes",
+                       record_.header.num_bytes);
+      }
+    }
+
+    std::this_thread::yield();
+    usleep(daq::long_sleep);
+  }
+}
+
+template <typename T>
+bool WorkerReplay<T>::WaitForTurn(long long t_event, long long t_first,
+                                  long long t_start) {
+  while (this->go_time_) {
+    long long wait_ns = 0;
+
+    if (paced_) {
+      wait_ns = (t_event - t_first) - (MetricsNow() - t_start);
+
+    } else if (this->num_events() >= this->gate_.limits().max_size) {
+      wait_ns = 1000 * daq::short_sleep;
+    }
+
+    // Like a busy board, a blocked queue holds the stream back.
+    if (wait_ns <= 0 && this->QueueBlocked()) {
+      wait_ns = 1000 * daq::short_sleep;
+    }
+
+    if (wait_ns <= 0) return true;
+
+    std::this_thread::yield();
+    usleep(std::min(wait_ns / 1000, 1000LL * daq::short_sleep));
+  }
+
+  return false;
+}
+
+template <typename T>
+T WorkerReplay<T>::PopEvent() {
+  static T data;
+  std::lock_guard<std::mutex> lock(this->queue_mutex_);
+
+  if (this->data_queue_.empty()) {
+    T str;
+    return str;
+  }
+
+  // Copy the data.
+  data = this->data_queue_.front();
+  this->data_queue_.pop();
+
+  // Publish the new queue size.
+  this->UpdateQueueStatus();
+
+  return data;
+}
+
+}  // ::daq
+
+#endif
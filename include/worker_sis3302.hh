@@ -15,13 +15,18 @@
 \*===========================================================================*/
 
 //--- std includes ----------------------------------------------------------//
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 //--- other includes --------------------------------------------------------//
 
 //--- project includes ------------------------------------------------------//
 #include "worker_vme.hh"
+#include "decode_kernels.hh"
+#include "struck_decode.hh"
 #include "common.hh"
 
 // This class pulls data from a sis_3302 device.
@@ -50,8 +55,11 @@ class WorkerSis3302 : public WorkerVme<sis_3302> {
   //     "start_delay": "0",
   //     "stop_delay": "0",
   //     "enable_event_length_stop": true,
-  //     "pretrigger_samples": "0xfff"
+  //     "pretrigger_samples": "0xfff",
+  //     "channel_mask": "0xff"
   // }
+  //
+  // Channels left out of "channel_mask" are not read and come out as 0.
   void LoadConfig();
 
   // The threaded loop that polls for data and pushes events on the queue.
@@ -85,11 +93,16 @@ class WorkerSis3302 : public WorkerVme<sis_3302> {
   const int kMaxPoll = 500;
 
   std::chrono::high_resolution_clock::time_point t0_;
+
+  uint channel_mask_;
+  uint trace_words_[SIS_3302_CH];  // words last read into each channel
+  std::vector<uint> raw_record_;   // an event as written to the raw stream
   
   // Checks the device for a triggered event.
   bool EventAvailable();
 
-  // Reads the data from the device with vme calls.
+  // Reads the data from the device with vme calls, the traces straight
+  // into the bundle.
   void GetEvent(sis_3302 &bundle);
 
 };
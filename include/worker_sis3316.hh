@@ -22,6 +22,7 @@
 
 //--- project includes ------------------------------------------------------//
 #include "worker_vme.hh"
+#include "decode_kernels.hh"
 #include "common.hh"
 
 // This class pulls data from a sis_3316 device.
@@ -112,6 +113,7 @@ class WorkerSis3316 : public WorkerVme<sis_3316> {
   // Variables
   std::chrono::high_resolution_clock::time_point t0_;
   std::atomic<bool> bank2_armed_flag;
+  sis_3316 bundle_;  // read into before it is queued
 
   // Checks the device for a triggered event.
   bool EventAvailable();
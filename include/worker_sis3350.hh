@@ -15,11 +15,13 @@
 \*===========================================================================*/
 
 //--- std includes ----------------------------------------------------------//
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
 //--- project includes ------------------------------------------------------//
 #include "worker_vme.hh"
+#include "decode_kernels.hh"
 #include "common.hh"
 
 namespace daq {
@@ -44,6 +46,8 @@ public:
   //     "invert_ext_lemo":true,
   //     "user_led_on":false,
   //     "enable_ext_lemo":true,
+  //     "multi_events":64,
+  //     "max_wait_ms":100,
   //
   //     "channel_offset":[
   //         -1.7,
@@ -59,6 +63,11 @@ public:
   //         85
   //     ]
   // }  
+  //
+  // With "multi_events" above 1 the board takes up to that many events
+  // per arm, one after the other in each channel's memory, and they are
+  // read out together.  A board armed for "max_wait_ms" is stopped with
+  // what it has, so slow triggers still come through.
   void LoadConfig();
 
   // The threaded loop that polls for data and pushes events on the queue.
@@ -68,8 +77,21 @@ public:
   sis_3350 PopEvent();
   
 private:
+
+  // Multi event registers.
+  const static uint MULTI_EVENT_MAX_NOF_EVENTS = 0x20;
+  const static uint MULTI_EVENT_COUNTER = 0x24;
+
+  // Words per event in each channel's memory, header and samples.
+  const static uint kEventWords = SIS_3350_LN / 2 + 4;
+  const static int kMaxEvents = 1024;
   
   std::chrono::high_resolution_clock::time_point t0_;
+
+  int multi_events_;
+  long long max_wait_ns_;
+  long long armed_at_;  // MetricsNow() of the last arm
+  sis_3350 bundle_;     // decoded into before it is queued
   
   // Checks the device for a triggered event.
   bool EventAvailable();
@@ -77,6 +99,14 @@ private:
   // Reads the event data out of the device via vme calls.
   void GetEvent(sis_3350 &bundle);
 
+  // Stops the board once it is full or has waited long enough, reads
+  // all its events in one go, rearms it and queues them.  Returns the
+  // number of events queued.
+  int GetEvents();
+
+  // Arms the sampling logic.
+  void Arm();
+
 };
 
 } // ::daq
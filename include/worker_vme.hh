@@ -20,10 +20,11 @@
 #include <iostream>
 
 //--- other includes --------------------------------------------------------//
-#include "vme/sis3100_vme_calls.h"
 
 //--- project includes ------------------------------------------------------//
 #include "worker_base.hh"
+#include "vme_backend.hh"
+#include "readout_buffer.hh"
 #include "common.hh"
 
 namespace daq {
@@ -52,8 +53,19 @@ protected:
 
   int device_;
   uint base_address_; // contained in the conf file.
+
+  // Where the block reads below land, one per worker.  Anything else a
+  // readout keeps between calls belongs in it or in a member, not in a
+  // function static, which every worker of the type would share.
+  ReadoutBuffer readout_buffer_;
   
   virtual bool EventAvailable() = 0;
+
+  // Maps num_words of readout buffer as conf's "readout_memory" asks,
+  // keeping the current one if it already matches both.  Called from
+  // LoadConfig with the config it read.
+  uint *AllocateReadoutBuffer(size_t num_words,
+                              const boost::property_tree::ptree &conf);
   
   int Read(uint addr, uint &msg);        // A32D32
   int Write(uint addr, uint msg);        // A32D32
@@ -65,6 +77,11 @@ protected:
   int ReadTraceMblt64(uint addr, uint *trace); // MBLT64 (A32)
   int ReadTraceMblt64SameBlock(uint addr, uint *trace);
   int ReadTraceMblt64Fifo(uint addr, uint *trace); // MBLT64FIFO (A32)
+  int ReadTraceBerr(uint addr, uint *trace, VmeBlockMode mode); // to BERR
+  int ReadTraceChain(VmeBlock *blocks, int num_blocks, VmeBlockMode mode);
+
+  // Read-modify-writes the busy_output register (A32D32).
+  void SetBusyOutput(bool busy);
 };
 
 // Reads 4 bytes from the specified address offset.
@@ -83,7 +100,7 @@ int WorkerVme<T>::Read(uint addr, uint &msg)
 
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -93,8 +110,8 @@ int WorkerVme<T>::Read(uint addr, uint &msg)
     return device_;
   }
 
-  status = (retval = vme_A32D32_read(device_, base_address_ + addr, &msg));
-  close(device_);
+  status = (retval = GetVmeBackend().ReadD32(device_, base_address_ + addr, &msg));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     //this->LogError("read32  failure at address 0x%08x", base_address_ + addr);
@@ -126,7 +143,7 @@ int WorkerVme<T>::Write(uint addr, uint msg)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -137,8 +154,8 @@ int WorkerVme<T>::Write(uint addr, uint msg)
   }
 
   // Make the vme call.
-  status = (retval = vme_A32D32_write(device_, base_address_ + addr, msg));
-  close(device_);
+  status = (retval = GetVmeBackend().WriteD32(device_, base_address_ + addr, msg));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     this->LogError("write32 failure at address 0x%08x", base_address_ + addr);
@@ -170,7 +187,7 @@ int WorkerVme<T>::Read16(uint addr, ushort &msg)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -180,8 +197,8 @@ int WorkerVme<T>::Read16(uint addr, ushort &msg)
     return device_;
   }
 
-  status = (retval = vme_A32D16_read(device_, base_address_ + addr, &msg));
-  close(device_);
+  status = (retval = GetVmeBackend().ReadD16(device_, base_address_ + addr, &msg));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     this->LogError("read16  failure at address 0x%08x", base_address_ + addr);
@@ -213,7 +230,7 @@ int WorkerVme<T>::Write16(uint addr, ushort msg)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -224,8 +241,8 @@ int WorkerVme<T>::Write16(uint addr, ushort msg)
   }
 
   // Make our vme call.
-  status = (retval = vme_A32D16_write(device_, base_address_ + addr, msg));
-  close(device_);
+  status = (retval = GetVmeBackend().WriteD16(device_, base_address_ + addr, msg));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     this->LogError("write16 failure at address 0x%08x", base_address_ + addr);
@@ -259,7 +276,7 @@ int WorkerVme<T>::ReadTrace(uint addr, uint *trace)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -273,12 +290,13 @@ int WorkerVme<T>::ReadTrace(uint addr, uint *trace)
   this->LogDump("read_2evme vme device 0x%08x, register 0x%08x, samples %i", 
 		 base_address_, addr, read_trace_len_);
 
-  status = (retval = vme_A32_2EVME_read(device_,
-                                        base_address_ + addr,
-                                        trace,
-                                        read_trace_len_,
-                                        &num_got));
-  close(device_);
+  status = (retval = GetVmeBackend().ReadBlock(device_,
+                                               VmeBlockMode::k2eVme,
+                                               base_address_ + addr,
+                                               trace,
+                                               read_trace_len_,
+                                               &num_got));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     this->LogError("read32_evme failed at 0x%08x", base_address_ + addr);
@@ -303,7 +321,7 @@ int WorkerVme<T>::ReadTraceFifo(uint addr, uint *trace)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -314,12 +332,13 @@ int WorkerVme<T>::ReadTraceFifo(uint addr, uint *trace)
   }
 
   // Make the vme call.
-  status = (retval = vme_A32_2EVMEFIFO_read(device_,
-         				    base_address_ + addr,
-         				    trace,
-         				    read_trace_len_,
-         				    &num_got));
-  close(device_);
+  status = (retval = GetVmeBackend().ReadBlock(device_,
+                                               VmeBlockMode::k2eVmeFifo,
+                                               base_address_ + addr,
+                                               trace,
+                                               read_trace_len_,
+                                               &num_got));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     this->LogError("read32_2evmefifo failed at 0x%08x", base_address_ + addr);
@@ -353,7 +372,7 @@ int WorkerVme<T>::ReadTraceMblt64(uint addr, uint *trace)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -364,12 +383,13 @@ int WorkerVme<T>::ReadTraceMblt64(uint addr, uint *trace)
   }
 
   // Make the vme call.
-  status = (retval = vme_A32MBLT64_read(device_,
-                                        base_address_ + addr,
-                                        trace,
-                                        read_trace_len_,
-                                        &num_got));
-  close(device_);
+  status = (retval = GetVmeBackend().ReadBlock(device_,
+                                               VmeBlockMode::kMblt64,
+                                               base_address_ + addr,
+                                               trace,
+                                               read_trace_len_,
+                                               &num_got));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     this->LogError("readA32_mblt64 failed at 0x%08x, asked: %i, recv: %i, retval: %i",
@@ -404,7 +424,7 @@ int WorkerVme<T>::ReadTraceMblt64SameBlock(uint addr, uint *trace)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -422,12 +442,13 @@ int WorkerVme<T>::ReadTraceMblt64SameBlock(uint addr, uint *trace)
   do {
     num_to_read = 0x0400;
 
-    //retval = vme_A32MBLT64_read(device_,
-    retval = vme_A32_2EVME_read(device_,
-                                base_address_ + addr,
-                                &trace[offset],
-                                num_to_read,
-                                &num_got);
+    // Alternatively VmeBlockMode::kMblt64.
+    retval = GetVmeBackend().ReadBlock(device_,
+                                       VmeBlockMode::k2eVme,
+                                       base_address_ + addr,
+                                       &trace[offset],
+                                       num_to_read,
+                                       &num_got);
 
     offset += num_got;
     word_count -= num_got;
@@ -444,7 +465,7 @@ int WorkerVme<T>::ReadTraceMblt64SameBlock(uint addr, uint *trace)
   if (offset > 0x0400) { status = offset; }
 
 
-  close(device_);
+  GetVmeBackend().Close(device_);
 
   if (status < 0) {
     //this->LogError("readA32_mblt64 failed at 0x%08x, asked: %i, recv: %i, retval: %i, word count left: %i",
@@ -479,7 +500,7 @@ int WorkerVme<T>::ReadTraceMblt64Fifo(uint addr, uint *trace)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -490,12 +511,13 @@ int WorkerVme<T>::ReadTraceMblt64Fifo(uint addr, uint *trace)
   }
 
   // Make the vme call.
-  status = (retval = vme_A32MBLT64FIFO_read(device_,
-         				    base_address_ + addr,
-         				    trace,
-         				    read_trace_len_,
-         				    &num_got));
-  close(device_);
+  status = (retval = GetVmeBackend().ReadBlock(device_,
+                                               VmeBlockMode::kMblt64Fifo,
+                                               base_address_ + addr,
+                                               trace,
+                                               read_trace_len_,
+                                               &num_got));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     this->LogError("read32_mblt_fifo failed at 0x%08x", base_address_ + addr);
@@ -528,7 +550,7 @@ int WorkerVme<T>::ReadTraceDma32Fifo(uint addr, uint *trace)
   // Get the vme device handle.
   count = 0;
   do {
-    device_ = open(daq::vme_path.c_str(), O_RDWR);
+    device_ = GetVmeBackend().Open();
     usleep(2);
   } while ((device_ < 0) && (count++ < maxcount_));
 
@@ -539,12 +561,13 @@ int WorkerVme<T>::ReadTraceDma32Fifo(uint addr, uint *trace)
   }
 
   // Make the vme call.
-  status = (retval = vme_A32DMA_D32FIFO_read(device_,
-					   base_address_ + addr,
-					   trace,
-					   read_trace_len_,
-					   &num_got));
-  close(device_);
+  status = (retval = GetVmeBackend().ReadBlock(device_,
+                                               VmeBlockMode::kDma32Fifo,
+                                               base_address_ + addr,
+                                               trace,
+                                               read_trace_len_,
+                                               &num_got));
+  GetVmeBackend().Close(device_);
 
   if (status != 0) {
     this->LogError("read32_blt32_fifo failed at 0x%08x, trace_len: %i, num got: %i, retval: %i",
@@ -559,6 +582,161 @@ int WorkerVme<T>::ReadTraceDma32Fifo(uint addr, uint *trace)
   return retval;
 }
 
+// Reads up to read_trace_len_ words from a board that ends the transfer
+// with a bus error once it runs out of data, as multi-event buffers do.
+// That bus error is the normal end of the block and is not logged.
+//
+// params:
+//   addr - address offset from base_addr_
+//   trace - pointer to data being read
+//   mode - block transfer to use
+//
+// return:
+//   number of words read, or the negative error code from vme read
+template<typename T>
+int WorkerVme<T>::ReadTraceBerr(uint addr, uint *trace, VmeBlockMode mode)
+{
+  std::lock_guard<std::mutex> lock(daq::vme_mutex);
+  static uint num_got;
+  static int retval, count;
+
+  // Get the vme device handle.
+  count = 0;
+  do {
+    device_ = GetVmeBackend().Open();
+    usleep(2);
+  } while ((device_ < 0) && (count++ < maxcount_));
+
+  // Log an error if we couldn't open it at all.
+  if (device_ < 0) {
+    this->LogError("failure to find vme device, error %i", device_);
+    return device_;
+  }
+
+  // Make the vme call.
+  num_got = 0;
+  retval = GetVmeBackend().ReadBlock(device_,
+                                     mode,
+                                     base_address_ + addr,
+                                     trace,
+                                     read_trace_len_,
+                                     &num_got);
+  GetVmeBackend().Close(device_);
+
+  if (retval != 0 && retval != kVmeBusError) {
+    this->LogError("read32_berr failed at 0x%08x, asked: %i, recv: %i, retval: %i",
+                    base_address_ + addr, read_trace_len_, num_got, retval);
+    return (retval < 0) ? retval : -retval;
+  }
+
+  this->LogDump("read32_berr addr 0x%08x, trace_len %i, ndata recv %i", 
+                 base_address_ + addr, read_trace_len_, num_got);
+
+  return num_got;
+}
+
+// Reads several blocks, each at its own address offset and length, as
+// one chained transfer.  The block addresses are offsets from base_addr_
+// and are left as given.
+//
+// params:
+//   blocks - the transfers, num_got is set for each
+//   num_blocks - number of blocks
+//   mode - block transfer to use
+//
+// return:
+//   error code from vme read
+template<typename T>
+int WorkerVme<T>::ReadTraceChain(VmeBlock *blocks, int num_blocks,
+                                 VmeBlockMode mode)
+{
+  std::lock_guard<std::mutex> lock(daq::vme_mutex);
+  static int retval, count;
+
+  // Get the vme device handle.
+  count = 0;
+  do {
+    device_ = GetVmeBackend().Open();
+    usleep(2);
+  } while ((device_ < 0) && (count++ < maxcount_));
+
+  // Log an error if we couldn't open it at all.
+  if (device_ < 0) {
+    this->LogError("failure to find vme device, error %i", device_);
+    return device_;
+  }
+
+  for (int i = 0; i < num_blocks; ++i) {
+    blocks[i].addr += base_address_;
+    blocks[i].num_got = 0;
+  }
+
+  // Make the vme call.
+  retval = GetVmeBackend().ReadBlockChain(device_, mode, blocks, num_blocks);
+  GetVmeBackend().Close(device_);
+
+  for (int i = 0; i < num_blocks; ++i) {
+    blocks[i].addr -= base_address_;
+  }
+
+  if (retval != 0) {
+    this->LogError("read32_chain failed at 0x%08x, blocks: %i, retval: %i",
+                    base_address_, num_blocks, retval);
+
+  } else {
+
+    this->LogDump("read32_chain addr 0x%08x, blocks %i", 
+                   base_address_, num_blocks);
+  }
+
+  return retval;
+}
+
+template<typename T>
+uint *WorkerVme<T>::AllocateReadoutBuffer(size_t num_words,
+                                          const boost::property_tree::ptree &conf)
+{
+  ReadoutMemory memory = ReadReadoutMemory(conf);
+
+  if (readout_buffer_.data() != nullptr &&
+      readout_buffer_.size() == num_words &&
+      readout_buffer_.memory() == memory) {
+    return readout_buffer_.data();
+  }
+
+  if (!readout_buffer_.Allocate(num_words, memory)) {
+    this->LogError("failed to map %zu words of readout buffer", num_words);
+    return nullptr;
+  }
+
+  if (memory.hugepages && !readout_buffer_.hugepages()) {
+    this->LogMessage("no huge pages reserved, readout buffer on normal pages");
+  }
+
+  if (memory.mlock && !readout_buffer_.locked()) {
+    this->LogWarning("could not lock %zu kB readout buffer in memory",
+                     num_words * sizeof(uint) / 1024);
+  }
+
+  return readout_buffer_.data();
+}
+
+template<typename T>
+void WorkerVme<T>::SetBusyOutput(bool busy)
+{
+  const BusyOutput &out = this->busy_output_;
+  uint msg = 0;
+
+  if (Read(out.reg, msg) != 0) {
+    this->LogError("failed to read busy output register 0x%x", out.reg);
+    return;
+  }
+
+  if (Write(out.reg, out.Apply(msg, busy)) != 0) {
+    this->LogError("failed to write busy output register 0x%x", out.reg);
+  }
+}
+
 } // ::daq
 
 #endif
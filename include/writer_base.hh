@@ -7,22 +7,35 @@
 #include <atomic>
 #include <string>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <future>
 
 //--- other includes --------------------------------------------------------//
 
 //--- project includes ------------------------------------------------------//
 #include "common.hh"
+#include "config_cache.hh"
+#include "metrics.hh"
 
 namespace daq {
 
+// A batch of built events, shared read-only by every writer it goes to.
+typedef std::shared_ptr<const std::vector<event_data>> batch_ptr;
+
 // This class defines an abstract base class for data writers to inherit form.
+//
+// The event builder hands batches to SubmitBatch, which queues them for
+// the writer's own dispatch thread, so a slow writer only holds up the
+// others once its queue of "flow_control.writers.max_batches" is full.
+// The dispatch thread calls PushData and EndOfBatch in submission order.
 
 class WriterBase : public CommonBase {
  public:
-  WriterBase(std::string conf_file, std::string name = "Writer")
-      : conf_file_(conf_file), thread_live_(true), CommonBase(name){};
+  WriterBase(std::string conf_file, std::string name = "Writer");
 
   virtual ~WriterBase() {
+    StopDispatch();
     thread_live_ = false;
     if (writer_thread_.joinable()) {
       try {
@@ -41,9 +54,19 @@ class WriterBase : public CommonBase {
   // Let the writer know that a batch is complete.
   virtual void EndOfBatch(bool bad_data) = 0;
 
-  // Push data to the writer, called by event builder/frontend.
+  // Push data to the writer, called from the dispatch thread.
   virtual void PushData(const std::vector<event_data>& data_buffer) = 0;
 
+  // Queues a batch for the dispatch thread, waiting while the queue is
+  // full.  The batch must not change after it is submitted.
+  void SubmitBatch(batch_ptr batch);
+
+  // Queues an EndOfBatch behind the batches submitted so far.
+  void SubmitEndOfBatch(bool bad_data);
+
+  // Ready once everything submitted before it has been written.
+  std::future<void> Flush();
+
  protected:
   // Simple variables
   std::string conf_file_;
@@ -53,6 +76,39 @@ class WriterBase : public CommonBase {
   // Concurrency variables
   std::thread writer_thread_;
   std::mutex writer_mutex_;
+
+  // Registry metrics under the writer's name.
+  Counter &events_written_;
+  Counter &events_dropped_;
+  Gauge &queue_depth_;
+  Histogram &write_time_;
+
+  // Stops the dispatch thread, dropping what is still queued.  Derived
+  // dtors call it first so nothing is pushed to a half destroyed writer.
+  void StopDispatch();
+
+ private:
+  // One entry of the dispatch queue, a batch, an end of batch or a
+  // flush marker.
+  struct Task {
+    batch_ptr batch;
+    bool end_of_batch;
+    bool bad_data;
+    std::shared_ptr<std::promise<void>> done;
+  };
+
+  size_t max_batches_;
+  std::atomic<bool> dispatch_live_;
+  std::deque<Task> tasks_;
+  size_t num_batches_;  // batches in tasks_, the markers not counted
+  std::mutex task_mutex_;
+  std::thread dispatch_thread_;
+  Gauge &batches_queued_;
+
+  void QueueTask(const Task &task);
+
+  // Hands the queued tasks to the writer in order.
+  void DispatchLoop();
 };
 
 }  // ::daq
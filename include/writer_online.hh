@@ -16,10 +16,17 @@
 
 //--- project includes ------------------------------------------------------//
 #include "writer_base.hh"
+#include "device_traits.hh"
 #include "common.hh"
 
 namespace daq {
 
+// Adds every device in the event to json_map and returns the message text,
+// traces are cut at max_trace_length samples unless it is negative.
+std::string PackOnlineEvent(const event_data &data,
+                            json11::Json::object &json_map,
+                            int max_trace_length);
+
 // A class that interfaces with the an EventBuilder and writes a root file.
 
 class WriterOnline : public WriterBase {
@@ -30,6 +37,7 @@ class WriterOnline : public WriterBase {
   // dtor
   ~WriterOnline() {
     go_time_ = false;
+    StopDispatch();
     thread_live_ = false;
     if (writer_thread_.joinable()) {
       try {
@@ -54,7 +62,7 @@ class WriterOnline : public WriterBase {
   void EndOfBatch(bool bad_data);
 
  private:
-  const int kMaxQueueSize = 5;
+  QueueGate gate_;  // limits data_queue_, see flow_control.hh
   int max_trace_length_;
   int number_of_events_;
   std::atomic<bool> message_ready_;
@@ -3,6 +3,8 @@
 
 //--- std includes ----------------------------------------------------------//
 #include <iostream>
+#include <algorithm>
+#include <memory>
 
 //--- other includes --------------------------------------------------------//
 #include <boost/foreach.hpp>
@@ -10,20 +12,35 @@
 #include <boost/property_tree/json_parser.hpp>
 #include "TFile.h"
 #include "TTree.h"
+#include "TParameter.h"
+#include "TROOT.h"
 
 //--- project includes ------------------------------------------------------//
 #include "writer_base.hh"
+#include "busy_control.hh"
+#include "device_traits.hh"
 #include "common.hh"
 
 namespace daq {
 
 // A class that interfaces with the an EventBuilder and writes a root file.
+//
+// Files are double buffered across runs.  StopWriter hands the finished
+// file to a closer thread and StartWriter opens the next run's file,
+// named by the config as it is then, while the last one is written out.
+// Each run's tree has its own branch buffers, which go to the closer
+// with the file since the tree still reads them.
 
 class WriterRoot : public WriterBase {
  public:
   // ctor
   explicit WriterRoot(std::string conf_file);
 
+  ~WriterRoot() {
+    StopDispatch();
+    WaitForClose();
+  };
+
   // Member Functions
   void LoadConfig();
   void StartWriter();
@@ -37,10 +54,23 @@ class WriterRoot : public WriterBase {
   std::string outfile_;
   std::string tree_name_;
 
-  TFile *pf_;
-  TTree *pt_;
+  // One run's output, the tree's branches point into data.
+  struct RunFile {
+    TFile *pf;
+    TTree *pt;
+    std::string outfile;
+    event_data data;
+  };
+
+  std::unique_ptr<RunFile> run_;  // the open run, null between runs
+
+  std::thread closer_thread_;  // writes and closes the previous run's file
+
+  // Writes, closes and deletes a finished file along with its buffers.
+  void CloseFile(RunFile *run);
 
-  event_data root_data_;
+  // Joins the closer of the previous file, if still running.
+  void WaitForClose();
 };
 
 }  // ::daq
@@ -0,0 +1,1019 @@
+/*===========================================================================*\
+
+  file:   caen_digitizer.cxx
+
+  about:  A stand-in for the part of the CAENDigitizer library used by the
+          caen usb workers.  It builds as lib/mock/libCAENDigitizer.so and
+          links in place of -lCAENDigitizer (make ... CAEN_MOCK=1).
+
+          Every opened link is a software digitizer.  Once acquisition
+          starts it takes triggers at a fixed rate into a finite event
+          memory.  ReadData hands the events out as standard packed
+          aggregates, so GetNumEvents, GetEventInfo and DecodeEvent walk
+          the same byte layout they would with hardware.  Record length,
+          post trigger, channel/group masks and the BLT size come from
+          the usual API calls.
+
+          The boards are described by the json file named in
+          CAEN_DGTZ_MOCK_CONF, e.g.
+
+          {
+              "rate":100.0,
+              "links": {
+                  "0": {"model":"DT5720", "rate":1000.0},
+                  "1": {"model":"DT5742", "serial":42}
+              }
+          }
+
+          Top level values are the defaults for every link.  The models
+          are DT5720, DT5730, DT5742 and V1742.  The other keys are
+          "serial", "noise" (adc counts), "memory_events",
+          "usb_latency_us" and "usb_bandwidth_mbps".  The last two are
+          charged on every ReadData, outside the library lock.
+
+\*===========================================================================*/
+
+//--- std includes ----------------------------------------------------------//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//--- other includes --------------------------------------------------------//
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include "CAENDigitizer.h"
+
+namespace {
+
+typedef boost::property_tree::ptree ptree;
+
+struct Model {
+  const char *name;
+  CAEN_DGTZ_BoardModel_t model;
+  CAEN_DGTZ_BoardFormFactor_t form_factor;
+  CAEN_DGTZ_BoardFamilyCode_t family;
+  uint32_t channels;  // groups on the x742
+  uint32_t bits;
+  double ttt_hz;  // trigger time tag clock
+};
+
+const Model kModels[] = {
+    {"DT5720", CAEN_DGTZ_DT5720, CAEN_DGTZ_DESKTOP_FORM_FACTOR,
+     CAEN_DGTZ_XX720_FAMILY_CODE, 4, 12, 125.0e6},
+    {"DT5730", CAEN_DGTZ_DT5730, CAEN_DGTZ_DESKTOP_FORM_FACTOR,
+     CAEN_DGTZ_XX730_FAMILY_CODE, 8, 14, 125.0e6},
+    {"DT5742", CAEN_DGTZ_DT5742, CAEN_DGTZ_DESKTOP_FORM_FACTOR,
+     CAEN_DGTZ_XX742_FAMILY_CODE, 2, 12, 1.0e9 / 8.5},
+    {"V1742", CAEN_DGTZ_V1742, CAEN_DGTZ_VME64_FORM_FACTOR,
+     CAEN_DGTZ_XX742_FAMILY_CODE, 4, 12, 1.0e9 / 8.5},
+};
+
+// Channels per group and the fast trigger channel on the x742.
+const int kX742Channels = 8;
+const int kX742Trigger = 8;
+const uint32_t kX742MaxLength = 1024;
+
+const int kPoolSize = 16;
+
+class Digitizer {
+ public:
+  Digitizer(const Model &model, int link, const ptree &conf);
+
+  const Model &model() const { return model_; }
+  const CAEN_DGTZ_BoardInfo_t &info() const { return info_; }
+  bool x742() const { return model_.family == CAEN_DGTZ_XX742_FAMILY_CODE; }
+
+  void Reset();
+  void Clear();
+  void Start();
+  void Stop();
+
+  CAEN_DGTZ_ErrorCode SetRecordLength(uint32_t size);
+  uint32_t record_length() const { return record_length_; }
+
+  // Bytes in one event, and in a full block transfer.
+  uint32_t EventBytes() const;
+  uint32_t BlockBytes() const { return EventBytes() * max_blt_; }
+
+  // Packs up to max_blt events into buffer, returns the bytes written.
+  uint32_t Read(char *buffer, uint32_t capacity);
+
+  // Bus time in us for a transfer of the given size.
+  double TransferTime(uint32_t bytes) const;
+
+  uint32_t post_trigger_;
+  uint32_t mask_;  // channel mask, or group mask on the x742
+  uint32_t max_blt_;
+  bool fast_trigger_digitizing_;
+  CAEN_DGTZ_DRS4Frequency_t drs4_frequency_;
+  std::vector<uint32_t> dc_offset_;
+  std::map<uint32_t, uint32_t> regs_;
+
+ private:
+  const Model &model_;
+  CAEN_DGTZ_BoardInfo_t info_;
+
+  double rate_;
+  double noise_;
+  uint32_t memory_events_;
+  double usb_latency_us_;
+  double usb_bandwidth_mbps_;
+
+  uint32_t record_length_;
+  bool running_;
+  std::chrono::steady_clock::time_point t_start_;
+  unsigned long long seen_;      // triggers since start
+  uint32_t event_counter_;       // accepted triggers since start
+  std::deque<unsigned long long> memory_;  // trigger number of stored events
+
+  // Pulses without baseline, rebuilt when the record length or post
+  // trigger change.
+  std::vector<std::vector<int>> pool_;
+  uint32_t pool_length_;
+  uint32_t pool_post_trigger_;
+
+  void Update();
+  void BuildPool();
+  const std::vector<int> &Pulse(unsigned long long trigger, int ch) const;
+  uint32_t Sample(const std::vector<int> &pulse, uint32_t i, int ch) const;
+  uint32_t *PackX720(uint32_t *w, unsigned long long trigger);
+  uint32_t *PackX742(uint32_t *w, unsigned long long trigger);
+};
+
+Digitizer::Digitizer(const Model &model, int link, const ptree &conf)
+    : model_(model), pool_length_(0), pool_post_trigger_(0) {
+  std::string key = "links." + std::to_string(link) + ".";
+
+  rate_ = conf.get<double>(key + "rate", conf.get<double>("rate", 100.0));
+  noise_ = conf.get<double>(key + "noise", conf.get<double>("noise", 2.0));
+  memory_events_ = conf.get<uint32_t>(
+      key + "memory_events", conf.get<uint32_t>("memory_events", 1024));
+  usb_latency_us_ = conf.get<double>(
+      key + "usb_latency_us", conf.get<double>("usb_latency_us", 125.0));
+  usb_bandwidth_mbps_ = conf.get<double>(
+      key + "usb_bandwidth_mbps", conf.get<double>("usb_bandwidth_mbps", 30.0));
+
+  std::memset(&info_, 0, sizeof(info_));
+  std::strncpy(info_.ModelName, model_.name, sizeof(info_.ModelName) - 1);
+  std::strncpy(info_.ROC_FirmwareRel, "0.0 - mock",
+               sizeof(info_.ROC_FirmwareRel) - 1);
+  std::strncpy(info_.AMC_FirmwareRel, "0.0 - mock",
+               sizeof(info_.AMC_FirmwareRel) - 1);
+
+  info_.Model = model_.model;
+  info_.Channels = model_.channels;
+  info_.FormFactor = model_.form_factor;
+  info_.FamilyCode = model_.family;
+  info_.SerialNumber = conf.get<uint32_t>(key + "serial", 1000 + link);
+  info_.ADC_NBits = model_.bits;
+
+  Reset();
+}
+
+void Digitizer::Reset() {
+  record_length_ = x742() ? kX742MaxLength : 1024;
+  post_trigger_ = 50;
+  mask_ = (1 << model_.channels) - 1;
+  max_blt_ = 1;
+  fast_trigger_digitizing_ = false;
+  drs4_frequency_ = CAEN_DGTZ_DRS4_5GHz;
+
+  uint32_t nch = x742() ? model_.channels * kX742Channels : model_.channels;
+  dc_offset_.assign(nch, 0x8000);
+  regs_.clear();
+
+  running_ = false;
+  Clear();
+}
+
+void Digitizer::Clear() {
+  memory_.clear();
+  event_counter_ = 0;
+}
+
+void Digitizer::Start() {
+  if (running_) return;
+
+  running_ = true;
+  t_start_ = std::chrono::steady_clock::now();
+  seen_ = 0;
+}
+
+void Digitizer::Stop() {
+  Update();
+  running_ = false;
+}
+
+CAEN_DGTZ_ErrorCode Digitizer::SetRecordLength(uint32_t size) {
+  if (x742()) {
+    // The DRS4 only offers a few fixed lengths.
+    if (size != 1024 && size != 520 && size != 256 && size != 136) {
+      return CAEN_DGTZ_InvalidParam;
+    }
+
+    record_length_ = size;
+    return CAEN_DGTZ_Success;
+  }
+
+  if (size == 0) {
+    return CAEN_DGTZ_InvalidParam;
+  }
+
+  // Samples come in pairs.
+  record_length_ = size + (size & 0x1);
+  return CAEN_DGTZ_Success;
+}
+
+uint32_t Digitizer::EventBytes() const {
+  uint32_t words = 4;
+
+  for (uint32_t i = 0; i < model_.channels; ++i) {
+    if (!(mask_ & (1 << i))) continue;
+
+    if (x742()) {
+      words += 2 + 3 * record_length_;
+
+      if (fast_trigger_digitizing_) {
+        words += 3 * record_length_ / 8;
+      }
+
+    } else {
+      words += record_length_ / 2;
+    }
+  }
+
+  return 4 * words;
+}
+
+double Digitizer::TransferTime(uint32_t bytes) const {
+  double us = usb_latency_us_;
+
+  if (usb_bandwidth_mbps_ > 0.0) {
+    us += bytes / usb_bandwidth_mbps_;
+  }
+
+  return us;
+}
+
+void Digitizer::Update() {
+  if (!running_) return;
+
+  using namespace std::chrono;
+  double dt = duration<double>(steady_clock::now() - t_start_).count();
+  unsigned long long triggers = dt * rate_;
+
+  // Triggers arriving while the memory is full are lost.
+  for (; seen_ < triggers; ++seen_) {
+    if (memory_.size() < memory_events_) {
+      memory_.push_back(seen_);
+    }
+  }
+}
+
+void Digitizer::BuildPool() {
+  std::mt19937 gen(info_.SerialNumber);
+  std::normal_distribution<double> noise(0.0, noise_);
+  std::uniform_real_distribution<double> amp(0.1, 0.5);
+  std::uniform_real_distribution<double> jitter(-2.0, 2.0);
+
+  double full_scale = (1 << model_.bits) - 1;
+  double t0 = record_length_ * (100 - post_trigger_) / 100.0;
+  double width = std::max(2.0, record_length_ / 256.0);
+
+  pool_.resize(kPoolSize);
+
+  for (auto &pulse : pool_) {
+    double a = amp(gen) * full_scale;
+    double t = t0 + jitter(gen);
+
+    pulse.resize(record_length_);
+
+    for (uint32_t i = 0; i < record_length_; ++i) {
+      double x = (i - t) / width;
+      pulse[i] = std::lround(-a * std::exp(-0.5 * x * x) + noise(gen));
+    }
+  }
+
+  pool_length_ = record_length_;
+  pool_post_trigger_ = post_trigger_;
+}
+
+const std::vector<int> &Digitizer::Pulse(unsigned long long trigger,
+                                         int ch) const {
+  return pool_[(trigger + 5 * ch) % kPoolSize];
+}
+
+uint32_t Digitizer::Sample(const std::vector<int> &pulse, uint32_t i,
+                           int ch) const {
+  int full_scale = (1 << model_.bits) - 1;
+  int baseline = (long long)dc_offset_[ch] * full_scale / 0xffff;
+
+  return std::min(std::max(baseline + pulse[i], 0), full_scale);
+}
+
+uint32_t Digitizer::Read(char *buffer, uint32_t capacity) {
+  Update();
+
+  if (pool_length_ != record_length_ || pool_post_trigger_ != post_trigger_) {
+    BuildPool();
+  }
+
+  uint32_t event_bytes = EventBytes();
+  uint32_t *w = reinterpret_cast<uint32_t *>(buffer);
+  uint32_t num = 0;
+
+  while (!memory_.empty() && num < max_blt_ &&
+         (num + 1) * event_bytes <= capacity) {
+    w = x742() ? PackX742(w, memory_.front()) : PackX720(w, memory_.front());
+
+    memory_.pop_front();
+    ++event_counter_;
+    ++num;
+  }
+
+  return num * event_bytes;
+}
+
+uint32_t *Digitizer::PackX720(uint32_t *w, unsigned long long trigger) {
+  uint32_t ttt = std::fmod(trigger / rate_ * model_.ttt_hz, 2147483648.0);
+
+  w[0] = 0xa0000000 | (EventBytes() / 4);
+  w[1] = (mask_ & 0xff);
+  w[2] = ((mask_ >> 8) & 0xff) << 24 | (event_counter_ & 0xffffff);
+  w[3] = ttt;
+  w += 4;
+
+  for (uint32_t ch = 0; ch < model_.channels; ++ch) {
+    if (!(mask_ & (1 << ch))) continue;
+
+    const std::vector<int> &pulse = Pulse(trigger, ch);
+
+    for (uint32_t i = 0; i < record_length_; i += 2) {
+      *w++ = Sample(pulse, i, ch) | (Sample(pulse, i + 1, ch) << 16);
+    }
+  }
+
+  return w;
+}
+
+uint32_t *Digitizer::PackX742(uint32_t *w, unsigned long long trigger) {
+  uint32_t ttt = std::fmod(trigger / rate_ * model_.ttt_hz, 1073741824.0);
+  uint32_t c[kX742Channels];
+
+  w[0] = 0xa0000000 | (EventBytes() / 4);
+  w[1] = (mask_ & 0xf);
+  w[2] = event_counter_ & 0x3fffff;
+  w[3] = ttt;
+  w += 4;
+
+  for (uint32_t gr = 0; gr < model_.channels; ++gr) {
+    if (!(mask_ & (1 << gr))) continue;
+
+    uint32_t start_cell = (trigger * 37 + gr * 101) % 1024;
+
+    *w++ = (start_cell << 20) | ((drs4_frequency_ & 0x3) << 16) |
+           (fast_trigger_digitizing_ ? 0x1000 : 0x0) | (3 * record_length_);
+
+    // Eight 12-bit samples, one per channel, in every three words.
+    for (uint32_t i = 0; i < record_length_; ++i) {
+      for (int ch = 0; ch < kX742Channels; ++ch) {
+        int idx = gr * kX742Channels + ch;
+        c[ch] = Sample(Pulse(trigger, idx), i, idx);
+      }
+
+      *w++ = c[0] | (c[1] << 12) | ((c[2] & 0xff) << 24);
+      *w++ = (c[2] >> 8) | (c[3] << 4) | (c[4] << 16) | ((c[5] & 0xf) << 28);
+      *w++ = (c[5] >> 4) | (c[6] << 8) | (c[7] << 20);
+    }
+
+    // The fast trigger, eight consecutive samples in three words.
+    if (fast_trigger_digitizing_) {
+      const std::vector<int> &pulse = Pulse(trigger, kX742Trigger + gr);
+      int ref = gr * kX742Channels;
+
+      for (uint32_t i = 0; i < record_length_; i += 8) {
+        for (int j = 0; j < 8; ++j) {
+          c[j] = Sample(pulse, i + j, ref);
+        }
+
+        *w++ = c[0] | (c[1] << 12) | ((c[2] & 0xff) << 24);
+        *w++ = (c[2] >> 8) | (c[3] << 4) | (c[4] << 16) | ((c[5] & 0xf) << 28);
+        *w++ = (c[5] >> 4) | (c[6] << 8) | (c[7] << 20);
+      }
+    }
+
+    *w++ = ttt;
+  }
+
+  return w;
+}
+
+// Unpacks three words holding eight 12-bit samples.
+inline void Unpack12(const uint32_t *w, uint32_t *c) {
+  c[0] = w[0] & 0xfff;
+  c[1] = (w[0] >> 12) & 0xfff;
+  c[2] = ((w[0] >> 24) & 0xff) | ((w[1] & 0xf) << 8);
+  c[3] = (w[1] >> 4) & 0xfff;
+  c[4] = (w[1] >> 16) & 0xfff;
+  c[5] = ((w[1] >> 28) & 0xf) | ((w[2] & 0xff) << 4);
+  c[6] = (w[2] >> 8) & 0xfff;
+  c[7] = (w[2] >> 20) & 0xfff;
+}
+
+struct Library {
+  std::mutex mutex;
+  ptree conf;
+  int next_handle = 0;
+  std::map<int, std::unique_ptr<Digitizer>> boards;
+  std::map<char *, uint32_t> buffers;  // readout buffer sizes
+  std::map<void *, uint32_t> events;   // decoded event capacities
+
+  Library() {
+    const char *file = std::getenv("CAEN_DGTZ_MOCK_CONF");
+    if (file == nullptr) return;
+
+    try {
+      boost::property_tree::read_json(file, conf);
+    } catch (std::exception &e) {
+      std::cerr << "CAENDigitizer mock: failed to read " << file << ", "
+                << e.what() << std::endl;
+    }
+  }
+};
+
+Library &Lib() {
+  static Library lib;
+  return lib;
+}
+
+// Looks up a handle, callers hold the library lock.
+Digitizer *Find(int handle) {
+  auto it = Lib().boards.find(handle);
+  return (it == Lib().boards.end()) ? nullptr : it->second.get();
+}
+
+}  // ::
+
+extern "C" {
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API
+CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_ConnectionType LinkType, int LinkNum,
+                        int ConetNode, uint32_t VMEBaseAddress, int *handle) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+
+  std::string key = "links." + std::to_string(LinkNum) + ".model";
+  std::string name = Lib().conf.get<std::string>(
+      key, Lib().conf.get<std::string>("model", "DT5720"));
+
+  for (const auto &model : kModels) {
+    if (name == model.name) {
+      *handle = Lib().next_handle++;
+      Lib().boards[*handle].reset(new Digitizer(model, LinkNum, Lib().conf));
+      return CAEN_DGTZ_Success;
+    }
+  }
+
+  std::cerr << "CAENDigitizer mock: no model " << name << std::endl;
+  return CAEN_DGTZ_DigitizerNotFound;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_CloseDigitizer(int handle) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  return Lib().boards.erase(handle) ? CAEN_DGTZ_Success
+                                    : CAEN_DGTZ_InvalidHandle;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_WriteRegister(int handle,
+                                                         uint32_t Address,
+                                                         uint32_t Data) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  dig->regs_[Address] = Data;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_ReadRegister(int handle,
+                                                        uint32_t Address,
+                                                        uint32_t *Data) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  *Data = dig->regs_[Address];
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_GetInfo(
+    int handle, CAEN_DGTZ_BoardInfo_t *BoardInfo) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  *BoardInfo = dig->info();
+  BoardInfo->CommHandle = handle;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_Reset(int handle) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  dig->Reset();
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_ClearData(int handle) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  dig->Clear();
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SWStartAcquisition(int handle) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  dig->Start();
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SWStopAcquisition(int handle) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  dig->Stop();
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetRecordLength(int handle,
+                                                           uint32_t size,
+                                                           ...) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  return dig->SetRecordLength(size);
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetPostTriggerSize(int handle,
+                                                              uint32_t percent) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+  if (percent > 100) return CAEN_DGTZ_InvalidParam;
+
+  dig->post_trigger_ = percent;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetChannelDCOffset(int handle,
+                                                              uint32_t channel,
+                                                              uint32_t Tvalue) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+  if (channel >= dig->dc_offset_.size() || Tvalue > 0xffff) {
+    return CAEN_DGTZ_InvalidParam;
+  }
+
+  dig->dc_offset_[channel] = Tvalue;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetChannelEnableMask(int handle,
+                                                                uint32_t mask) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+  if (dig->x742()) return CAEN_DGTZ_FunctionNotAllowed;
+
+  dig->mask_ = mask & ((1 << dig->model().channels) - 1);
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetGroupEnableMask(int handle,
+                                                              uint32_t mask) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+  if (!dig->x742()) return CAEN_DGTZ_FunctionNotAllowed;
+
+  dig->mask_ = mask & ((1 << dig->model().channels) - 1);
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetMaxNumEventsBLT(
+    int handle, uint32_t numEvents) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+  if (numEvents == 0) return CAEN_DGTZ_InvalidParam;
+
+  dig->max_blt_ = numEvents;
+  return CAEN_DGTZ_Success;
+}
+
+// Trigger routing has no effect on a board that always triggers.
+CAEN_DGTZ_ErrorCode CAENDGTZ_API
+CAEN_DGTZ_SetSWTriggerMode(int handle, CAEN_DGTZ_TriggerMode_t mode) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  return Find(handle) ? CAEN_DGTZ_Success : CAEN_DGTZ_InvalidHandle;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API
+CAEN_DGTZ_SetExtTriggerInputMode(int handle, CAEN_DGTZ_TriggerMode_t mode) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  return Find(handle) ? CAEN_DGTZ_Success : CAEN_DGTZ_InvalidHandle;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetChannelSelfTrigger(
+    int handle, CAEN_DGTZ_TriggerMode_t mode, uint32_t channelmask) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  return Find(handle) ? CAEN_DGTZ_Success : CAEN_DGTZ_InvalidHandle;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API
+CAEN_DGTZ_SetAcquisitionMode(int handle, CAEN_DGTZ_AcqMode_t mode) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  return Find(handle) ? CAEN_DGTZ_Success : CAEN_DGTZ_InvalidHandle;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API
+CAEN_DGTZ_SetFastTriggerMode(int handle, CAEN_DGTZ_TriggerMode_t mode) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  return dig->x742() ? CAEN_DGTZ_Success : CAEN_DGTZ_FunctionNotAllowed;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetGroupFastTriggerThreshold(
+    int handle, uint32_t group, uint32_t Tvalue) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  return dig->x742() ? CAEN_DGTZ_Success : CAEN_DGTZ_FunctionNotAllowed;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetGroupFastTriggerDCOffset(
+    int handle, uint32_t group, uint32_t DCvalue) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  return dig->x742() ? CAEN_DGTZ_Success : CAEN_DGTZ_FunctionNotAllowed;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API
+CAEN_DGTZ_SetFastTriggerDigitizing(int handle, CAEN_DGTZ_EnaDis_t enable) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+  if (!dig->x742()) return CAEN_DGTZ_FunctionNotAllowed;
+
+  dig->fast_trigger_digitizing_ = (enable == CAEN_DGTZ_ENABLE);
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_SetDRS4SamplingFrequency(
+    int handle, CAEN_DGTZ_DRS4Frequency_t frequency) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+  if (!dig->x742()) return CAEN_DGTZ_FunctionNotAllowed;
+  if (frequency >= _CAEN_DGTZ_DRS4_COUNT_) return CAEN_DGTZ_InvalidParam;
+
+  dig->drs4_frequency_ = frequency;
+  return CAEN_DGTZ_Success;
+}
+
+// The synthetic samples need no DRS4 corrections.
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_LoadDRS4CorrectionData(
+    int handle, CAEN_DGTZ_DRS4Frequency_t frequency) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  return dig->x742() ? CAEN_DGTZ_Success : CAEN_DGTZ_FunctionNotAllowed;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_EnableDRS4Correction(int handle) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  return dig->x742() ? CAEN_DGTZ_Success : CAEN_DGTZ_FunctionNotAllowed;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_MallocReadoutBuffer(int handle,
+                                                               char **buffer,
+                                                               uint32_t *size) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  *size = dig->BlockBytes();
+  *buffer = static_cast<char *>(std::malloc(*size));
+  if (*buffer == nullptr) return CAEN_DGTZ_OutOfMemory;
+
+  Lib().buffers[*buffer] = *size;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_FreeReadoutBuffer(char **buffer) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+
+  if (*buffer != nullptr) {
+    Lib().buffers.erase(*buffer);
+    std::free(*buffer);
+    *buffer = nullptr;
+  }
+
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_ReadData(int handle,
+                                                    CAEN_DGTZ_ReadMode_t mode,
+                                                    char *buffer,
+                                                    uint32_t *bufferSize) {
+  double us;
+
+  {
+    std::lock_guard<std::mutex> lock(Lib().mutex);
+    Digitizer *dig = Find(handle);
+    if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+    if (buffer == nullptr) return CAEN_DGTZ_InvalidBuffer;
+
+    auto it = Lib().buffers.find(buffer);
+    uint32_t capacity =
+        (it == Lib().buffers.end()) ? dig->BlockBytes() : it->second;
+
+    // A buffer allocated before the record length grew can't hold an
+    // event at all.
+    if (capacity < dig->EventBytes()) {
+      *bufferSize = 0;
+      return CAEN_DGTZ_InvalidBuffer;
+    }
+
+    *bufferSize = dig->Read(buffer, capacity);
+    us = dig->TransferTime(*bufferSize);
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(us));
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_GetNumEvents(int handle,
+                                                        char *buffer,
+                                                        uint32_t buffsize,
+                                                        uint32_t *numEvents) {
+  const uint32_t *w = reinterpret_cast<const uint32_t *>(buffer);
+  uint32_t pos = 0, num = 0;
+
+  while (pos < buffsize / 4) {
+    if ((w[pos] >> 28) != 0xa) return CAEN_DGTZ_InvalidBuffer;
+
+    pos += w[pos] & 0x0fffffff;
+    ++num;
+  }
+
+  *numEvents = num;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_GetEventInfo(
+    int handle, char *buffer, uint32_t buffsize, int32_t numEvent,
+    CAEN_DGTZ_EventInfo_t *eventInfo, char **EventPtr) {
+  bool x742;
+
+  {
+    std::lock_guard<std::mutex> lock(Lib().mutex);
+    Digitizer *dig = Find(handle);
+    if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+    x742 = dig->x742();
+  }
+
+  uint32_t *w = reinterpret_cast<uint32_t *>(buffer);
+  uint32_t pos = 0;
+
+  for (int32_t i = 0; pos < buffsize / 4; ++i) {
+    if ((w[pos] >> 28) != 0xa) return CAEN_DGTZ_InvalidBuffer;
+
+    if (i == numEvent) {
+      const uint32_t *hdr = w + pos;
+
+      eventInfo->EventSize = 4 * (hdr[0] & 0x0fffffff);
+      eventInfo->BoardId = hdr[1] >> 27;
+      eventInfo->Pattern = (hdr[1] >> 8) & 0xffff;
+
+      if (x742) {
+        eventInfo->ChannelMask = hdr[1] & 0xf;
+        eventInfo->EventCounter = hdr[2] & 0x3fffff;
+      } else {
+        eventInfo->ChannelMask = (hdr[1] & 0xff) | ((hdr[2] >> 24) << 8);
+        eventInfo->EventCounter = hdr[2] & 0xffffff;
+      }
+
+      eventInfo->TriggerTimeTag = hdr[3];
+      *EventPtr = reinterpret_cast<char *>(w + pos);
+      return CAEN_DGTZ_Success;
+    }
+
+    pos += w[pos] & 0x0fffffff;
+  }
+
+  return CAEN_DGTZ_BadEventNumber;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_AllocateEvent(int handle,
+                                                         void **Evt) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+  if (dig->x742()) {
+    auto evt = new CAEN_DGTZ_X742_EVENT_t();
+
+    for (uint32_t gr = 0; gr < dig->model().channels; ++gr) {
+      for (int ch = 0; ch < MAX_X742_CHANNEL_SIZE; ++ch) {
+        evt->DataGroup[gr].DataChannel[ch] = new float[kX742MaxLength];
+      }
+    }
+
+    *Evt = evt;
+    Lib().events[*Evt] = kX742MaxLength;
+
+  } else {
+    auto evt = new CAEN_DGTZ_UINT16_EVENT_t();
+    uint32_t len = dig->record_length();
+
+    for (uint32_t ch = 0; ch < dig->model().channels; ++ch) {
+      evt->DataChannel[ch] = new uint16_t[len];
+    }
+
+    *Evt = evt;
+    Lib().events[*Evt] = len;
+  }
+
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_FreeEvent(int handle, void **Evt) {
+  std::lock_guard<std::mutex> lock(Lib().mutex);
+  Digitizer *dig = Find(handle);
+  if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+  if (*Evt == nullptr) return CAEN_DGTZ_Success;
+
+  if (dig->x742()) {
+    auto evt = static_cast<CAEN_DGTZ_X742_EVENT_t *>(*Evt);
+
+    for (int gr = 0; gr < MAX_X742_GROUP_SIZE; ++gr) {
+      for (int ch = 0; ch < MAX_X742_CHANNEL_SIZE; ++ch) {
+        delete[] evt->DataGroup[gr].DataChannel[ch];
+      }
+    }
+
+    delete evt;
+
+  } else {
+    auto evt = static_cast<CAEN_DGTZ_UINT16_EVENT_t *>(*Evt);
+
+    for (int ch = 0; ch < MAX_UINT16_CHANNEL_SIZE; ++ch) {
+      delete[] evt->DataChannel[ch];
+    }
+
+    delete evt;
+  }
+
+  Lib().events.erase(*Evt);
+  *Evt = nullptr;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAENDGTZ_API CAEN_DGTZ_DecodeEvent(int handle,
+                                                       char *evtPtr,
+                                                       void **Evt) {
+  bool x742;
+  uint32_t channels, capacity;
+
+  {
+    std::lock_guard<std::mutex> lock(Lib().mutex);
+    Digitizer *dig = Find(handle);
+    if (dig == nullptr) return CAEN_DGTZ_InvalidHandle;
+
+    auto it = Lib().events.find(*Evt);
+    if (it == Lib().events.end()) return CAEN_DGTZ_InvalidEvent;
+
+    x742 = dig->x742();
+    channels = dig->model().channels;
+    capacity = it->second;
+  }
+
+  const uint32_t *w = reinterpret_cast<const uint32_t *>(evtPtr);
+  if (w == nullptr || (w[0] >> 28) != 0xa) return CAEN_DGTZ_InvalidEvent;
+
+  uint32_t words = w[0] & 0x0fffffff;
+  const uint32_t *end = w + words;
+
+  if (!x742) {
+    auto evt = static_cast<CAEN_DGTZ_UINT16_EVENT_t *>(*Evt);
+    uint32_t mask = (w[1] & 0xff) | ((w[2] >> 24) << 8);
+    uint32_t nch = 0;
+
+    for (uint32_t ch = 0; ch < channels; ++ch) {
+      if (mask & (1 << ch)) ++nch;
+    }
+
+    uint32_t len = nch ? 2 * (words - 4) / nch : 0;
+    if (len > capacity) return CAEN_DGTZ_InvalidEvent;
+
+    w += 4;
+
+    for (uint32_t ch = 0; ch < channels; ++ch) {
+      if (!(mask & (1 << ch))) {
+        evt->ChSize[ch] = 0;
+        continue;
+      }
+
+      uint16_t *data = evt->DataChannel[ch];
+
+      for (uint32_t i = 0; i < len; i += 2) {
+        data[i] = *w & 0xffff;
+        data[i + 1] = *w++ >> 16;
+      }
+
+      evt->ChSize[ch] = len;
+    }
+
+    return CAEN_DGTZ_Success;
+  }
+
+  auto evt = static_cast<CAEN_DGTZ_X742_EVENT_t *>(*Evt);
+  uint32_t mask = w[1] & 0xf;
+  uint32_t c[kX742Channels];
+
+  w += 4;
+
+  for (uint32_t gr = 0; gr < channels; ++gr) {
+    CAEN_DGTZ_X742_GROUP_t &group = evt->DataGroup[gr];
+
+    evt->GrPresent[gr] = (mask >> gr) & 0x1;
+    if (!evt->GrPresent[gr]) continue;
+
+    uint32_t header = *w++;
+    uint32_t len = (header & 0xfff) / 3;
+    bool trg = header & 0x1000;
+
+    if (len > capacity || w + 3 * len > end) return CAEN_DGTZ_InvalidEvent;
+
+    for (uint32_t i = 0; i < len; ++i, w += 3) {
+      Unpack12(w, c);
+
+      for (int ch = 0; ch < kX742Channels; ++ch) {
+        group.DataChannel[ch][i] = c[ch];
+      }
+    }
+
+    for (int ch = 0; ch < kX742Channels; ++ch) {
+      group.ChSize[ch] = len;
+    }
+
+    group.ChSize[kX742Trigger] = 0;
+
+    if (trg) {
+      for (uint32_t i = 0; i < len; i += 8, w += 3) {
+        Unpack12(w, c);
+        std::copy(c, c + 8, group.DataChannel[kX742Trigger] + i);
+      }
+
+      group.ChSize[kX742Trigger] = len;
+    }
+
+    group.StartIndexCell = (header >> 20) & 0x3ff;
+    group.TriggerTimeTag = *w++;
+  }
+
+  return CAEN_DGTZ_Success;
+}
+
+}  // extern "C"
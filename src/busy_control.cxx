@@ -0,0 +1,134 @@
+#include "busy_control.hh"
+
+#include <algorithm>
+
+namespace daq {
+
+BusyOutput ReadBusyOutput(const boost::property_tree::ptree &conf) {
+  BusyOutput out;
+
+  auto node = conf.get_child_optional("busy_output");
+  if (!node) return out;
+
+  out.reg = std::stoul(node->get<std::string>("register"), nullptr, 0);
+  out.mask = std::stoul(node->get<std::string>("mask", "0xffffffff"),
+                        nullptr, 0);
+  out.busy = std::stoul(node->get<std::string>("busy"), nullptr, 0);
+  out.idle = std::stoul(node->get<std::string>("idle", "0x0"), nullptr, 0);
+  out.in_use = node->get<bool>("in_use", true);
+
+  return out;
+}
+
+BusyControl &BusyControl::Instance() {
+  static BusyControl busy;
+  return busy;
+}
+
+BusyControl::BusyControl()
+    : CommonBase(std::string("BusyControl")),
+      in_use_(false),
+      high_(1.0),
+      low_(0.0),
+      num_holding_(0),
+      running_(false),
+      run_start_(0),
+      run_stop_(0),
+      busy_since_(0),
+      busy_ns_(0),
+      busy_time_(Metrics::Instance().GetCounter("BusyControl.busy_ns")),
+      asserted_(Metrics::Instance().GetGauge("BusyControl.asserted")) {}
+
+void BusyControl::SetWatermarks(bool in_use, double high, double low) {
+  high_ = high;
+  low_ = low;
+  in_use_ = in_use;
+}
+
+void BusyControl::StartRun() {
+  std::lock_guard<std::mutex> lock(time_mutex_);
+
+  running_ = true;
+  run_start_ = MetricsNow();
+  busy_ns_ = 0;
+}
+
+void BusyControl::StopRun() {
+  std::lock_guard<std::mutex> lock(time_mutex_);
+  if (!running_) return;
+
+  run_stop_ = MetricsNow();
+  busy_ns_ += OpenBusyTime(run_stop_);
+  running_ = false;
+
+  LogMessage("run was busy for %lli of %lli ns", busy_ns_,
+             run_stop_ - run_start_);
+}
+
+Livetime BusyControl::GetLivetime() {
+  std::lock_guard<std::mutex> lock(time_mutex_);
+  Livetime live;
+
+  if (running_) {
+    long long now = MetricsNow();
+    live.run_ns = now - run_start_;
+    live.busy_ns = busy_ns_ + OpenBusyTime(now);
+  } else {
+    live.run_ns = run_stop_ - run_start_;
+    live.busy_ns = busy_ns_;
+  }
+
+  return live;
+}
+
+void BusyControl::Hold() {
+  std::lock_guard<std::mutex> lock(time_mutex_);
+
+  if (num_holding_++ == 0) {
+    busy_since_ = MetricsNow();
+    asserted_.Set(1);
+  }
+}
+
+void BusyControl::Release() {
+  std::lock_guard<std::mutex> lock(time_mutex_);
+
+  if (num_holding_ == 1) {
+    long long now = MetricsNow();
+
+    busy_time_.Add(now - busy_since_);
+    if (running_) busy_ns_ += OpenBusyTime(now);
+
+    asserted_.Set(0);
+  }
+
+  --num_holding_;
+}
+
+long long BusyControl::OpenBusyTime(long long now) {
+  if (num_holding_ == 0) return 0;
+  return now - std::max(busy_since_, run_start_);
+}
+
+void BusySource::Update(size_t depth, size_t max_size) {
+  BusyControl &control = BusyControl::Instance();
+
+  if (!holding_) {
+    if (control.in_use() && depth >= control.high_water_mark() * max_size) {
+      holding_ = true;
+      control.Hold();
+    }
+
+  } else if (depth <= control.low_water_mark() * max_size) {
+    Release();
+  }
+}
+
+void BusySource::Release() {
+  if (holding_) {
+    holding_ = false;
+    BusyControl::Instance().Release();
+  }
+}
+
+}  // ::daq
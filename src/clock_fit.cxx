@@ -0,0 +1,142 @@
+#include "clock_fit.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace daq {
+
+void TimeTagClock::SetTag(int bits, double tick_ns) {
+  mask_ = (bits >= 64) ? ~0ULL : (1ULL << bits) - 1;
+  tick_ns_ = tick_ns;
+  started_ = false;
+  last_ = 0;
+  last_host_ns_ = 0;
+}
+
+uint64_t TimeTagClock::Extend(uint64_t tag, long long host_ns) {
+  tag &= mask_;
+
+  if (!started_) {
+    started_ = true;
+    last_ = tag;
+    last_host_ns_ = host_ns;
+    return last_;
+  }
+
+  // Ticks since the last event, within one wrap of the tag.
+  uint64_t ticks = (tag - last_) & mask_;
+
+  // The host time says how many whole wraps went by unseen.  A wrap is
+  // only counted when the host is sure of it, half a period to spare.
+  double period_ns = (mask_ + 1.0) * tick_ns_;
+  double elapsed_ns = host_ns - last_host_ns_;
+  double missed = std::floor((elapsed_ns - ticks * tick_ns_) / period_ns + 0.5);
+
+  if (missed > 0) ticks += (uint64_t)missed * (mask_ + 1);
+
+  last_ += ticks;
+  last_host_ns_ = host_ns;
+
+  return last_;
+}
+
+ClockFit::ClockFit(const std::string &name, int window)
+    : window_(window),
+      next_(0),
+      num_added_(0),
+      has_fit_(false),
+      slope_(1.0),
+      host_mean_(0.0),
+      device_mean_(0.0),
+      drift_(Metrics::Instance().GetGauge(name + ".clock_drift_ppb")),
+      residual_(Metrics::Instance().GetGauge(name + ".clock_residual_ns")) {}
+
+bool ClockFit::Configure(const boost::property_tree::ptree &conf) {
+  auto node = conf.get_child_optional("clock_fit");
+  if (!node || !node->get<bool>("in_use", true)) return false;
+
+  window_ = std::max(2, node->get<int>("window", 1000));
+  Reset();
+
+  return true;
+}
+
+void ClockFit::Reset() {
+  host_ns_.clear();
+  device_ns_.clear();
+  next_ = 0;
+  num_added_ = 0;
+
+  std::lock_guard<std::mutex> lock(fit_mutex_);
+  has_fit_ = false;
+}
+
+void ClockFit::Add(long long host_ns, long long device_ns) {
+  if ((int)host_ns_.size() < window_) {
+    host_ns_.push_back(host_ns);
+    device_ns_.push_back(device_ns);
+
+  } else {
+    host_ns_[next_] = host_ns;
+    device_ns_[next_] = device_ns;
+  }
+
+  next_ = (next_ + 1) % window_;
+
+  // Refitting costs a pass over the window, so it is done ten times a
+  // window rather than every event.
+  if (++num_added_ >= std::max(2, window_ / 10) && host_ns_.size() >= 2) {
+    Fit();
+    num_added_ = 0;
+  }
+}
+
+long long ClockFit::HostTime(long long device_ns) {
+  std::lock_guard<std::mutex> lock(fit_mutex_);
+  if (!has_fit_) return -1;
+
+  return std::llround(host_mean_ + (device_ns - device_mean_) / slope_);
+}
+
+void ClockFit::Fit() {
+  int n = host_ns_.size();
+
+  // Centered on the first point, the sums keep ns precision in doubles.
+  long long h0 = host_ns_[0], d0 = device_ns_[0];
+  double hm = 0.0, dm = 0.0;
+
+  for (int i = 0; i < n; ++i) {
+    hm += (double)(host_ns_[i] - h0) / n;
+    dm += (double)(device_ns_[i] - d0) / n;
+  }
+
+  double shh = 0.0, shd = 0.0;
+  for (int i = 0; i < n; ++i) {
+    double h = host_ns_[i] - h0 - hm;
+    double d = device_ns_[i] - d0 - dm;
+    shh += h * h;
+    shd += h * d;
+  }
+
+  if (shh <= 0.0) return;
+  double slope = shd / shh;
+
+  double ssr = 0.0;
+  for (int i = 0; i < n; ++i) {
+    double r = (device_ns_[i] - d0 - dm) - slope * (host_ns_[i] - h0 - hm);
+    ssr += r * r;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(fit_mutex_);
+    has_fit_ = true;
+    slope_ = slope;
+    host_mean_ = h0 + hm;
+    device_mean_ = d0 + dm;
+  }
+
+  drift_.Set(std::llround((slope - 1.0) * 1.0e9));
+  residual_.Set(std::llround(std::sqrt(ssr / n)));
+}
+
+}  // ::daq
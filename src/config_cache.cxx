@@ -0,0 +1,280 @@
+#include "config_cache.hh"
+
+#include <sys/stat.h>
+
+namespace daq {
+
+namespace {
+
+typedef boost::property_tree::ptree ptree;
+
+// Walks two trees in step, recording each path whose value differs.
+// Children are matched by position, so array entries compare by index.
+void DiffTrees(const ptree &a, const ptree &b, const std::string &path,
+               std::vector<std::string> &changed) {
+  if (a.data() != b.data()) {
+    changed.push_back(path);
+  }
+
+  auto it_a = a.begin();
+  auto it_b = b.begin();
+  int idx = 0;
+
+  for (; it_a != a.end() && it_b != b.end(); ++it_a, ++it_b, ++idx) {
+    std::string key = it_a->first.empty() ? std::to_string(idx) : it_a->first;
+    std::string child = path.empty() ? key : path + "." + key;
+
+    if (it_a->first != it_b->first) {
+      changed.push_back(child);
+    } else {
+      DiffTrees(it_a->second, it_b->second, child, changed);
+    }
+  }
+
+  // Anything left over was added or removed.
+  for (; it_a != a.end(); ++it_a, ++idx) {
+    std::string key = it_a->first.empty() ? std::to_string(idx) : it_a->first;
+    changed.push_back(path.empty() ? key : path + "." + key);
+  }
+
+  for (; it_b != b.end(); ++it_b, ++idx) {
+    std::string key = it_b->first.empty() ? std::to_string(idx) : it_b->first;
+    changed.push_back(path.empty() ? key : path + "." + key);
+  }
+}
+
+// File modification time, st_mtim is named differently on OS X.
+inline const timespec &ModTime(const struct stat &st) {
+#ifdef OS_DARWIN
+  return st.st_mtimespec;
+#else
+  return st.st_mtim;
+#endif
+}
+
+}  // ::
+
+ConfigCache &ConfigCache::Instance() {
+  static ConfigCache cache;
+  return cache;
+}
+
+conf_ptr ConfigCache::Load(const std::string &conf_file) {
+  struct stat st;
+  bool have_stat = (stat(conf_file.c_str(), &st) == 0);
+
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = cache_.find(conf_file);
+
+    if (have_stat && it != cache_.end() &&
+        it->second.mtime_sec == ModTime(st).tv_sec &&
+        it->second.mtime_nsec == ModTime(st).tv_nsec &&
+        it->second.size == st.st_size) {
+      return it->second.conf;
+    }
+  }
+
+  // Parse outside the lock so workers configuring in parallel don't wait
+  // on each other's files.
+  auto conf = std::make_shared<ptree>();
+  boost::property_tree::read_json(conf_file, *conf);
+
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  Entry &entry = cache_[conf_file];
+
+  if (have_stat) {
+    entry.mtime_sec = ModTime(st).tv_sec;
+    entry.mtime_nsec = ModTime(st).tv_nsec;
+    entry.size = st.st_size;
+  } else {
+    entry.mtime_sec = 0;
+    entry.mtime_nsec = -1;
+    entry.size = -1;
+  }
+
+  // A touched but unchanged file keeps its old tree.
+  if (entry.conf && (*entry.conf == *conf)) {
+    return entry.conf;
+  }
+
+  LogDebug("parsed %s", conf_file.c_str());
+  entry.conf = conf;
+  entry.run.reset();
+
+  return entry.conf;
+}
+
+std::shared_ptr<const RunConfig> ConfigCache::LoadRun(
+    const std::string &conf_file) {
+  conf_ptr conf = Load(conf_file);
+
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    Entry &entry = cache_[conf_file];
+
+    if (entry.run && entry.run->tree == conf) {
+      return entry.run;
+    }
+  }
+
+  auto run = BuildRun(conf);
+
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  Entry &entry = cache_[conf_file];
+
+  if (entry.conf == conf) {
+    entry.run = run;
+  }
+
+  return run;
+}
+
+bool ConfigCache::Changed(const std::string &conf_file, const conf_ptr &prev) {
+  return Load(conf_file) != prev;
+}
+
+std::vector<std::string> ConfigCache::Diff(const ptree &a, const ptree &b) {
+  std::vector<std::string> changed;
+  DiffTrees(a, b, std::string(""), changed);
+  return changed;
+}
+
+void ConfigCache::Clear() {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  cache_.clear();
+}
+
+std::shared_ptr<const RunConfig> ConfigCache::BuildRun(const conf_ptr &conf) {
+  auto run = std::make_shared<RunConfig>();
+
+  run->tree = conf;
+  run->logfile = conf->get<std::string>("logfile", logfile_);
+
+  run->batch_size = conf->get<int>("batch_size", 10);
+  if (run->batch_size < 1) {
+    LogWarning("batch_size %i is invalid, using 1", run->batch_size);
+    run->batch_size = 1;
+  }
+
+  run->max_event_time = conf->get<int>("max_event_time", 2000);
+  if (run->max_event_time < 1) {
+    LogWarning("max_event_time %i is invalid, using 2000",
+               run->max_event_time);
+    run->max_event_time = 2000;
+  }
+
+  run->init_threads = conf->get<int>("init_threads", 0);
+  if (run->init_threads < 0) {
+    LogWarning("init_threads %i is invalid, using one per device",
+               run->init_threads);
+    run->init_threads = 0;
+  }
+
+  run->root_file = conf->get<std::string>("writers.root.file", "default.root");
+  run->root_tree = conf->get<std::string>("writers.root.tree", "t");
+  run->root_sync = conf->get<bool>("writers.root.sync", false);
+
+  run->online_port = conf->get<std::string>("writers.online.port", "");
+  run->online_high_water_mark =
+      conf->get<int>("writers.online.high_water_mark", 10);
+  run->online_max_trace_length =
+      conf->get<int>("writers.online.max_trace_length", -1);
+
+  if (run->online_high_water_mark < 0) {
+    LogWarning("writers.online.high_water_mark %i is invalid, using 10",
+               run->online_high_water_mark);
+    run->online_high_water_mark = 10;
+  }
+
+  run->metrics_port = conf->get<std::string>("metrics.port", "");
+
+  std::string mode = conf->get<std::string>("raw_stream.mode", "off");
+  if (mode == "record") {
+    run->raw_stream.mode = RawStreamMode::kRecord;
+
+  } else if (mode == "replay") {
+    run->raw_stream.mode = RawStreamMode::kReplay;
+
+  } else if (mode != "off") {
+    LogWarning("raw_stream.mode %s is invalid, using off", mode.c_str());
+  }
+
+  run->raw_stream.dir =
+      conf->get<std::string>("raw_stream.dir", run->raw_stream.dir);
+  run->raw_stream.paced =
+      conf->get<std::string>("raw_stream.pace", "recorded") != "fast";
+  run->raw_stream.loop = conf->get<bool>("raw_stream.loop", false);
+
+  run->worker_queue = ReadQueueLimits(*conf, "flow_control.workers",
+                                      QueueLimits(100, QueuePolicy::kBlock));
+  run->builder_queue = ReadQueueLimits(
+      *conf, "flow_control.builder", QueueLimits(50, QueuePolicy::kDropNewest));
+
+  // A batch is only sent once the queue holds batch_size events, a
+  // smaller queue would block the builder or drop every event.
+  if (run->builder_queue.max_size < run->batch_size) {
+    LogWarning("flow_control.builder.queue_size %i is below batch_size %i, "
+               "using %i", run->builder_queue.max_size, run->batch_size,
+               run->batch_size);
+    run->builder_queue.max_size = run->batch_size;
+  }
+  run->writer_queue = ReadQueueLimits(
+      *conf, "flow_control.writers", QueueLimits(5, QueuePolicy::kDropNewest));
+
+  run->writer_batches = conf->get<int>("flow_control.writers.max_batches", 8);
+  if (run->writer_batches < 1) {
+    LogWarning("flow_control.writers.max_batches %i is invalid, using 8",
+               run->writer_batches);
+    run->writer_batches = 8;
+  }
+
+  run->busy_in_use = conf->get<bool>("busy.in_use", false);
+  run->busy_high_water_mark = conf->get<double>("busy.high_water_mark", 0.8);
+  run->busy_low_water_mark = conf->get<double>("busy.low_water_mark", 0.5);
+
+  if (run->busy_high_water_mark <= 0.0 || run->busy_high_water_mark > 1.0) {
+    LogWarning("busy.high_water_mark %.2f is invalid, using 0.8",
+               run->busy_high_water_mark);
+    run->busy_high_water_mark = 0.8;
+  }
+
+  if (run->busy_low_water_mark < 0.0 ||
+      run->busy_low_water_mark > run->busy_high_water_mark) {
+    LogWarning("busy.low_water_mark %.2f is invalid, using half the high",
+               run->busy_low_water_mark);
+    run->busy_low_water_mark = 0.5 * run->busy_high_water_mark;
+  }
+
+  return run;
+}
+
+QueueLimits ConfigCache::ReadQueueLimits(const ptree &conf,
+                                         const std::string &path,
+                                         QueueLimits limits) {
+  int size = conf.get<int>(path + ".queue_size", limits.max_size);
+  if (size < 1) {
+    LogWarning("%s.queue_size %i is invalid, using %i", path.c_str(), size,
+               limits.max_size);
+  } else {
+    limits.max_size = size;
+  }
+
+  std::string policy = conf.get<std::string>(path + ".policy", "");
+  if (!policy.empty() && !ParseQueuePolicy(policy, limits.policy)) {
+    LogWarning("%s.policy %s is invalid, keeping the default", path.c_str(),
+               policy.c_str());
+  }
+
+  int prescale = conf.get<int>(path + ".prescale", limits.prescale);
+  if (prescale < 1) {
+    LogWarning("%s.prescale %i is invalid, using %i", path.c_str(), prescale,
+               limits.prescale);
+  } else {
+    limits.prescale = prescale;
+  }
+
+  return limits;
+}
+
+}  // ::daq
@@ -5,11 +5,22 @@ namespace daq {
 EventBuilder::EventBuilder(const WorkerList &workers,
                            const std::vector<WriterBase *> &writers,
                            std::string conf_file)
-    : CommonBase(std::string("EventBuilder")) {
+    : CommonBase(std::string("EventBuilder")),
+      num_built_(Metrics::Instance().GetCounter("EventBuilder.built")),
+      num_sent_(Metrics::Instance().GetCounter("EventBuilder.sent")),
+      num_unsynced_(Metrics::Instance().GetCounter("EventBuilder.unsynced")),
+      num_doubles_(Metrics::Instance().GetCounter("EventBuilder.doubles")),
+      num_overflow_(Metrics::Instance().GetCounter("EventBuilder.overflow")),
+      num_discarded_(Metrics::Instance().GetCounter("EventBuilder.discarded")),
+      build_time_(Metrics::Instance().GetHistogram("EventBuilder.build_ns")),
+      queue_depth_(Metrics::Instance().GetGauge("EventBuilder.queue_depth")) {
   workers_ = workers;
   writers_ = writers;
   conf_file_ = conf_file;
 
+  counts_at_start_ = BuilderCounts();
+  counts_at_start_ = GetCounts();
+
   LoadConfig();
 
   builder_thread_ = std::thread(&EventBuilder::BuilderLoop, this);
@@ -17,28 +28,55 @@ EventBuilder::EventBuilder(const WorkerList &workers,
 }
 
 void EventBuilder::LoadConfig() {
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
+  auto conf = ConfigCache::Instance().LoadRun(conf_file_);
 
   thread_live_ = true;
   go_time_ = false;
   quitting_time_ = false;
   finished_run_ = false;
+  building_ = false;
+
+  batch_size_ = conf->batch_size;
+  max_event_time_ = conf->max_event_time;
+
+  queue_mutex_.lock();
+  gate_.SetLimits(conf->builder_queue);
+  queue_mutex_.unlock();
 
-  batch_size_ = conf.get<int>("batch_size", 10);
-  max_event_time_ = conf.get<int>("max_event_time", 2000);
+  BusyControl::Instance().SetWatermarks(conf->busy_in_use,
+                                        conf->busy_high_water_mark,
+                                        conf->busy_low_water_mark);
+
+  if (!conf->metrics_port.empty()) {
+    Metrics::Instance().StartExporter(conf->metrics_port);
+  }
+}
+
+void EventBuilder::StartBuilder() {
+  // Update the reference and drop events read before the run began.
+  batch_start_ = clock();
+  workers_.FlushEventData();
+
+  quitting_time_ = false;
+  finished_run_ = false;
+  BusyControl::Instance().StartRun();
+  go_time_ = true;
 }
 
 void EventBuilder::BuilderLoop() {
   // Thread can only be killed by ending the run.
   while (thread_live_) {
-    // Update the reference and drop any events outside of run time.
-    batch_start_ = clock();
-    workers_.FlushEventData();
-
     // Collect data while the run isn't paused, in a deadtime or finished.
-    while (go_time_) {
-      if (WorkersGotSyncEvent()) {
+    while (BeginPass()) {
+      long long t_start = MetricsNow();
+
+      // A blocked queue leaves the events with the workers, whose queues
+      // then fill up and hold off the hardware in turn.
+      queue_mutex_.lock();
+      bool blocked = gate_.Blocked(pull_data_que_.size());
+      queue_mutex_.unlock();
+
+      if (!blocked && WorkersGotSyncEvent()) {
         // Get the data.
         event_data bundle;
 
@@ -46,16 +84,32 @@ void EventBuilder::BuilderLoop() {
 
         // Push it back to pull_data queue.
         queue_mutex_.lock();
-        if (pull_data_que_.size() < kMaxQueueSize) {
+        QueueAction action = gate_.Admit(pull_data_que_.size());
+
+        if (action == QueueAction::kDropNewest) {
+          num_overflow_.Add();
+
+        } else {
+          if (action == QueueAction::kDropOldest) {
+            pull_data_que_.pop();
+            num_overflow_.Add();
+          }
+
           pull_data_que_.push(bundle);
+          num_built_.Add();
         }
+        queue_depth_.Set(pull_data_que_.size());
+        busy_source_.Update(pull_data_que_.size(), gate_.limits().max_size);
         queue_mutex_.unlock();
 
+        build_time_.Record(MetricsNow() - t_start);
+
         LogMessage("Data queue is now size = %i", pull_data_que_.size());
 
         //  workers_.FlushEventData();
       }
 
+      building_ = false;
       std::this_thread::yield();
       usleep(daq::short_sleep);
 
@@ -67,13 +121,22 @@ void EventBuilder::BuilderLoop() {
   }  // thread_live_
 }
 
+bool EventBuilder::BeginPass() {
+  // Checked under the lock EndRun clears go_time_ with, so no pass can
+  // start once EndRun has seen building_ drop.
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  building_ = go_time_.load();
+
+  return building_;
+}
+
 void EventBuilder::ControlLoop() {
   while (thread_live_) {
     while (go_time_) {
       bool over_batch_size = false;
       {
         std::lock_guard<std::mutex> lock(queue_mutex_);
-        over_batch_size = pull_data_que_.size() >= batch_size_;
+        over_batch_size = pull_data_que_.size() >= (size_t)batch_size_;
       }
 
       if (over_batch_size) {
@@ -83,15 +146,7 @@ void EventBuilder::ControlLoop() {
       }
 
       if (quitting_time_) {
-        StopWorkers();
-
-        CopyBatch();
-
-        SendLastBatch();
-
-        go_time_ = false;
-        thread_live_ = false;
-        finished_run_ = true;
+        EndRun();
       }
 
       std::this_thread::yield();
@@ -104,7 +159,10 @@ void EventBuilder::ControlLoop() {
 }
 
 bool EventBuilder::WorkersGotSyncEvent() {
-  bool any_have_event =  workers_.AnyWorkersHaveEvent();
+  int min_events, max_events;
+  workers_.GetEventCounts(min_events, max_events);
+
+  bool any_have_event = max_events > 0;
   //if only one worker, no need to try synchronization
   if (workers_.Size() == 1) { return any_have_event; }
 
@@ -115,16 +173,21 @@ bool EventBuilder::WorkersGotSyncEvent() {
   // Wait for all devices to get a chance to read the event.
   usleep(max_event_time_);
 
+  // One scan answers both of the checks below.
+  workers_.GetEventCounts(min_events, max_events);
+
   // Drop the event if not all devices got a trigger.
-  if (!workers_.AllWorkersHaveEvent()) {
+  if (min_events == 0) {
     workers_.FlushEventData();
+    num_unsynced_.Add();
     LogMessage("Event was not synched");
     return false;
   }
 
   // Drop the event if any devices got two triggers.
-  if (workers_.AnyWorkersHaveMultiEvent()) {
+  if (max_events > 1) {
     workers_.FlushEventData();
+    num_doubles_.Add();
     LogMessage("Trigger was actually a double event");
     return false;
   }
@@ -143,6 +206,8 @@ void EventBuilder::CopyBatch() {
     if (!pull_data_que_.empty()) {
       push_data_vec_.push_back(pull_data_que_.front());
       pull_data_que_.pop();
+      queue_depth_.Set(pull_data_que_.size());
+      busy_source_.Update(pull_data_que_.size(), gate_.limits().max_size);
 
       LogMessage("Pull queue size = %i", pull_data_que_.size());
     }
@@ -156,30 +221,124 @@ void EventBuilder::CopyBatch() {
 void EventBuilder::SendBatch() {
   push_data_mutex_.lock();
 
+  // Every writer queues the same copy of the batch.
+  auto batch = std::make_shared<std::vector<event_data>>();
+  batch->swap(push_data_vec_);
+
   for (auto &writer : writers_) {
-    writer->PushData(push_data_vec_);
+    writer->SubmitBatch(batch);
   }
 
+  num_sent_.Add(batch->size());
   push_data_mutex_.unlock();
 }
 
 void EventBuilder::SendLastBatch() {
   LogMessage("Sending last batch");
 
-  // Zero the pull data vec
-  queue_mutex_.lock();
-  while (pull_data_que_.size() != 0) pull_data_que_.pop();
-  queue_mutex_.unlock();
+  // Everything built goes out, in batches as during the run.
+  while (true) {
+    queue_mutex_.lock();
+    bool empty = pull_data_que_.empty();
+    queue_mutex_.unlock();
+
+    if (empty) break;
+
+    CopyBatch();
+    SendBatch();
+  }
 
   push_data_mutex_.lock();
   LogMessage("Sending end of batch/run to the writers");
+
+  std::vector<std::future<void>> flushed;
   for (auto &writer : writers_) {
-    writer->PushData(push_data_vec_);
-    writer->EndOfBatch(false);
+    writer->SubmitEndOfBatch(false);
+    flushed.push_back(writer->Flush());
+  }
+
+  // The run is finished once every writer has caught up.
+  for (auto &done : flushed) {
+    done.wait();
   }
+
   push_data_mutex_.unlock();
 }
 
+void EventBuilder::DrainWorkers() {
+  long long t_stop = MetricsNow();
+
+  // Let readouts in progress reach the worker queues.
+  usleep(max_event_time_);
+
+  while (true) {
+    int min_events, max_events;
+    workers_.GetEventCounts(min_events, max_events);
+
+    if (max_events == 0 && !building_) break;
+
+    if (MetricsNow() - t_stop > kDrainTimeout) {
+      LogWarning("workers still hold events after the run, dropping them");
+      num_discarded_.Add(max_events);
+      workers_.FlushEventData();
+      break;
+    }
+
+    bool over_batch_size = false;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      over_batch_size = pull_data_que_.size() >= (size_t)batch_size_;
+    }
+
+    if (over_batch_size) {
+      CopyBatch();
+      SendBatch();
+    }
+
+    std::this_thread::yield();
+    usleep(daq::short_sleep);
+  }
+}
+
+void EventBuilder::EndRun() {
+  long long t_start = MetricsNow();
+
+  StopWorkers();
+  BusyControl::Instance().StopRun();
+
+  DrainWorkers();
+
+  // Wait out the builder's last pass before emptying its queue.
+  queue_mutex_.lock();
+  go_time_ = false;
+  queue_mutex_.unlock();
+
+  while (building_) {
+    std::this_thread::yield();
+    usleep(daq::short_sleep);
+  }
+
+  SendLastBatch();
+
+  LogMessage("run ended in %lli us", (MetricsNow() - t_start) / 1000);
+
+  quitting_time_ = false;
+  finished_run_ = true;
+}
+
+BuilderCounts EventBuilder::GetCounts() {
+  BuilderCounts counts;
+
+  counts.built = num_built_.value() - counts_at_start_.built;
+  counts.sent = num_sent_.value() - counts_at_start_.sent;
+  counts.unsynced = num_unsynced_.value() - counts_at_start_.unsynced;
+  counts.doubles = num_doubles_.value() - counts_at_start_.doubles;
+  counts.overflow = num_overflow_.value() - counts_at_start_.overflow;
+  counts.discarded = num_discarded_.value() - counts_at_start_.discarded;
+
+  return counts;
+}
+
 // Start the workers taking data.
 void EventBuilder::StartWorkers() {
   LogMessage("Starting workers");
@@ -0,0 +1,193 @@
+#include "metrics.hh"
+
+#include <algorithm>
+
+namespace daq {
+
+Histogram::Histogram() : count_(0), sum_(0), max_(0) {
+  for (auto &c : counts_) {
+    c.store(0, std::memory_order_relaxed);
+  }
+}
+
+unsigned long long Histogram::UpperEdge(int index) {
+  if (index < kSubBuckets) return index;
+
+  int shift = index / kSubBuckets - 1;
+  unsigned long long lower =
+      (unsigned long long)(kSubBuckets + index % kSubBuckets) << shift;
+
+  return lower + ((1ULL << shift) - 1);
+}
+
+json11::Json Histogram::Snapshot() const {
+  static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+  static const char *labels[] = {"p50", "p90", "p99", "p999"};
+
+  // The buckets are read one at a time, so the total is taken from
+  // them rather than from count_.
+  unsigned long long counts[kNumBuckets];
+  unsigned long long total = 0;
+
+  for (int i = 0; i < kNumBuckets; ++i) {
+    counts[i] = counts_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+
+  long long max = max_.load(std::memory_order_relaxed);
+  long long sum = sum_.load(std::memory_order_relaxed);
+  long long count = count_.load(std::memory_order_relaxed);
+
+  json11::Json::object snap{
+      {"count", (double)total},
+      {"mean", count ? (double)sum / count : 0.0},
+      {"max", (double)max}};
+
+  unsigned long long seen = 0;
+  int idx = 0;
+
+  for (int q = 0; q < 4; ++q) {
+    unsigned long long rank = quantiles[q] * total;
+
+    while (idx < kNumBuckets && seen + counts[idx] <= rank) {
+      seen += counts[idx++];
+    }
+
+    double value = (idx < kNumBuckets) ? UpperEdge(idx) : max;
+    snap[labels[q]] = std::min(value, (double)max);
+  }
+
+  return snap;
+}
+
+Metrics &Metrics::Instance() {
+  static Metrics metrics;
+  return metrics;
+}
+
+Metrics::~Metrics() { StopExporter(); }
+
+Counter &Metrics::GetCounter(const std::string &name) {
+  std::lock_guard<std::mutex> lock(registry_mutex_);
+
+  auto &ptr = counters_[name];
+  if (!ptr) ptr.reset(new Counter());
+
+  return *ptr;
+}
+
+Gauge &Metrics::GetGauge(const std::string &name) {
+  std::lock_guard<std::mutex> lock(registry_mutex_);
+
+  auto &ptr = gauges_[name];
+  if (!ptr) ptr.reset(new Gauge());
+
+  return *ptr;
+}
+
+Histogram &Metrics::GetHistogram(const std::string &name) {
+  std::lock_guard<std::mutex> lock(registry_mutex_);
+
+  auto &ptr = histograms_[name];
+  if (!ptr) ptr.reset(new Histogram());
+
+  return *ptr;
+}
+
+std::string Metrics::Dump() {
+  json11::Json::object counters, gauges, histograms;
+
+  {
+    // Only guards the maps, the values are read without locking.
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+
+    for (auto &c : counters_) {
+      counters[c.first] = (double)c.second->value();
+    }
+
+    for (auto &g : gauges_) {
+      gauges[g.first] = (double)g.second->value();
+    }
+
+    for (auto &h : histograms_) {
+      histograms[h.first] = h.second->Snapshot();
+    }
+  }
+
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+
+  return json11::Json(json11::Json::object{
+                          {"time", std::chrono::duration<double>(now).count()},
+                          {"counters", counters},
+                          {"gauges", gauges},
+                          {"histograms", histograms}})
+      .dump();
+}
+
+void Metrics::StartExporter(const std::string &port) {
+  if (exporter_live_ && port == port_) return;
+
+  StopExporter();
+
+  port_ = port;
+  exporter_live_ = true;
+  exporter_thread_ = std::thread(&Metrics::ExporterLoop, this, port);
+}
+
+void Metrics::StopExporter() {
+  exporter_live_ = false;
+
+  if (exporter_thread_.joinable()) {
+    try {
+      exporter_thread_.join();
+    } catch (const std::system_error &e) {
+      LogError("encountered race condition joining thread");
+    }
+  }
+}
+
+void Metrics::ExporterLoop(std::string port) {
+  zmq::socket_t sck(msg_context, ZMQ_REP);
+
+  int linger = 0;
+  sck.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+
+  try {
+    sck.bind(port.c_str());
+  } catch (const zmq::error_t &e) {
+    LogError("could not bind metrics port %s", port.c_str());
+    return;
+  }
+
+  LogMessage("serving metrics on %s", port.c_str());
+
+  while (exporter_live_) {
+    zmq::message_t request;
+    bool got_request = false;
+
+    try {
+      got_request = sck.recv(&request, ZMQ_DONTWAIT);
+    } catch (const zmq::error_t &e) {
+      // interrupted system call
+      continue;
+    }
+
+    if (got_request) {
+      std::string buffer = Dump();
+      zmq::message_t reply(buffer.size());
+      std::copy(buffer.begin(), buffer.end(), (char *)reply.data());
+
+      try {
+        sck.send(reply);
+      } catch (const zmq::error_t &e) {
+        LogError("failed to send metrics");
+      }
+
+    } else {
+      usleep(10 * daq::long_sleep);
+      std::this_thread::yield();
+    }
+  }
+}
+
+}  // ::daq
@@ -0,0 +1,131 @@
+#include "raw_stream.hh"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+namespace daq {
+
+namespace {
+
+std::mutex settings_mutex;
+RawStreamSettings settings;
+
+long long SteadyNow() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // ::
+
+void SetRawStreamSettings(const RawStreamSettings &new_settings) {
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  settings = new_settings;
+}
+
+RawStreamSettings GetRawStreamSettings() {
+  std::lock_guard<std::mutex> lock(settings_mutex);
+  return settings;
+}
+
+std::string RawStreamPath(const std::string &worker_name) {
+  std::string dir = GetRawStreamSettings().dir;
+
+  if (!dir.empty() && dir[dir.size() - 1] != '/') {
+    dir += '/';
+  }
+
+  return dir + worker_name + ".raw";
+}
+
+bool RawStreamWriter::Open(const std::string &path, const std::string &type,
+                           const std::string &name) {
+  Close();
+
+  // Large events go straight through, the buffer batches small ones.
+  out_buffer_.resize(1 << 20);
+  out_.rdbuf()->pubsetbuf(&out_buffer_[0], out_buffer_.size());
+  out_.open(path.c_str(), std::ios::binary | std::ios::trunc);
+
+  if (!out_.is_open()) return false;
+
+  raw_file_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kRawStreamMagic, sizeof(header.magic));
+  strncpy(header.type, type.c_str(), sizeof(header.type) - 1);
+  strncpy(header.name, name.c_str(), sizeof(header.name) - 1);
+
+  out_.write((const char *)&header, sizeof(header));
+
+  t0_ = SteadyNow();
+  num_records_ = 0;
+
+  return out_.good();
+}
+
+void RawStreamWriter::Close() {
+  if (out_.is_open()) {
+    out_.close();
+  }
+}
+
+bool RawStreamWriter::Write(RawRecordKind kind, const void *data,
+                            size_t num_bytes, uint64_t system_clock) {
+  raw_record_header header;
+  header.time_ns = SteadyNow() - t0_;
+  header.system_clock = system_clock;
+  header.kind = kind;
+  header.num_bytes = num_bytes;
+
+  out_.write((const char *)&header, sizeof(header));
+  out_.write((const char *)data, num_bytes);
+  ++num_records_;
+
+  return out_.good();
+}
+
+bool RawStreamReader::Open(const std::string &path) {
+  Close();
+
+  in_.open(path.c_str(), std::ios::binary);
+  if (!in_.is_open()) return false;
+
+  in_.read((char *)&header_, sizeof(header_));
+
+  if (!in_.good() ||
+      memcmp(header_.magic, kRawStreamMagic, sizeof(header_.magic)) != 0) {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void RawStreamReader::Close() {
+  if (in_.is_open()) {
+    in_.close();
+  }
+}
+
+bool RawStreamReader::Next(RawRecord &record) {
+  if (!in_.is_open()) return false;
+
+  in_.read((char *)&record.header, sizeof(record.header));
+  if (in_.gcount() != sizeof(record.header)) return false;
+
+  record.payload.resize(record.header.num_bytes);
+  if (record.header.num_bytes == 0) return true;
+
+  in_.read(&record.payload[0], record.header.num_bytes);
+
+  // A record cut short by a crash ends the stream.
+  return in_.gcount() == record.header.num_bytes;
+}
+
+void RawStreamReader::Rewind() {
+  in_.clear();
+  in_.seekg(sizeof(raw_file_header), std::ios::beg);
+}
+
+}  // ::daq
@@ -0,0 +1,87 @@
+#include "readout_buffer.hh"
+
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace daq {
+
+namespace {
+
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t RoundUp(size_t bytes, size_t page) {
+  return (bytes + page - 1) / page * page;
+}
+
+}  // ::
+
+ReadoutMemory ReadReadoutMemory(const boost::property_tree::ptree &conf) {
+  ReadoutMemory memory;
+
+  auto node = conf.get_child_optional("readout_memory");
+  if (!node) return memory;
+
+  memory.hugepages = node->get<bool>("hugepages", memory.hugepages);
+  memory.mlock = node->get<bool>("mlock", memory.mlock);
+
+  return memory;
+}
+
+bool ReadoutBuffer::Allocate(size_t num_words, const ReadoutMemory &memory) {
+  Free();
+  memory_ = memory;
+  if (num_words == 0) return true;
+
+  size_t bytes = num_words * sizeof(uint);
+  void *ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if (memory.hugepages) {
+    bytes_ = RoundUp(bytes, kHugePageSize);
+    ptr = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    hugepages_ = (ptr != MAP_FAILED);
+  }
+#endif
+
+  if (ptr == MAP_FAILED) {
+    bytes_ = RoundUp(bytes, sysconf(_SC_PAGESIZE));
+    ptr = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ptr == MAP_FAILED) {
+      bytes_ = 0;
+      return false;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (memory.hugepages) madvise(ptr, bytes_, MADV_HUGEPAGE);
+#endif
+  }
+
+  data_ = (uint *)ptr;
+  size_ = num_words;
+
+  // Fault every page in now rather than during a transfer.
+  std::memset(data_, 0, bytes_);
+
+  if (memory.mlock) locked_ = (::mlock(data_, bytes_) == 0);
+
+  return true;
+}
+
+void ReadoutBuffer::Free() {
+  if (data_ == nullptr) return;
+
+  if (locked_) munlock(data_, bytes_);
+  munmap(data_, bytes_);
+
+  data_ = nullptr;
+  size_ = 0;
+  bytes_ = 0;
+  hugepages_ = false;
+  locked_ = false;
+}
+
+}  // ::daq
@@ -0,0 +1,133 @@
+#include "struck_decode.hh"
+
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DAQ_STRUCK_X86
+#include <immintrin.h>
+#endif
+
+namespace daq {
+
+namespace struck {
+
+namespace {
+
+// -1 until the first use picks a level.
+std::atomic<int> simd_level(-1);
+
+void Unpack12Scalar(const uint *words, int num_words, UShort_t *samples) {
+  for (int i = 0; i < num_words; ++i) {
+    samples[2 * i] = words[i] & 0xfff;
+    samples[2 * i + 1] = (words[i] >> 16) & 0xfff;
+  }
+}
+
+#ifdef DAQ_STRUCK_X86
+
+// Both samples sit in the low 12 bits of their half word, so masking the
+// words leaves them in place as 16-bit samples.
+__attribute__((target("sse2")))
+void Unpack12Sse2(const uint *words, int num_words, UShort_t *samples) {
+  const __m128i mask = _mm_set1_epi32(0x0fff0fff);
+  int i = 0;
+
+  for (; i + 4 <= num_words; i += 4) {
+    __m128i w = _mm_loadu_si128((const __m128i *)(words + i));
+    _mm_storeu_si128((__m128i *)(samples + 2 * i), _mm_and_si128(w, mask));
+  }
+
+  Unpack12Scalar(words + i, num_words - i, samples + 2 * i);
+}
+
+__attribute__((target("avx2")))
+void Unpack12Avx2(const uint *words, int num_words, UShort_t *samples) {
+  const __m256i mask = _mm256_set1_epi32(0x0fff0fff);
+  int i = 0;
+
+  for (; i + 8 <= num_words; i += 8) {
+    __m256i w = _mm256_loadu_si256((const __m256i *)(words + i));
+    _mm256_storeu_si256((__m256i *)(samples + 2 * i),
+                        _mm256_and_si256(w, mask));
+  }
+
+  Unpack12Scalar(words + i, num_words - i, samples + 2 * i);
+}
+
+#endif
+
+}  // ::
+
+SimdLevel DetectSimdLevel() {
+#ifdef DAQ_STRUCK_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return SimdLevel::kAvx2;
+  if (__builtin_cpu_supports("sse2")) return SimdLevel::kSse2;
+#endif
+
+  return SimdLevel::kScalar;
+}
+
+SimdLevel GetSimdLevel() {
+  int level = simd_level.load(std::memory_order_relaxed);
+
+  if (level < 0) {
+    level = (int)DetectSimdLevel();
+    simd_level.store(level, std::memory_order_relaxed);
+  }
+
+  return (SimdLevel)level;
+}
+
+void SetSimdLevel(SimdLevel level) {
+  // Never above what the cpu runs.
+  if ((int)level > (int)DetectSimdLevel()) level = DetectSimdLevel();
+
+  simd_level.store((int)level, std::memory_order_relaxed);
+}
+
+const char *SimdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kAvx2:
+      return "avx2";
+    case SimdLevel::kSse2:
+      return "sse2";
+    default:
+      return "scalar";
+  }
+}
+
+bool ParseSimdLevel(const std::string &name, SimdLevel &level) {
+  if (name == "scalar") {
+    level = SimdLevel::kScalar;
+  } else if (name == "sse2") {
+    level = SimdLevel::kSse2;
+  } else if (name == "avx2") {
+    level = SimdLevel::kAvx2;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+void Unpack12(const uint *words, int num_words, UShort_t *samples) {
+  switch (GetSimdLevel()) {
+#ifdef DAQ_STRUCK_X86
+    case SimdLevel::kAvx2:
+      Unpack12Avx2(words, num_words, samples);
+      break;
+
+    case SimdLevel::kSse2:
+      Unpack12Sse2(words, num_words, samples);
+      break;
+#endif
+
+    default:
+      Unpack12Scalar(words, num_words, samples);
+  }
+}
+
+}  // ::struck
+
+}  // ::daq
@@ -0,0 +1,94 @@
+#include "vme_backend.hh"
+#include "vme_sim.hh"
+#include "common.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "vme/sis3100_vme_calls.h"
+
+namespace daq {
+
+namespace {
+
+std::shared_ptr<VmeBackend> &CurrentBackend() {
+  static std::shared_ptr<VmeBackend> backend(new Sis3100Backend());
+  return backend;
+}
+
+}  // ::
+
+int VmeBackend::ReadBlockChain(int dev, VmeBlockMode mode, VmeBlock *blocks,
+                               int num_blocks) {
+  for (int i = 0; i < num_blocks; ++i) {
+    VmeBlock &block = blocks[i];
+    int rc = ReadBlock(dev, mode, block.addr, block.data, block.num_words,
+                       &block.num_got);
+
+    if (rc != 0) return rc;
+  }
+
+  return 0;
+}
+
+int Sis3100Backend::Open() { return open(daq::vme_path.c_str(), O_RDWR); }
+
+void Sis3100Backend::Close(int dev) { close(dev); }
+
+int Sis3100Backend::ReadD32(int dev, uint addr, uint *data) {
+  return vme_A32D32_read(dev, addr, data);
+}
+
+int Sis3100Backend::WriteD32(int dev, uint addr, uint data) {
+  return vme_A32D32_write(dev, addr, data);
+}
+
+int Sis3100Backend::ReadD16(int dev, uint addr, ushort *data) {
+  return vme_A32D16_read(dev, addr, data);
+}
+
+int Sis3100Backend::WriteD16(int dev, uint addr, ushort data) {
+  return vme_A32D16_write(dev, addr, data);
+}
+
+int Sis3100Backend::ReadBlock(int dev, VmeBlockMode mode, uint addr,
+                              uint *data, uint num_words, uint *num_got) {
+  switch (mode) {
+    case VmeBlockMode::k2eVme:
+      return vme_A32_2EVME_read(dev, addr, data, num_words, num_got);
+
+    case VmeBlockMode::k2eVmeFifo:
+      return vme_A32_2EVMEFIFO_read(dev, addr, data, num_words, num_got);
+
+    case VmeBlockMode::kDma32Fifo:
+      return vme_A32DMA_D32FIFO_read(dev, addr, data, num_words, num_got);
+
+    case VmeBlockMode::kMblt64:
+      return vme_A32MBLT64_read(dev, addr, data, num_words, num_got);
+
+    case VmeBlockMode::kMblt64Fifo:
+      return vme_A32MBLT64FIFO_read(dev, addr, data, num_words, num_got);
+  }
+
+  return -1;
+}
+
+VmeBackend &GetVmeBackend() { return *CurrentBackend(); }
+
+void SetVmeBackend(std::shared_ptr<VmeBackend> backend) {
+  CurrentBackend() = backend;
+}
+
+void LoadVmeBackend(const boost::property_tree::ptree &run_conf) {
+  std::string type = run_conf.get<std::string>("vme_backend.type", "sis3100");
+
+  if (type == "sim") {
+    auto crate = std::make_shared<SimCrate>();
+    crate->LoadConfig(run_conf);
+    SetVmeBackend(crate);
+
+  } else {
+    SetVmeBackend(std::make_shared<Sis3100Backend>());
+  }
+}
+
+}  // ::daq
@@ -0,0 +1,824 @@
+#include "vme_sim.hh"
+#include "config_cache.hh"
+
+#include <cmath>
+#include <random>
+#include <thread>
+#include <algorithm>
+
+namespace daq {
+
+namespace {
+
+// Struck 48-bit timestamps are split into 12-bit pieces over two words.
+void SisClockWords(unsigned long long clock, uint &w0, uint &w1) {
+  w1 = (clock & 0xfff) | (((clock >> 12) & 0xfff) << 16);
+  w0 = ((clock >> 24) & 0xfff) | (((clock >> 36) & 0xfff) << 16);
+}
+
+// Cheap repeatable spread for per-event values.
+inline uint Mix(unsigned long long trigger, uint ch) {
+  unsigned long long h = trigger * 0x9e3779b97f4a7c15ULL + ch * 0xbf58476dULL;
+  h ^= h >> 31;
+  return (uint)(h * 0x94d049bb133111ebULL >> 32);
+}
+
+}  // ::
+
+SimTraces::SimTraces(int length, int bits, double noise, unsigned seed)
+    : length_(length), pool_(kPoolSize) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> amp_dist(0.2, 0.6);
+  std::uniform_real_distribution<double> shift_dist(-2.0, 2.0);
+  std::normal_distribution<double> noise_dist(0.0, noise > 0 ? noise : 1e-9);
+
+  const double full_scale = (1 << bits) - 1;
+  const double baseline = 0.9 * full_scale;
+  const double sigma = std::max(2.0, length / 400.0);
+
+  // Negative going pulses a quarter of the way into the trace.
+  for (auto &trace : pool_) {
+    double amp = amp_dist(gen) * full_scale;
+    double center = length / 4.0 + shift_dist(gen);
+
+    trace.resize(length);
+    for (int i = 0; i < length; ++i) {
+      double x = (i - center) / sigma;
+      double v = baseline + noise_dist(gen);
+
+      if (std::fabs(x) < 8.0) {
+        v -= amp * std::exp(-0.5 * x * x);
+      }
+
+      v = std::min(std::max(v, 0.0), full_scale);
+      trace[i] = (ushort)v;
+    }
+  }
+}
+
+const ushort *SimTraces::trace(unsigned long long trigger, int ch) const {
+  return pool_[(trigger * 7 + ch * 3) % kPoolSize].data();
+}
+
+int SimBoard::Read(uint offset, uint &data) {
+  auto it = regs_.find(offset);
+  data = (it == regs_.end()) ? 0 : it->second;
+  return 0;
+}
+
+int SimBoard::Write(uint offset, uint data) {
+  regs_[offset] = data;
+  return 0;
+}
+
+int SimBoard::ReadBlock(uint, uint *, uint, uint &num_got) {
+  num_got = 0;
+  return SimCrate::kBusError;
+}
+
+int SimBoard::CopyEvent(const std::vector<uint> &header, const ushort *samples,
+                        int num_samples, uint *data, uint num_words,
+                        uint &num_got) {
+  uint total = header.size() + num_samples / 2;
+  uint n = std::min(num_words, total);
+  uint i = 0;
+
+  for (; i < n && i < header.size(); ++i) {
+    data[i] = header[i];
+  }
+
+  for (; i < n; ++i) {
+    const ushort *pair = samples + 2 * (i - header.size());
+    data[i] = pair[0] | ((uint)pair[1] << 16);
+  }
+
+  num_got = n;
+  return (n < num_words) ? SimCrate::kBusError : 0;
+}
+
+SimSis3316::SimSis3316(SimCrate &crate)
+    : SimBoard(crate, 0x1000000),
+      traces_(SIS_3316_LN, 14, crate.noise(), 3316),
+      armed_bank_(0),
+      arm_trigger_(0),
+      latched_bank_(0),
+      latched_trigger_(0),
+      channel_(0) {
+  regs_[0x4] = 0x33162008;  // MODID
+  regs_[0x1c] = 0x1;        // HARDWARE_VERSION
+  regs_[0x20] = 0xa0;       // INTERNAL_TEMPERATURE
+}
+
+int SimSis3316::Read(uint offset, uint &data) {
+  uint gr = offset >> 12;
+
+  if (offset == 0x60) {
+    // Memory threshold flag once the armed bank took a trigger.
+    SimBoard::Read(offset, data);
+    data &= ~(0x1 << 19);
+
+    if (armed_bank_ && (crate_.TriggerCount() > arm_trigger_)) {
+      data |= 0x1 << 19;
+    }
+
+    return 0;
+
+  } else if ((gr >= 1) && (gr <= 4) && ((offset & 0xff0) == 0x120)) {
+    // Previous bank sample address, flagged with the bank it describes.
+    data = 0;
+
+    if (latched_bank_) {
+      data = ((latched_bank_ == 2) << 24) | (3 + SIS_3316_LN / 2);
+    }
+
+    return 0;
+  }
+
+  return SimBoard::Read(offset, data);
+}
+
+int SimSis3316::Write(uint offset, uint data) {
+  if ((offset == 0x420) || (offset == 0x424)) {
+    // Disarm the active bank, keeping its event, and arm the other.
+    if (armed_bank_ && (crate_.TriggerCount() > arm_trigger_)) {
+      latched_bank_ = armed_bank_;
+      latched_trigger_ = arm_trigger_;
+    }
+
+    armed_bank_ = (offset == 0x420) ? 1 : 2;
+    arm_trigger_ = crate_.TriggerCount();
+    return 0;
+
+  } else if ((offset == 0x400) || (offset == 0x414)) {
+    armed_bank_ = 0;
+    return 0;
+
+  } else if ((offset >= 0x80) && (offset < 0x90)) {
+    // Readout FSM, selects the channel for the group's fifo.
+    if (data & 0x80000000) {
+      channel_ = 4 * ((offset - 0x80) / 4);
+      channel_ += (data >> 25) & 0x1;
+      channel_ += ((data >> 28) & 0x1) << 1;
+    }
+
+    return SimBoard::Write(offset, data);
+  }
+
+  // Busy flags of the i2c/spi interfaces clear immediately.
+  if (offset < 0x100) data &= 0x7fffffff;
+
+  // The oscillators acknowledge every i2c byte.
+  if ((offset >= 0x40) && (offset < 0x50)) data |= 0x1 << 8;
+
+  return SimBoard::Write(offset, data);
+}
+
+int SimSis3316::ReadBlock(uint offset, uint *data, uint num_words,
+                          uint &num_got) {
+  uint gr = offset / 0x100000;
+
+  if ((gr < 1) || (gr > 4) || (latched_bank_ == 0)) {
+    return SimBoard::ReadBlock(offset, data, num_words, num_got);
+  }
+
+  unsigned long long clock = crate_.ClockAt(latched_trigger_, 250.0e6);
+
+  std::vector<uint> header(3);
+  header[0] = (((clock >> 32) & 0xffff) << 16) | (channel_ << 4);
+  header[1] = clock & 0xffffffff;
+  header[2] = SIS_3316_LN / 2;
+
+  CopyEvent(header, traces_.trace(latched_trigger_, channel_), SIS_3316_LN,
+            data, num_words, num_got);
+
+  // Memory past the event reads back as zeros rather than a bus error.
+  std::fill(data + num_got, data + num_words, 0);
+  num_got = num_words;
+
+  return 0;
+}
+
+SimSis3302::SimSis3302(SimCrate &crate)
+    : SimBoard(crate, 0x8000000),
+      traces_(SIS_3302_LN, 16, crate.noise(), 3302),
+      armed_(false),
+      arm_trigger_(0),
+      latched_trigger_(0) {
+  regs_[0x4] = 0x33021205;  // MODID
+}
+
+int SimSis3302::Read(uint offset, uint &data) {
+  if (offset == 0x10) {
+    // Armed bit drops once a trigger has been sampled.
+    if (armed_ && (crate_.TriggerCount() > arm_trigger_)) {
+      armed_ = false;
+      latched_trigger_ = arm_trigger_;
+    }
+
+    SimBoard::Read(offset, data);
+    data = (data & ~0x10000) | (armed_ ? 0x10000 : 0);
+    return 0;
+
+  } else if ((offset == 0x10000) || (offset == 0x10001)) {
+    uint w0, w1;
+    SisClockWords(crate_.ClockAt(latched_trigger_, 100.0e6), w0, w1);
+    data = (offset == 0x10000) ? w0 : w1;
+    return 0;
+
+  } else if (((offset & 0x00fffff8) == 0x10) && ((offset >> 24) >= 0x2) &&
+             ((offset >> 24) <= 0x5)) {
+    // Next sample address, in samples.
+    data = SIS_3302_LN;
+    return 0;
+  }
+
+  return SimBoard::Read(offset, data);
+}
+
+int SimSis3302::Write(uint offset, uint data) {
+  if (offset == 0x410) {
+    armed_ = true;
+    arm_trigger_ = crate_.TriggerCount();
+    return 0;
+
+  } else if ((offset == 0x400) || (offset == 0x414)) {
+    armed_ = false;
+    return 0;
+  }
+
+  return SimBoard::Write(offset, data);
+}
+
+int SimSis3302::ReadBlock(uint offset, uint *data, uint num_words,
+                          uint &num_got) {
+  int ch = (int)(offset >> 23) - 0x8;
+
+  if ((ch < 0) || (ch >= SIS_3302_CH)) {
+    return SimBoard::ReadBlock(offset, data, num_words, num_got);
+  }
+
+  return CopyEvent(std::vector<uint>(), traces_.trace(latched_trigger_, ch),
+                   SIS_3302_LN, data, num_words, num_got);
+}
+
+SimSis3350::SimSis3350(SimCrate &crate)
+    : SimBoard(crate, 0x8000000),
+      traces_(SIS_3350_LN, 12, crate.noise(), 3350),
+      armed_(false),
+      arm_trigger_(0),
+      latched_trigger_(0),
+      num_events_(0) {
+  regs_[0x4] = 0x33501000;  // MODID
+  regs_[0x70] = 0xa0;       // temperature
+}
+
+uint SimSis3350::EventCount() {
+  if (!armed_) return num_events_;
+
+  unsigned long long triggers = crate_.TriggerCount() - arm_trigger_;
+  uint max_events = multi_event() ? std::max(regs_[0x20], 1u) : 1;
+
+  // Sampling stops once the last event fits.
+  if (triggers >= max_events) {
+    armed_ = false;
+    latched_trigger_ = arm_trigger_;
+    num_events_ = max_events;
+  }
+
+  return std::min<unsigned long long>(triggers, max_events);
+}
+
+int SimSis3350::Read(uint offset, uint &data) {
+  if (offset == 0x10) {
+    EventCount();
+
+    SimBoard::Read(offset, data);
+    data = (data & ~0x10000) | (armed_ ? 0x10000 : 0);
+    return 0;
+
+  } else if (offset == 0x24) {
+    // Multi event counter.
+    data = EventCount();
+    return 0;
+  }
+
+  return SimBoard::Read(offset, data);
+}
+
+int SimSis3350::Write(uint offset, uint data) {
+  if (offset == 0x410) {
+    armed_ = true;
+    arm_trigger_ = crate_.TriggerCount();
+    num_events_ = 0;
+    return 0;
+
+  } else if ((offset == 0x400) || (offset == 0x414)) {
+    // Events taken so far stay in memory.
+    num_events_ = EventCount();
+    latched_trigger_ = arm_trigger_;
+    armed_ = false;
+    return 0;
+  }
+
+  return SimBoard::Write(offset, data);
+}
+
+int SimSis3350::ReadBlock(uint offset, uint *data, uint num_words,
+                          uint &num_got) {
+  int ch = (int)(offset >> 24) - 0x4;
+
+  if ((ch < 0) || (ch >= SIS_3350_CH)) {
+    return SimBoard::ReadBlock(offset, data, num_words, num_got);
+  }
+
+  // Each event is two timestamp words and two more header words ahead of
+  // the samples.
+  const uint stride = SIS_3350_LN / 2 + 4;
+  uint word = (offset & 0xffffff) / 4;
+  std::vector<uint> header(4, 0);
+
+  num_got = 0;
+
+  while (num_got < num_words) {
+    uint event = word / stride;
+    uint pos = word % stride;
+
+    if (event >= std::max(num_events_, 1u)) return SimCrate::kBusError;
+
+    unsigned long long trigger = latched_trigger_ + event;
+    SisClockWords(crate_.ClockAt(trigger, 500.0e6), header[0], header[1]);
+
+    uint n = std::min(num_words - num_got, stride - pos);
+    uint got = 0;
+
+    if (pos == 0) {
+      CopyEvent(header, traces_.trace(trigger, ch), SIS_3350_LN,
+                data + num_got, n, got);
+
+    } else {
+      // Start mid event, copy it whole and keep the tail.
+      std::vector<uint> whole(stride);
+      CopyEvent(header, traces_.trace(trigger, ch), SIS_3350_LN, &whole[0],
+                stride, got);
+      std::copy(whole.begin() + pos, whole.begin() + pos + n, data + num_got);
+      got = n;
+    }
+
+    num_got += got;
+    word += got;
+  }
+
+  return 0;
+}
+
+SimCaen1785::SimCaen1785(SimCrate &crate)
+    : SimBoard(crate, 0x10000), consumed_(0), pos_(0) {
+  regs_[0x1000] = 0x0b05;  // firmware revision
+}
+
+int SimCaen1785::Pending() {
+  unsigned long long triggers = crate_.TriggerCount();
+
+  // Triggers beyond the buffer depth are lost.
+  if (triggers > consumed_ + kBufferDepth) {
+    consumed_ = triggers - kBufferDepth;
+    pos_ = 0;
+  }
+
+  return triggers - consumed_;
+}
+
+uint SimCaen1785::EventWord(uint idx) {
+  // Output buffer: header, high and low range words per channel, EOB.
+  static const uint order[CAEN_1785_CH] = {0, 4, 1, 5, 2, 6, 3, 7};
+
+  if (Pending() == 0 || idx >= kEventWords) {
+    return 0x06000000;  // not valid datum
+
+  } else if (idx == 0) {
+    return 0x02000000 | ((2 * CAEN_1785_CH) << 8);
+
+  } else if (idx == kEventWords - 1) {
+    return 0x04000000 | (consumed_ & 0xffffff);
+  }
+
+  uint ch = order[(idx - 1) / 2];
+  uint low = (idx - 1) % 2;
+  uint value = 300 + Mix(consumed_, ch) % 3000;
+
+  if (low) value /= 8;
+
+  return (ch << 18) | (low << 17) | (value & 0xfff);
+}
+
+int SimCaen1785::Read(uint offset, uint &data) {
+  if (offset == 0x100e) {
+    data = (Pending() > 0) ? 0x1 : 0x0;  // DREADY
+    return 0;
+
+  } else if (offset == 0x1022) {
+    data = (Pending() > 0) ? 0x0 : 0x2;  // buffer empty
+    return 0;
+
+  } else if (offset < 0x800) {
+    data = EventWord(offset / 4);
+    return 0;
+  }
+
+  return SimBoard::Read(offset, data);
+}
+
+int SimCaen1785::Write(uint offset, uint data) {
+  if (offset == 0x1028) {
+    // Done with the current event.
+    if (Pending() > 0) ++consumed_;
+    return 0;
+
+  } else if (((offset == 0x1032) && (data & 0x4)) || (offset == 0x1006)) {
+    // Clear data or reset.
+    consumed_ = crate_.TriggerCount();
+    pos_ = 0;
+  }
+
+  return SimBoard::Write(offset, data);
+}
+
+int SimCaen1785::ReadBlock(uint offset, uint *data, uint num_words,
+                           uint &num_got) {
+  if (offset >= 0x800) {
+    return SimBoard::ReadBlock(offset, data, num_words, num_got);
+  }
+
+  // Without BERR enabled the board pads with not valid data.
+  bool berr = regs_[0x1010] & 0x20;
+  num_got = 0;
+
+  while (num_got < num_words && Pending() > 0) {
+    data[num_got++] = EventWord(pos_++);
+
+    if (pos_ == kEventWords) {
+      ++consumed_;
+      pos_ = 0;
+    }
+  }
+
+  if (num_got < num_words && berr) return SimCrate::kBusError;
+
+  while (num_got < num_words) data[num_got++] = 0x06000000;
+  return 0;
+}
+
+SimCaen1742::SimCaen1742(SimCrate &crate)
+    : SimBoard(crate, 0x10000),
+      traces_(CAEN_1742_LN, 12, crate.noise(), 1742),
+      running_(false),
+      consumed_(0),
+      pos_(0) {
+  regs_[0xf034] = 0x0;  // board type
+  regs_[0xf080] = 0x1;  // serial number
+  regs_[0xf084] = 0x23;
+
+  for (int i = 0; i < 4; ++i) {
+    regs_[0xf040 + 4 * i] = i + 1;   // hardware revision
+    regs_[0x10a0 + 0x100 * i] = 40;  // DRS4 temperature
+  }
+}
+
+int SimCaen1742::Pending() {
+  if (!running_) return 0;
+
+  unsigned long long triggers = crate_.TriggerCount();
+
+  if (triggers > consumed_ + kBufferDepth) {
+    consumed_ = triggers - kBufferDepth;
+  }
+
+  return triggers - consumed_;
+}
+
+int SimCaen1742::Read(uint offset, uint &data) {
+  if (offset == 0x8104) {
+    // Ready, running and event ready flags.
+    data = 0x100 | (running_ ? 0x4 : 0x0) | ((Pending() > 0) ? 0x8 : 0x0);
+    return 0;
+
+  } else if (offset == 0x812c) {
+    data = Pending();
+    return 0;
+
+  } else if ((offset & 0xf0ff) == 0x1088) {
+    data = 0;  // group never busy
+    return 0;
+  }
+
+  return SimBoard::Read(offset, data);
+}
+
+int SimCaen1742::Write(uint offset, uint data) {
+  if (offset == 0x8100) {
+    bool run = data & 0x4;
+
+    if (run && !running_) {
+      consumed_ = crate_.TriggerCount();
+      event_.clear();
+    }
+
+    running_ = run;
+
+  } else if ((offset == 0xef24) || (offset == 0xef28)) {
+    // Reset or clear, drop everything buffered.
+    if (offset == 0xef24) running_ = false;
+
+    consumed_ = crate_.TriggerCount();
+    event_.clear();
+  }
+
+  return SimBoard::Write(offset, data);
+}
+
+int SimCaen1742::ReadBlock(uint offset, uint *data, uint num_words,
+                           uint &num_got) {
+  if (offset >= 0x1000) {
+    return SimBoard::ReadBlock(offset, data, num_words, num_got);
+  }
+
+  if (event_.empty()) {
+    if (Pending() == 0) {
+      num_got = 0;
+      return SimCrate::kBusError;
+    }
+
+    BuildEvent(consumed_++);
+    pos_ = 0;
+  }
+
+  uint n = std::min(num_words, (uint)event_.size() - pos_);
+  std::copy(event_.begin() + pos_, event_.begin() + pos_ + n, data);
+
+  pos_ += n;
+  num_got = n;
+
+  // The transfer past the end of the event is terminated with BERR.
+  if (n < num_words) {
+    event_.clear();
+    return SimCrate::kBusError;
+  }
+
+  return 0;
+}
+
+void SimCaen1742::BuildEvent(unsigned long long trigger) {
+  const int nch = CAEN_1742_CH / CAEN_1742_GR;
+  const uint data_size = 3 * CAEN_1742_LN;
+  const bool trg = regs_[0x8000] & 0x800;
+  const uint ttt = crate_.ClockAt(trigger, 200.0e6 / 1024) & 0x3fffffff;
+
+  event_.clear();
+  event_.push_back(0);                   // size, filled in below
+  event_.push_back(0xf);                 // group mask
+  event_.push_back(trigger & 0x3fffff);  // event counter
+  event_.push_back(ttt);
+
+  for (int gr = 0; gr < CAEN_1742_GR; ++gr) {
+    uint start_cell = (trigger * 37 + gr * 101) % 1024;
+    event_.push_back((start_cell << 20) | (trg ? 0x1000 : 0x0) | data_size);
+
+    const ushort *c[nch];
+    for (int j = 0; j < nch; ++j) {
+      c[j] = traces_.trace(trigger, gr * nch + j);
+    }
+
+    // Eight 12-bit samples, one per channel, in three words.
+    for (int i = 0; i < CAEN_1742_LN; ++i) {
+      event_.push_back(c[0][i] | (c[1][i] << 12) | ((c[2][i] & 0xff) << 24));
+      event_.push_back(((c[2][i] >> 8) & 0xf) | (c[3][i] << 4) |
+                       (c[4][i] << 16) | ((c[5][i] & 0xf) << 28));
+      event_.push_back(((c[5][i] >> 4) & 0xff) | (c[6][i] << 8) |
+                       (c[7][i] << 20));
+    }
+
+    if (trg) {
+      const ushort *t = traces_.trace(trigger, CAEN_1742_CH + gr);
+
+      for (int i = 0; i < CAEN_1742_LN; i += 8) {
+        event_.push_back(t[i] | (t[i + 1] << 12) | ((t[i + 2] & 0xff) << 24));
+        event_.push_back(((t[i + 2] >> 8) & 0xf) | (t[i + 3] << 4) |
+                         (t[i + 4] << 16) | ((t[i + 5] & 0xf) << 28));
+        event_.push_back(((t[i + 5] >> 4) & 0xff) | (t[i + 6] << 8) |
+                         (t[i + 7] << 20));
+      }
+    }
+
+    event_.push_back(ttt);
+  }
+
+  event_[0] = 0xa0000000 | event_.size();
+}
+
+SimCrate::SimCrate()
+    : CommonBase(std::string("SimCrate")),
+      t0_(std::chrono::steady_clock::now()),
+      trigger_rate_(100.0),
+      latency_us_(0.0),
+      open_latency_us_(0.0),
+      bandwidth_mbps_(0.0),
+      noise_(2.0) {}
+
+void SimCrate::LoadConfig(const boost::property_tree::ptree &run_conf) {
+  std::lock_guard<std::mutex> lock(crate_mutex_);
+
+  trigger_rate_ = run_conf.get<double>("vme_backend.trigger_rate", 100.0);
+  latency_us_ = run_conf.get<double>("vme_backend.latency_us", 0.0);
+  open_latency_us_ = run_conf.get<double>("vme_backend.open_latency_us", 0.0);
+  bandwidth_mbps_ = run_conf.get<double>("vme_backend.bandwidth_mbps", 0.0);
+  noise_ = run_conf.get<double>("vme_backend.noise", 2.0);
+
+  boards_.clear();
+
+  const boost::property_tree::ptree empty;
+  for (auto &type : run_conf.get_child("devices", empty)) {
+    for (auto &dev : type.second) {
+      std::string dev_conf = dev.second.data();
+
+      if (dev_conf.empty()) continue;
+      if (dev_conf[0] != '/') dev_conf = conf_dir + dev_conf;
+
+      // Only vme devices have a base address.
+      std::string base;
+      try {
+        base = ConfigCache::Instance().Load(dev_conf)->get<std::string>(
+            "base_address", "");
+      } catch (boost::property_tree::ptree_error &e) {
+        LogWarning("can't read %s: %s", dev_conf.c_str(), e.what());
+      }
+
+      if (!base.empty()) {
+        AddBoard(type.first, std::stoul(base, nullptr, 0));
+      }
+    }
+  }
+
+  t0_ = std::chrono::steady_clock::now();
+
+  LogMessage("simulating %i boards, %.1f Hz triggers", (int)boards_.size(),
+             trigger_rate_);
+}
+
+bool SimCrate::AddBoard(const std::string &type, uint base_address) {
+  std::unique_ptr<SimBoard> board;
+
+  if (type == "sis_3316") {
+    board.reset(new SimSis3316(*this));
+  } else if (type == "sis_3302") {
+    board.reset(new SimSis3302(*this));
+  } else if (type == "sis_3350") {
+    board.reset(new SimSis3350(*this));
+  } else if (type == "caen_1785") {
+    board.reset(new SimCaen1785(*this));
+  } else if (type == "caen_1742") {
+    board.reset(new SimCaen1742(*this));
+  } else {
+    LogWarning("no model for %s, 0x%08x left empty", type.c_str(),
+               base_address);
+    return false;
+  }
+
+  LogMessage("placed %s at 0x%08x", type.c_str(), base_address);
+  boards_[base_address] = std::move(board);
+  return true;
+}
+
+unsigned long long SimCrate::TriggerCount() {
+  using namespace std::chrono;
+  double dt = duration<double>(steady_clock::now() - t0_).count();
+  return (trigger_rate_ > 0) ? (unsigned long long)(dt * trigger_rate_) : 0;
+}
+
+unsigned long long SimCrate::ClockAt(unsigned long long trigger,
+                                     double clock_hz) {
+  if (trigger_rate_ <= 0) return 0;
+  return (unsigned long long)(trigger * (clock_hz / trigger_rate_));
+}
+
+int SimCrate::Open() {
+  Wait(open_latency_us_);
+  return 1;
+}
+
+void SimCrate::Close(int) {}
+
+int SimCrate::ReadD32(int, uint addr, uint *data) {
+  std::lock_guard<std::mutex> lock(crate_mutex_);
+  Wait(latency_us_);
+
+  uint offset;
+  SimBoard *board = FindBoard(addr, offset);
+  if (board == nullptr) return kBusError;
+
+  return board->Read(offset, *data);
+}
+
+int SimCrate::WriteD32(int, uint addr, uint data) {
+  std::lock_guard<std::mutex> lock(crate_mutex_);
+  Wait(latency_us_);
+
+  uint offset;
+  SimBoard *board = FindBoard(addr, offset);
+  if (board == nullptr) return kBusError;
+
+  return board->Write(offset, data);
+}
+
+int SimCrate::ReadD16(int dev, uint addr, ushort *data) {
+  uint word = 0;
+  int rc = ReadD32(dev, addr, &word);
+
+  *data = word & 0xffff;
+  return rc;
+}
+
+int SimCrate::WriteD16(int dev, uint addr, ushort data) {
+  return WriteD32(dev, addr, data);
+}
+
+int SimCrate::ReadBlock(int, VmeBlockMode, uint addr, uint *data,
+                        uint num_words, uint *num_got) {
+  std::lock_guard<std::mutex> lock(crate_mutex_);
+
+  uint offset;
+  SimBoard *board = FindBoard(addr, offset);
+
+  if (board == nullptr) {
+    Wait(latency_us_);
+    *num_got = 0;
+    return kBusError;
+  }
+
+  // Fifo and incrementing modes are modelled alike, boards decide what
+  // an address means.
+  int rc = board->ReadBlock(offset, data, num_words, *num_got);
+
+  double bytes = 4.0 * (*num_got);
+  Wait(latency_us_ + ((bandwidth_mbps_ > 0) ? bytes / bandwidth_mbps_ : 0.0));
+
+  return rc;
+}
+
+int SimCrate::ReadBlockChain(int, VmeBlockMode, VmeBlock *blocks,
+                             int num_blocks) {
+  std::lock_guard<std::mutex> lock(crate_mutex_);
+
+  double bytes = 0.0;
+  int rc = 0;
+
+  for (int i = 0; i < num_blocks && rc == 0; ++i) {
+    VmeBlock &block = blocks[i];
+
+    uint offset;
+    SimBoard *board = FindBoard(block.addr, offset);
+
+    if (board == nullptr) {
+      block.num_got = 0;
+      rc = kBusError;
+      break;
+    }
+
+    rc = board->ReadBlock(offset, block.data, block.num_words, block.num_got);
+    bytes += 4.0 * block.num_got;
+  }
+
+  Wait(latency_us_ + ((bandwidth_mbps_ > 0) ? bytes / bandwidth_mbps_ : 0.0));
+
+  return rc;
+}
+
+SimBoard *SimCrate::FindBoard(uint addr, uint &offset) {
+  auto it = boards_.upper_bound(addr);
+  if (it == boards_.begin()) return nullptr;
+
+  --it;
+  offset = addr - it->first;
+
+  if (offset >= it->second->window()) return nullptr;
+
+  return it->second.get();
+}
+
+void SimCrate::Wait(double us) {
+  using namespace std::chrono;
+  if (us <= 0.0) return;
+
+  auto until = steady_clock::now() +
+               duration_cast<steady_clock::duration>(
+                   duration<double, std::micro>(us));
+
+  // Sleep through long transfers, spin for the few microsecond ones.
+  if (us > 200.0) {
+    std::this_thread::sleep_until(until);
+  }
+
+  while (steady_clock::now() < until) {
+  }
+}
+
+}  // ::daq
@@ -1,9 +1,11 @@
 #include "worker_caen1742.hh"
+#include "worker_factory.hh"
 
 namespace daq {
 
 WorkerCaen1742::WorkerCaen1742(std::string name, std::string conf)
-    : WorkerVme<caen_1742>(name, conf) {
+    : WorkerVme<caen_1742>(name, conf), bundle_() {
+  drs_loaded_ = false;
   LoadConfig();
 }
 
@@ -20,8 +22,7 @@ WorkerCaen1742::~WorkerCaen1742() {
 
 void WorkerCaen1742::LoadConfig() {
   // Open the configuration file.
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
+  const boost::property_tree::ptree &conf = ReadConfig();
 
   int rc;
   uint msg = 0;
@@ -32,6 +33,10 @@ void WorkerCaen1742::LoadConfig() {
   drs_peak_corrections_ = conf.get<bool>("drs_peak_corrections", true);
   drs_time_corrections_ = conf.get<bool>("drs_time_corrections", true);
 
+  // Room for the largest event the board sends in one go.
+  read_trace_len_ = 0x10000;
+  AllocateReadoutBuffer(read_trace_len_, conf);
+
   // Get the base address for the device.  Convert from hex.
   tmp = conf.get<std::string>("base_address");
   base_address_ = std::stoul(tmp, nullptr, 0);
@@ -393,13 +398,8 @@ void WorkerCaen1742::WorkLoop() {
 
   while (thread_live_) {
     while (go_time_) {
-      static caen_1742 bundle;
-
-      if (EventAvailable() && GetEvent(bundle)) {
-        queue_mutex_.lock();
-        data_queue_.push(bundle);
-        has_event_ = true;
-        queue_mutex_.unlock();
+      if (!QueueBlocked() && EventAvailable() && GetEvent(bundle_)) {
+        QueueEvent(bundle_);
 
         LogDebug("read out new event");
 
@@ -442,8 +442,8 @@ caen_1742 WorkerCaen1742::PopEvent() {
     data = data_queue_.front();
     data_queue_.pop();
 
-    // Check if this is that last event.
-    if (data_queue_.size() == 0) has_event_ = false;
+    // Publish the new queue size.
+    UpdateQueueStatus();
 
     queue_mutex_.unlock();
     return data;
@@ -500,15 +500,15 @@ bool WorkerCaen1742::GetEvent(caen_1742 &bundle) {
   int ch, rc = 0;
   char *evtptr = nullptr;
   uint msg, d, size;
-  int sample;
-  std::vector<uint> startcells(4, 0);
+  uint startcells[CAEN_1742_GR] = {0};
+  long long t_start = MetricsNow();
 
-  static std::vector<uint> buffer;
-  // if (buffer.size() == 0) {
-  //  buffer.reserve((CAEN_1742_CH * CAEN_1742_LN * 4) / 3 + 32);
-  buffer.reserve(0x10000);
-  //}
-  std::fill(buffer.begin(), buffer.end(), 0);
+  uint *buffer = readout_buffer_.data();
+
+  if (buffer == nullptr) {
+    LogError("no readout buffer");
+    return false;
+  }
 
   // Get the system time
   auto t1 = high_resolution_clock::now();
@@ -532,15 +532,12 @@ bool WorkerCaen1742::GetEvent(caen_1742 &bundle) {
     ReadTraceDma32Fifo(0x0, &buffer[0]);
   */
 
-  read_trace_len_ = buffer.capacity();
-  LogDebug("begin readout of event length: %i", msg);
-  rc = ReadTraceMblt64SameBlock(0x0, &buffer[0]);
+  LogDebug("begin readout of event length: %u", read_trace_len_);
+  rc = ReadTraceMblt64SameBlock(0x0, buffer);
 
   // rc > 0: number of words read
   // rc < 0: -retval;
   if (rc < 0) {
-    std::fill(buffer.begin(), buffer.end(), 0);
-    buffer.resize(0);
     return false;
   }
 
@@ -562,110 +559,28 @@ bool WorkerCaen1742::GetEvent(caen_1742 &bundle) {
 
   // LogDebug("%i events in memory", msg);
 
-  // Figure out the group mask
-  bool grp_mask[CAEN_1742_GR];
-
-  for (int i = 0; i < CAEN_1742_GR; ++i) {
-    grp_mask[i] = buffer[1] & (0x1 << i);
-  }
-
-  // Now unpack the data for each group
-  uint header;
-  uint chdata[8];
-  int start_idx = 4;  // Skip main event header
-  int stop_idx = 4;
-
-  bundle.device_clock[0] = buffer[2];
-
-  LogDebug("beginning to unpack data");
   for (int grp_idx = 0; grp_idx < CAEN_1742_GR; ++grp_idx) {
-    // Skip if this group isn't present.
-    if (!grp_mask[grp_idx]) {
+    if (!(buffer[1] & (0x1 << grp_idx))) {
       LogWarning("Skipping group %i", grp_idx);
-      continue;
-    }
-
-    // Grab the group header info.
-    header = buffer[start_idx++];
-
-    // Check to make sure it is a header
-    if ((~header & 0xc00ce000) != 0xc00ce000) {
-      LogWarning("Missed header");
-    }
-
-    // Calculate the group size.
-    int data_size = header & 0xfff;
-    int nchannels = CAEN_1742_CH / CAEN_1742_GR;
-    bool trg_saved = header & (0x1 << 12);
-    startcells[grp_idx] = (header >> 20) & 0x3ff;
-
-    stop_idx = start_idx + data_size;
-    sample = 0;
-
-    LogDebug("start = %i, stop = %i, size = %u", start_idx, stop_idx,
-             data_size);
-    for (int i = start_idx; i < stop_idx; i += 3) {
-      uint ln0 = buffer[i];
-      uint ln1 = buffer[i + 1];
-      uint ln2 = buffer[i + 2];
-
-      chdata[0] = ln0 & 0xfff;
-      chdata[1] = (ln0 >> 12) & 0xfff;
-      chdata[2] = ((ln0 >> 24) & 0xff) | ((ln1 & 0xf) << 8);
-      chdata[3] = (ln1 >> 4) & 0xfff;
-      chdata[4] = (ln1 >> 16) & 0xfff;
-      chdata[5] = ((ln1 >> 28) & 0xf) | ((ln2 & 0xff) << 4);
-      chdata[6] = (ln2 >> 8) & 0xfff;
-      chdata[7] = (ln2 >> 20) & 0xfff;
-
-      for (int j = 0; j < 8; ++j) {
-        int ch_idx = j + grp_idx * nchannels;
-        bundle.trace[ch_idx][sample] = chdata[j];
-      }
-
-      ++sample;
     }
+  }
 
-    // Update our starting point.
-    start_idx = stop_idx;
-    sample = 0;
-
-    // Now grab the trigger if it was digitized.
-    if (trg_saved) {
-      LogDebug("Digitizing trigger");
-      stop_idx = start_idx + (data_size / 8);
-
-      for (int i = start_idx; i < stop_idx; i += 3) {
-        uint ln0 = buffer[i];
-        uint ln1 = buffer[i + 1];
-        uint ln2 = buffer[i + 2];
-
-        chdata[0] = ln0 & 0xfff;
-        chdata[1] = (ln0 >> 12) & 0xfff;
-        chdata[2] = ((ln0 >> 24) & 0xff) | ((ln1 & 0xf) << 8);
-        chdata[3] = (ln1 >> 4) & 0xfff;
-        chdata[4] = (ln1 >> 16) & 0xfff;
-        chdata[5] = ((ln1 >> 28) & 0xf) | ((ln2 & 0xff) << 4);
-        chdata[6] = (ln2 >> 8) & 0xfff;
-        chdata[7] = (ln2 >> 20) & 0xfff;
-
-        for (int j = 0; j < 8; ++j) {
-          bundle.trigger[grp_idx][sample++] = chdata[j];
-        }
-      }
-    }
+  long long t_read = MetricsNow();
+  readout_time_.Record(t_read - t_start);
 
-    // Grab the trigger time and increment starting index.
-    uint timestamp = buffer[stop_idx++];
-    LogDebug("timestamp: 0x%08x\n", timestamp);
+  RecordRaw(buffer, rc * sizeof(uint), bundle.system_clock);
 
-    start_idx = stop_idx;
+  LogDebug("beginning to unpack data");
+  if (DecodeCaen1742(buffer, rc, bundle, startcells) < 0) {
+    LogError("event overran the %i words read", rc);
+    return false;
   }
 
   if (true) {
     ApplyDataCorrection(bundle, startcells);
   }
 
+  decode_time_.Record(MetricsNow() - t_read);
   LogDebug("data readout complete");
 
   return true;
@@ -673,213 +588,43 @@ bool WorkerCaen1742::GetEvent(caen_1742 &bundle) {
 
 // This function does the caen corrections directly as they do.
 int WorkerCaen1742::ApplyDataCorrection(caen_1742 &data,
-                                        const std::vector<uint> &startcells) {
-  static bool correction_loaded = false;
-  static drs_correction table;
-
+                                        const uint startcells[CAEN_1742_GR]) {
   LogDebug("applying data correction");
 
-  if (!correction_loaded) {
-    GetCorrectionData(table);
-    correction_loaded = true;
-  }
-
-  if (drs_cell_corrections_) {
-    CellCorrection(data, table, startcells);
-  }
-
-  if (drs_peak_corrections_) {
-    PeakCorrection(data, table);
-  }
-
-  if (drs_time_corrections_) {
-    TimeCorrection(data, table, startcells);
-  }
-
-  return 0;
-}
-
-int WorkerCaen1742::CellCorrection(caen_1742 &data, const drs_correction &table,
-                                   const std::vector<uint> &startcells) {
-  LogDebug("running cell correction");
-
-  uint i, j, k;
-  short startcell;
-  uint nchannels = CAEN_1742_CH / CAEN_1742_GR;
-
-  for (i = 0; i < CAEN_1742_CH; ++i) {
-    startcell = startcells[i / nchannels];
-
-    for (j = 0; j < CAEN_1742_LN; ++j) {
-      data.trace[i][j] -= table.cell[i][(startcell + j) % 1024];
-      data.trace[i][j] -= table.nsample[i][j];
-    }
-  }
+  LoadDrsSetup();
+  Drs4ApplyCorrections(data, drs_, startcells);
 
   return 0;
 }
 
-// todo: make this human readable.
-int WorkerCaen1742::PeakCorrection(caen_1742 &data,
-                                   const drs_correction &table) {
-  LogDebug("running drs peak correction");
-  int offset;
-  uint i, j, k;
-  auto wf = data.trace;  // Shortened to clean up logic notation.
-
-  // Drop first sample automatically apparently.
-  for (i = 0; i < CAEN_1742_CH; ++i) wf[i][0] = wf[i][1];
-
-  // Now check the other waveform indexes.
-  for (i = 1; i < CAEN_1742_LN; ++i) {
-    for (j = 0; j < CAEN_1742_CH; ++j) {
-      // Reset if we are at the beginning of a new group.
-      if (j % (CAEN_1742_CH / CAEN_1742_GR) == 0) offset = 0;
-
-      LogDump("peak correction on cell[%i][%i]", j, i);
-
-      switch (i) {
-        case 1:
-          if (wf[j][i + 1] - wf[j][i] > peakthresh) offset++;
-          break;
-
-        case 2:
-          if ((wf[j][i + 1] - wf[j][i - 1] > peakthresh) &&
-              (wf[j][i + 1] - wf[j][i] > peakthresh))
-            offset++;
-          break;
-
-        case CAEN_1742_LN - 2:
-          if (wf[j][i - 1] - wf[j][i] > peakthresh) offset++;
-          break;
-
-        case CAEN_1742_LN - 1:
-          if (wf[j][i - 1] - wf[j][i] > peakthresh) offset++;
-          break;
-
-        default:
-          if ((wf[j][i - 1] - wf[j][i] > peakthresh) &&
-              ((wf[j][i + 1] - wf[j][i] > peakthresh) ||
-               (wf[j][i + 2] - wf[j][i] > peakthresh))) {
-            offset++;
-          }
-          break;
-      }
+void WorkerCaen1742::LoadDrsSetup() {
+  drs_.cell_corrections = drs_cell_corrections_;
+  drs_.peak_corrections = drs_peak_corrections_;
+  drs_.time_corrections = drs_time_corrections_;
+  drs_.peak_threshold = peakthresh;
 
-      if (offset == (CAEN_1742_CH / CAEN_1742_GR)) {
-        for (k = j - (CAEN_1742_CH / CAEN_1742_GR) + 1; k < j + 1; ++k) {
-          switch (i) {
-            case 1:
-              wf[k][0] = wf[k][2];
-              wf[k][1] = wf[k][2];
-              break;
-
-            case 2:
-              wf[k][0] = wf[k][3];
-              wf[k][1] = wf[k][3];
-              wf[k][2] = wf[k][3];
-              break;
-
-            case CAEN_1742_LN - 1:
-              wf[k][i] = wf[k][i - 1];
-              break;
-
-            case CAEN_1742_LN - 2:
-              wf[k][i] = wf[k][i - 1];
-              wf[k][i + 1] = wf[k][i - 1];
-              break;
-
-            default:
-              if (wf[k][i + 1] - wf[k][i] > peakthresh) {
-                wf[k][i] = 0.5 * (wf[k][i + 1] + wf[k][i - 1]);
-
-              } else if (wf[k][i + 2] - wf[k][i] > peakthresh) {
-                wf[k][i] = 0.5 * (wf[k][i + 2] + wf[k][i - 1]);
-                wf[k][i + 1] = wf[k][i];
-              }
-              break;
-          }
-        }  // k
-      }    // peak fix
-    }      // j
-  }        // i
+  if (drs_loaded_) return;
 
-  return 0;
-}
+  GetCorrectionData(drs_.table);
 
-int WorkerCaen1742::TimeCorrection(caen_1742 &data, const drs_correction &table,
-                                   const std::vector<uint> &startcells) {
-  LogDebug("performing drs time correction");
-  uint i, j, k, grp_idx;
-  float t0, t1, dv, dt, vcorr, vrem;
-  static float time[CAEN_1742_GR][CAEN_1742_LN];
-  static float wf[CAEN_1742_LN];
-  static float sample_time = 0.0;  // in ns
-  static bool initialized = false;
+  if (sampling_setting_ == 0x0) {
+    drs_.sample_time = 0.2;
 
-  // Set up time if first time.
-  if (!initialized) {
-    if (sampling_setting_ == 0x0) {
-      sample_time = 0.2;
+  } else if (sampling_setting_ == 0x1) {
+    drs_.sample_time = 0.4;
 
-    } else if (sampling_setting_ == 0x1) {
-      sample_time = 0.4;
-
-    } else {
-      sample_time = 1.0;
-    }
-
-    for (i = 0; i < CAEN_1742_GR; ++i) {
-      // Set a initial time reference
-      t0 = table.time[i][startcells[i] % CAEN_1742_LN];
-      time[i][0] = 0.0;
-
-      for (j = 1; j < CAEN_1742_LN; ++j) {
-        dt = table.time[i][(startcells[i] + j) % CAEN_1742_LN] - t0;
-
-        if (dt > 0) {
-          time[i][j] = time[i][j - 1] + dt;
-          LogDump("time[%i][%i] = %.4f", i, j, time[i][j]);
-
-        } else {
-          time[i][j] = time[i][j - 1] + dt + CAEN_1742_LN * sample_time;
-          LogDump("time[%i][%i] = %.4f", i, j, time[i][j]);
-        }
-
-        t0 = table.time[i][(startcells[i] + j) % CAEN_1742_LN];
-      }
-    }
-
-    initialized = true;
+  } else {
+    drs_.sample_time = 1.0;
   }
 
-  // Now do a linear interpolation to the correct time points.
-  for (i = 0; i < CAEN_1742_CH; ++i) {
-    grp_idx = i / (CAEN_1742_CH / CAEN_1742_GR);
-    vcorr = 0.0;
-    vrem = 0.0;
-    dv = 0.0;
-    k = 0;
-
-    wf[0] = data.trace[i][0];
-
-    for (j = 1; j < CAEN_1742_LN; ++j) {
-      // Find the next sample in time order.
-      while ((k < CAEN_1742_LN - 2) && (time[grp_idx][k + 1] < j * sample_time))
-        ++k;
-
-      dv = data.trace[i][k + 1] - data.trace[i][k];
-      dt = time[grp_idx][k + 1] - time[grp_idx][k];
-      vcorr = (float)dv / dt * (j * sample_time - time[grp_idx][k]);
-      LogDump("vcorr[%i][%i] = %.4f", i, j, vcorr);
-
-      wf[j] = data.trace[i][k] + vcorr;
-    }
+  // The time axis is set up from the first event.
+  drs_.has_time_axis = false;
+  drs_loaded_ = true;
+}
 
-    for (j = 0; j < CAEN_1742_LN; ++j) {
-      data.trace[i][j] = wf[j];
-    }
-  }
+void WorkerCaen1742::RecordRawSetup() {
+  LoadDrsSetup();
+  raw_out_->Write(kRawSetup, &drs_, sizeof(drs_), 0);
 }
 
 int WorkerCaen1742::GetChannelCorrectionData(uint ch, drs_correction &table) {
@@ -998,6 +743,8 @@ int WorkerCaen1742::GetChannelCorrectionData(uint ch, drs_correction &table) {
       pagenum++;
     }
   }
+
+  return 0;
 }
 
 int WorkerCaen1742::ReadFlashPage(uint32_t group, uint32_t pagenum,
@@ -1107,6 +854,8 @@ int WorkerCaen1742::GetCorrectionData(drs_correction &table) {
   for (uint ch = 0; ch < CAEN_1742_CH; ++ch) {
     GetChannelCorrectionData(ch, table);
   }
+
+  return 0;
 }
 
 int WorkerCaen1742::WriteCorrectionDataCsv() {
@@ -1161,6 +910,10 @@ int WorkerCaen1742::WriteCorrectionDataCsv() {
       }
     }  // time
   }    // i
+
+  return 0;
 }
 
+static WorkerRegistrar<WorkerCaen1742> caen1742_registrar("caen_1742");
+
 }  // ::daq
@@ -1,8 +1,14 @@
 #include "worker_caen1785.hh"
+#include "worker_factory.hh"
 
 namespace daq {
 
-WorkerCaen1785::WorkerCaen1785(std::string name, std::string conf) : WorkerVme<caen_1785>(name, conf)
+WorkerCaen1785::WorkerCaen1785(std::string name, std::string conf) :
+  WorkerVme<caen_1785>(name, conf),
+  num_carried_(0),
+  counter_started_(false),
+  event_index_(0),
+  events_lost_(Metrics::Instance().GetCounter(name + ".events_lost"))
 {
   LoadConfig();
 
@@ -13,11 +19,24 @@ WorkerCaen1785::WorkerCaen1785(std::string name, std::string conf) : WorkerVme<c
 void WorkerCaen1785::LoadConfig()
 { 
   // Open the configuration file.
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
+  const boost::property_tree::ptree &conf = ReadConfig();
 
   read_low_adc_ = conf.get<bool>("read_low_adc", false);
 
+  std::string readout = conf.get<std::string>("readout", "single");
+  block_readout_ = (readout != "single");
+
+  if (readout == "blt32") {
+    block_mode_ = VmeBlockMode::kDma32Fifo;
+
+  } else if (readout == "mblt64") {
+    block_mode_ = VmeBlockMode::kMblt64Fifo;
+
+  } else if (block_readout_) {
+    LogError("unknown readout %s, reading single words", readout.c_str());
+    block_readout_ = false;
+  }
+
   // Get the base address for the device.  Convert from hex.
   base_address_ = std::stoi(conf.get<std::string>("base_address"), nullptr, 0);
   
@@ -59,6 +78,22 @@ void WorkerCaen1785::LoadConfig()
   // Disable suppressors.
   //  Write16(0x1032, 0x18);
 
+  if (block_readout_) {
+    // Enable BERR, so a block read ends with the last buffered event.
+    rc = Write16(0x1010, 0x20);
+    if (rc != 0) {
+      LogError("failed to enable BERR in control register 1");
+    }
+
+    // Room for a whole output buffer behind an event carried over.
+    AllocateReadoutBuffer(2 * kOutputWords, conf);
+    num_carried_ = 0;
+
+  } else {
+    // Room for the one event read at a time.
+    AllocateReadoutBuffer(kOutputWords, conf);
+  }
+
   // Reset the data on the device.
   ClearData();
   LogMessage("CAEN 1785 data cleared");
@@ -73,17 +108,27 @@ void WorkerCaen1785::WorkLoop()
 
     while (go_time_) {
 
-      if (EventAvailable()) {
+      bool got_data = false;
+
+      if (!QueueBlocked()) {
+
+        if (block_readout_) {
+
+          got_data = (GetEvents() > 0);
 
-        static caen_1785 bundle;
-        GetEvent(bundle);
+        } else if (EventAvailable()) {
 
-        queue_mutex_.lock();
-        data_queue_.push(bundle);
-        has_event_ = true;
-        queue_mutex_.unlock();
+          caen_1785 bundle = caen_1785();
+          if (GetEvent(bundle)) {
+            SetEventIndex(bundle);
 
-      } else {
+            QueueEvent(bundle);
+            got_data = true;
+          }
+        }
+      }
+
+      if (!got_data) {
 
 	std::this_thread::yield();
 	usleep(daq::short_sleep);
@@ -112,8 +157,8 @@ caen_1785 WorkerCaen1785::PopEvent()
     data = data_queue_.front();
     data_queue_.pop();
     
-    // Check if this is that last event.
-    if (data_queue_.size() == 0) has_event_ = false;
+    // Publish the new queue size.
+    UpdateQueueStatus();
     
     queue_mutex_.unlock();
     return data;
@@ -124,9 +169,9 @@ caen_1785 WorkerCaen1785::PopEvent()
 bool WorkerCaen1785::EventAvailable()
 {
   // Check acq reg.
-  static ushort msg_16= 0;
-  static uint msg, rc;
-  static bool is_event;
+  ushort msg_16 = 0;
+  uint rc;
+  bool is_event;
 
   // Check if the device has data.
   rc = Read16(0x100E, msg_16);
@@ -142,26 +187,28 @@ bool WorkerCaen1785::EventAvailable()
     LogError("failed checking for empty buffer");
   }
 
-  is_event &= !(msg & 0x2);
+  is_event &= !(msg_16 & 0x2);
 
   return is_event;
 }
 
-void WorkerCaen1785::GetEvent(caen_1785 &bundle)
+bool WorkerCaen1785::GetEvent(caen_1785 &bundle)
 {
-  using namespace std::chrono;
-  int offset = 0x0;
-  uint rc = 0, ch = 0, data = 0;
-
-  // Get the system time
-  auto t1 = high_resolution_clock::now();
-  auto dtn = t1.time_since_epoch() - t0_.time_since_epoch();
-  bundle.system_clock = duration_cast<milliseconds>(dtn).count();
+  int offset = 0x0, num_words = 0;
+  uint rc = 0, data = 0, type = 0;
+  long long t_start = MetricsNow();
+  uint *words = readout_buffer_.data();
+
+  if (words == nullptr) {
+    LogError("no readout buffer");
+    return false;
+  }
 
-  // Read the data for each high value.
-  while ((((data >> 24) & 0x7) != 0x6) || (((data >> 24) &0x7) != 0x4)) {
+  bundle.system_clock = SystemClock();
 
-    if (offset >= 0x1000) break;
+  // Read the output buffer through the end of block, which holds the
+  // event counter.
+  while ((offset < 0x800) && (type != 0x4) && (type != 0x6)) {
 
     rc = Read(offset, data);
     if (rc != 0) {
@@ -169,37 +216,106 @@ void WorkerCaen1785::GetEvent(caen_1785 &bundle)
     }
 
     offset += 4;
+    words[num_words++] = data;
+    type = (data >> 24) & 0x7;
+  }
 
-    if (((data >> 24) & 0x7) == 0x0) {
-      
-      if (((data >> 17) & 0x1) && read_low_adc_) {
+  if (type == 0x4) {
+    // Increment event register.
+    rc = Write16(0x1028, 0x0);
+    if (rc != 0) {
+      LogError("failure incrementing event register");
+    }
+  }
 
-	// Skip high values.
-      	continue;
+  long long t_read = MetricsNow();
+  readout_time_.Record(t_read - t_start);
 
-      } else if (!((data >> 17) & 0x1) && !read_low_adc_) {
+  RecordRaw(words, num_words * sizeof(uint), bundle.system_clock);
 
-	// Skip low values.
-      	continue;
-      }
+  DecodeCaen1785(words, num_words, read_low_adc_, bundle);
+  decode_time_.Record(MetricsNow() - t_read);
 
-      bundle.device_clock[ch] = 0; // No device time
-      bundle.value[ch] = (data & 0xfff);
+  return true;
+}
 
-      if (ch == 7) {
-	// Increment event register and exit.
-	rc = Write16(0x1028, 0x0);
-        if (rc != 0) {
-          LogError("failure incrementing event register");
-        }
+int WorkerCaen1785::GetEvents()
+{
+  long long t_start = MetricsNow();
+  uint *block = readout_buffer_.data();
 
-	break;
-      }
+  if (block == nullptr) {
+    LogError("no readout buffer");
+    return 0;
+  }
 
-      // Device in order 0, 4, 1, 5, 2, 6, 3, 7.
-      ch = (ch > 3) * (ch - 3) + (ch < 4) * (ch + 4);
-    }
+  // Read behind any event the last block cut off.
+  read_trace_len_ = kOutputWords;
+  int rc = ReadTraceBerr(0x0, &block[num_carried_], block_mode_);
+  read_trace_len_ = 1;
+
+  if (rc <= 0) return 0;
+
+  long long t_read = MetricsNow();
+  readout_time_.Record(t_read - t_start);
+
+  int num_words = num_carried_ + rc;
+  int pos = 0, begin = 0, end = 0, num_events = 0;
+  ULong64_t system_clock = SystemClock();
+
+  while (Caen1785NextEvent(block, num_words, pos, begin, end)) {
+    caen_1785 bundle = caen_1785();
+    bundle.system_clock = system_clock;
+
+    RecordRaw(&block[begin], (end - begin) * sizeof(uint), system_clock);
+
+    DecodeCaen1785(&block[begin], end - begin, read_low_adc_, bundle);
+    SetEventIndex(bundle);
+
+    QueueEvent(bundle);
+    ++num_events;
+
+    long long t_decoded = MetricsNow();
+    decode_time_.Record(t_decoded - t_read);
+    t_read = t_decoded;
+  }
+
+  // The rest of an event cut off by the block comes with the next one.
+  num_carried_ = num_words - pos;
+  std::copy(block + pos, block + num_words, block);
+
+  return num_events;
+}
+
+ULong64_t WorkerCaen1785::SystemClock()
+{
+  using namespace std::chrono;
+  auto dtn = high_resolution_clock::now().time_since_epoch() -
+             t0_.time_since_epoch();
+
+  return duration_cast<milliseconds>(dtn).count();
+}
+
+void WorkerCaen1785::SetEventIndex(caen_1785 &bundle)
+{
+  uint counter = bundle.event_index & 0xffffff;
+
+  if (!counter_started_) {
+    counter_started_ = true;
+    event_index_ = counter;
+
+  } else {
+
+    // Steps of the counter since the last event, within one wrap.
+    ULong64_t step = (counter - event_index_) & 0xffffff;
+    if (step > 1) events_lost_.Add(step - 1);
+
+    event_index_ += step;
   }
+
+  bundle.event_index = event_index_;
 }
 
+static WorkerRegistrar<WorkerCaen1785> caen1785_registrar("caen_1785");
+
 } // ::daq
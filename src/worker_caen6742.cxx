@@ -1,9 +1,10 @@
 #include "worker_caen6742.hh"
+#include "worker_factory.hh"
 
 namespace daq {
 
 WorkerCaen6742::WorkerCaen6742(std::string name, std::string conf)
-    : WorkerBase<caen_6742>(name, conf) {
+    : WorkerBase<caen_6742>(name, conf), bundle_() {
   buffer_ = nullptr;
   event_ = nullptr;
 
@@ -27,8 +28,7 @@ WorkerCaen6742::~WorkerCaen6742() {
 
 void WorkerCaen6742::LoadConfig() {
   // Open the configuration file.
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
+  const boost::property_tree::ptree &conf = ReadConfig();
 
   int rc;
   uint msg = 0;
@@ -180,10 +180,16 @@ void WorkerCaen6742::LoadConfig() {
     LogError("failed to set acquisition mode to software controlled");
   }
 
-  // Set max events to 1 our purposes.
-  rc = CAEN_DGTZ_SetMaxNumEventsBLT(device_, 1);
+  // Read blocks of several events per USB round trip at high rates.
+  int blt_events = conf.get<int>("blt_events", 1);
+  if (blt_events < 1 || blt_events > 1023) {
+    LogWarning("blt_events %i is invalid, using 1", blt_events);
+    blt_events = 1;
+  }
+
+  rc = CAEN_DGTZ_SetMaxNumEventsBLT(device_, blt_events);
   if (rc != 0) {
-    LogError("failed to set max number of events to 1");
+    LogError("failed to set max number of events to %i", blt_events);
   }
 
   // Allocated the readout buffer.
@@ -211,14 +217,24 @@ void WorkerCaen6742::WorkLoop() {
 
   while (thread_live_) {
     while (go_time_) {
-      if (EventAvailable()) {
-        static caen_6742 bundle;
-        if (GetEvent(bundle)){	  
-	  queue_mutex_.lock();
-	  data_queue_.push(bundle);
-	  has_event_ = true;
-	  queue_mutex_.unlock();
-	}
+      if (!QueueBlocked() && EventAvailable()) {
+        caen_6742 &bundle = bundle_;
+        bool recorded = false;
+
+        for (uint i = 0; i < num_block_events_; ++i) {
+          long long t_read = MetricsNow();
+          if (GetEvent(bundle, i)) {
+            decode_time_.Record(MetricsNow() - t_read);
+
+            // The whole block once, decoding leaves it untouched.
+            if (!recorded) {
+              RecordRaw(buffer_, bsize_, bundle.system_clock);
+              recorded = true;
+            }
+
+            QueueEvent(bundle);
+          }
+        }
       } else {
         std::this_thread::yield();
         usleep(daq::short_sleep);
@@ -255,8 +271,8 @@ caen_6742 WorkerCaen6742::PopEvent() {
     data = data_queue_.front();
     data_queue_.pop();
 
-    // Check if this is that last event.
-    if (data_queue_.size() == 0) has_event_ = false;
+    // Publish the new queue size.
+    UpdateQueueStatus();
 
     queue_mutex_.unlock();
     return data;
@@ -265,7 +281,8 @@ caen_6742 WorkerCaen6742::PopEvent() {
 
 bool WorkerCaen6742::EventAvailable() {
   // Check acq reg.
-  uint num_events = 0, rc = 0;
+  uint rc = 0;
+  long long t_start = MetricsNow();
 
   rc = CAEN_DGTZ_ReadData(device_, CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT,
                           buffer_, &bsize_);
@@ -273,13 +290,15 @@ bool WorkerCaen6742::EventAvailable() {
     LogError("failed to readout data");
   }
 
-  rc = CAEN_DGTZ_GetNumEvents(device_, buffer_, bsize_, &num_events);
+  num_block_events_ = 0;
+  rc = CAEN_DGTZ_GetNumEvents(device_, buffer_, bsize_, &num_block_events_);
 
   if (rc != 0) {
     LogError("failed to read number of events in data buffer");
   }
 
-  if (num_events > 0) {
+  if (num_block_events_ > 0) {
+    readout_time_.Record(MetricsNow() - t_start);
     return true;
 
   } else {
@@ -287,7 +306,7 @@ bool WorkerCaen6742::EventAvailable() {
   }
 }
 
-bool WorkerCaen6742::GetEvent(caen_6742 &bundle) {
+bool WorkerCaen6742::GetEvent(caen_6742 &bundle, uint index) {
   using namespace std::chrono;
   int ch, rc = 0;
   char *evtptr = nullptr;
@@ -298,7 +317,7 @@ bool WorkerCaen6742::GetEvent(caen_6742 &bundle) {
   bundle.system_clock = duration_cast<milliseconds>(dtn).count();
 
   // Get the event data
-  rc = CAEN_DGTZ_GetEventInfo(device_, buffer_, bsize_, 0, &event_info_,
+  rc = CAEN_DGTZ_GetEventInfo(device_, buffer_, bsize_, index, &event_info_,
                               &evtptr);
   if (rc != 0) {
     LogError("failed to retrieve event info");
@@ -334,4 +353,20 @@ bool WorkerCaen6742::GetEvent(caen_6742 &bundle) {
   return true;
 }
 
+void WorkerCaen6742::SetBusyOutput(bool busy) {
+  uint msg = 0;
+
+  if (CAEN_DGTZ_ReadRegister(device_, busy_output_.reg, &msg)) {
+    LogError("failed to read busy output register 0x%x", busy_output_.reg);
+    return;
+  }
+
+  if (CAEN_DGTZ_WriteRegister(device_, busy_output_.reg,
+                              busy_output_.Apply(msg, busy))) {
+    LogError("failed to write busy output register 0x%x", busy_output_.reg);
+  }
+}
+
+static WorkerRegistrar<WorkerCaen6742> caen6742_registrar("caen_6742");
+
 }  // ::daq
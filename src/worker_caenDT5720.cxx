@@ -1,38 +1,25 @@
 #include "worker_caenDT5720.hh"
+#include "worker_factory.hh"
 
 namespace daq {
 
 WorkerCaenDT5720::WorkerCaenDT5720(std::string name, std::string conf)
-    : WorkerCaenUSBBase<caen_5720>(name, conf),
-      event_(nullptr),
-      event_ptr_(nullptr) {
+    : WorkerCaenUSBBase<caen_5720>(name, conf) {
   LoadConfig();
 }
 
 WorkerCaenDT5720::~WorkerCaenDT5720() {
-  // make absolutely sure worker thread is done before deallocating
-  thread_live_ = go_time_ = false;
-  if (work_thread_.joinable()) {
-    try {
-      work_thread_.join();
-    } catch (...) {
-      std::cout << name_ << ": thread had race condition joining." << std::endl;
-    }
-  }
+  // make absolutely sure both threads are done before deallocating
+  go_time_ = false;
+  StopThread();
 
-  // free dynamic memory
-  if (CAEN_DGTZ_FreeEvent(device_, (void**)&event_)) {
-    LogError("Failed to free event");
-  }
-  if (CAEN_DGTZ_FreeReadoutBuffer(&buffer_)) {
-    LogError("Failed to free readout buffer");
-  }
+  FreeBuffers();
 }
 
 void WorkerCaenDT5720::LoadConfig() {
-  CAEN_DGTZ_SetRecordLength(device_, CAEN_5720_LN);
+  WorkerCaenUSBBase<caen_5720>::LoadConfig();
 
-  CAEN_DGTZ_SetChannelEnableMask(device_, 0xf);
+  LoadChannelSetup(CAEN_5720_CH, CAEN_5720_LN);
 
   // disable self trigger
   if (CAEN_DGTZ_SetChannelSelfTrigger(device_, CAEN_DGTZ_TRGMODE_DISABLED,
@@ -86,46 +73,25 @@ void WorkerCaenDT5720::LoadConfig() {
     ++channel_num;
   }
 
-  // allocate event and buffer
-  if (CAEN_DGTZ_MallocReadoutBuffer(device_, &buffer_, &size_)) {
-    LogError("failed to allocate readout buffer.");
-  }
-  if (CAEN_DGTZ_AllocateEvent(device_, (void**)&event_)) {
-    LogError("failed to allocate event");
-  }
+  AllocateBuffers();
 }
 
-caen_5720 WorkerCaenDT5720::GetEvent() {
-  LogMessage("getting event!");
-
+caen_5720 WorkerCaenDT5720::GetEvent(const uint* event, int num_words) {
   caen_5720 bundle;
 
-  if (CAEN_DGTZ_GetEventInfo(device_, buffer_, bsize_, 0, &event_info_,
-                             &event_ptr_)) {
-    LogError("failed to get event info");
+  // Unpacked straight from the readout buffer, DecodeEvent would cost a
+  // library call and another copy of every sample.
+  if (DecodeCaenDT5720(event, num_words, bundle) < 0) {
+    LogError("couldn't decode event");
   }
 
-  LogMessage("event counter %i", event_info_.EventCounter);
-
-  if (CAEN_DGTZ_DecodeEvent(device_, event_ptr_, (void**)&event_)) {
-    LogError("could't decode event");
-  } else {
-    LogMessage("successfully decoded event.");
-  }
-
-  bundle.event_index = event_info_.EventCounter;
   auto t1 = std::chrono::high_resolution_clock::now();
   bundle.system_clock =
       std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0_).count();
 
-  for (uint32_t i = 0; i < CAEN_5720_CH; ++i) {
-    std::copy(event_->DataChannel[i], event_->DataChannel[i] + CAEN_5720_LN,
-              bundle.trace[i]);
-  }
-
-  LogMessage("event read out");
-
   return bundle;
 }
 
+static WorkerRegistrar<WorkerCaenDT5720> caen5720_registrar("caen_5720");
+
 }  //::daq
@@ -1,38 +1,25 @@
 #include "worker_caenDT5730.hh"
+#include "worker_factory.hh"
 
 namespace daq {
 
 WorkerCaenDT5730::WorkerCaenDT5730(std::string name, std::string conf)
-    : WorkerCaenUSBBase<caen_5730>(name, conf),
-      event_(nullptr),
-      event_ptr_(nullptr) {
+    : WorkerCaenUSBBase<caen_5730>(name, conf) {
   LoadConfig();
 }
 
 WorkerCaenDT5730::~WorkerCaenDT5730() {
-  // make absolutely sure worker thread is done before deallocating
-  thread_live_ = go_time_ = false;
-  if (work_thread_.joinable()) {
-    try {
-      work_thread_.join();
-    } catch (...) {
-      std::cout << name_ << ": thread had race condition joining." << std::endl;
-    }
-  }
+  // make absolutely sure both threads are done before deallocating
+  go_time_ = false;
+  StopThread();
 
-  // free dynamic memory
-  if (CAEN_DGTZ_FreeEvent(device_, (void**)&event_)) {
-    LogError("Failed to free event");
-  }
-  if (CAEN_DGTZ_FreeReadoutBuffer(&buffer_)) {
-    LogError("Failed to free readout buffer");
-  }
+  FreeBuffers();
 }
 
 void WorkerCaenDT5730::LoadConfig() {
-  CAEN_DGTZ_SetRecordLength(device_, CAEN_5730_LN);
+  WorkerCaenUSBBase<caen_5730>::LoadConfig();
 
-  CAEN_DGTZ_SetChannelEnableMask(device_, 0xff);
+  LoadChannelSetup(CAEN_5730_CH, CAEN_5730_LN);
 
   // disable self trigger
   if (CAEN_DGTZ_SetChannelSelfTrigger(device_, CAEN_DGTZ_TRGMODE_DISABLED,
@@ -50,6 +37,15 @@ void WorkerCaenDT5730::LoadConfig() {
   } else {
     regval &= ~1; //nim
   }
+
+  // The header's pattern bits can carry bits 47:32 of the time tag,
+  // which then wraps after days instead of seconds.
+  extended_time_tag_ = conf_.get<bool>("extended_time_tag", false);
+  regval &= ~(0x3 << 21);
+  if (extended_time_tag_) {
+    regval |= (0x2 << 21);
+  }
+  time_tag_.SetTag(extended_time_tag_ ? 48 : 31, time_tag_.tick_ns());
   if (CAEN_DGTZ_WriteRegister(device_, 0x811c, regval)){
     LogError("failed to write front panel register enabling ttl/nim");
   }
@@ -125,46 +121,25 @@ void WorkerCaenDT5730::LoadConfig() {
     ++channel_num;
   }
 
-  // allocate event and buffer
-  if (CAEN_DGTZ_MallocReadoutBuffer(device_, &buffer_, &size_)) {
-    LogError("failed to allocate readout buffer.");
-  }
-  if (CAEN_DGTZ_AllocateEvent(device_, (void**)&event_)) {
-    LogError("failed to allocate event");
-  }
+  AllocateBuffers();
 }
 
-caen_5730 WorkerCaenDT5730::GetEvent() {
-  LogMessage("getting event!");
-
+caen_5730 WorkerCaenDT5730::GetEvent(const uint* event, int num_words) {
   caen_5730 bundle;
 
-  if (CAEN_DGTZ_GetEventInfo(device_, buffer_, bsize_, 0, &event_info_,
-                             &event_ptr_)) {
-    LogError("failed to get event info");
+  // Unpacked straight from the readout buffer, DecodeEvent would cost a
+  // library call and another copy of every sample.
+  if (DecodeCaenDT5730(event, num_words, bundle) < 0) {
+    LogError("couldn't decode event");
   }
 
-  LogMessage("event counter %i", event_info_.EventCounter);
-
-  if (CAEN_DGTZ_DecodeEvent(device_, event_ptr_, (void**)&event_)) {
-    LogError("could't decode event");
-  } else {
-    LogMessage("successfully decoded event.");
-  }
-
-  bundle.event_index = event_info_.EventCounter;
   auto t1 = std::chrono::high_resolution_clock::now();
   bundle.system_clock =
       std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0_).count();
 
-  for (uint32_t i = 0; i < CAEN_5730_CH; ++i) {
-    std::copy(event_->DataChannel[i], event_->DataChannel[i] + CAEN_5730_LN,
-              bundle.trace[i]);
-  }
-
-  LogMessage("event read out");
-
   return bundle;
 }
 
+static WorkerRegistrar<WorkerCaenDT5730> caen5730_registrar("caen_5730");
+
 }  //::daq
@@ -0,0 +1,134 @@
+#include "worker_factory.hh"
+#include "worker_list.hh"
+#include "vme_backend.hh"
+
+#include <dlfcn.h>
+
+namespace daq {
+
+WorkerFactory &WorkerFactory::Instance() {
+  static WorkerFactory factory;
+  return factory;
+}
+
+bool WorkerFactory::Register(const std::string &type, creator create) {
+  std::lock_guard<std::mutex> lock(factory_mutex_);
+  return creators_.insert(std::make_pair(type, create)).second;
+}
+
+bool WorkerFactory::HasType(const std::string &type) {
+  std::lock_guard<std::mutex> lock(factory_mutex_);
+  return creators_.count(type) > 0;
+}
+
+std::vector<std::string> WorkerFactory::Types() {
+  std::lock_guard<std::mutex> lock(factory_mutex_);
+  std::vector<std::string> types;
+
+  for (auto &entry : creators_) {
+    types.push_back(entry.first);
+  }
+
+  return types;
+}
+
+WorkerInterface *WorkerFactory::Create(const std::string &type,
+                                       const std::string &name,
+                                       const std::string &conf_file) {
+  creator create;
+  {
+    std::lock_guard<std::mutex> lock(factory_mutex_);
+    auto it = creators_.find(type);
+
+    if (it == creators_.end()) {
+      LogError("no worker registered for device type %s", type.c_str());
+      return nullptr;
+    }
+
+    create = it->second;
+  }
+
+  LogMessage("creating %s worker %s", type.c_str(), name.c_str());
+  return create(name, conf_file);
+}
+
+bool WorkerFactory::LoadPlugin(const std::string &path) {
+  // Resolve everything now so a broken plugin fails at startup.
+  void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_GLOBAL);
+
+  if (handle == nullptr) {
+    LogError("failed to load worker plugin %s: %s", path.c_str(), dlerror());
+    return false;
+  }
+
+  // Plugins stay loaded for the life of the process, workers from them
+  // may outlive any single WorkerList.
+  std::lock_guard<std::mutex> lock(factory_mutex_);
+  plugins_.push_back(handle);
+
+  return true;
+}
+
+int WorkerFactory::AddWorkers(const std::string &conf_file,
+                              WorkerList &workers) {
+  auto run = ConfigCache::Instance().LoadRun(conf_file);
+  const boost::property_tree::ptree &conf = *run->tree;
+
+  const boost::property_tree::ptree empty;
+  for (auto &v : conf.get_child("worker_plugins", empty)) {
+    LoadPlugin(v.second.data());
+  }
+
+  // Pick the real crate or the simulated one before any board is touched.
+  LoadVmeBackend(conf);
+  SetRawStreamSettings(run->raw_stream);
+
+  // Replay swaps every device for the worker reading its raw stream.
+  std::string prefix;
+  if (run->raw_stream.mode == RawStreamMode::kReplay) {
+    prefix = "replay:";
+  }
+
+  int queued = 0;
+  for (auto &type : conf.get_child("devices", empty)) {
+    if (!HasType(prefix + type.first)) {
+      if (!type.second.empty()) {
+        LogWarning("skipping devices of unknown type %s%s", prefix.c_str(),
+                   type.first.c_str());
+      }
+      continue;
+    }
+
+    for (auto &dev : type.second) {
+      std::string dev_conf = dev.second.data();
+
+      if (!dev_conf.empty() && dev_conf[0] != '/') {
+        dev_conf = conf_dir + dev_conf;
+      }
+
+      // Devices are configured concurrently by InitWorkers below.
+      std::string dev_type = prefix + type.first;
+      std::string dev_name = dev.first;
+      QueueLimits limits = run->worker_queue;
+      workers.PushBackDeferred([this, dev_type, dev_name, dev_conf, limits]() {
+        WorkerInterface *worker = Create(dev_type, dev_name, dev_conf);
+        if (worker != nullptr) worker->SetQueueLimits(limits);
+        return worker;
+      });
+
+      ++queued;
+    }
+  }
+
+  int count = workers.InitWorkers(run->init_threads);
+
+  if (count < queued) {
+    LogWarning("only %i of %i workers from %s were created", count, queued,
+               conf_file.c_str());
+  }
+
+  LogMessage("added %i workers from %s", count, conf_file.c_str());
+  return count;
+}
+
+}  // ::daq
@@ -13,203 +13,188 @@ void WorkerList::StopRun() {
   StopThreads();
 }
 
-struct StartWorkersVis : public boost::static_visitor<> {
-  template <typename T>
-  void operator()(T workerptr) {
-    workerptr->StartWorker();
+bool WorkerList::PushBack(WorkerInterface *worker) {
+  if (workers_.size() >= WorkerStatus::kMaxWorkers) {
+    LogError("worker list is full, cannot add more than %i workers",
+             WorkerStatus::kMaxWorkers);
+    delete worker;
+    return false;
   }
-};
+
+  // Clear any state left by a previously freed worker in this slot.
+  int slot = workers_.size();
+  status_->num_events[slot] = 0;
+
+  worker->SetStatusSlot(status_.get(), slot);
+  workers_.push_back(worker);
+  return true;
+}
+
+int WorkerList::InitWorkers(int num_threads) {
+  if (pending_.size() == 0) return 0;
+
+  const int num_workers = pending_.size();
+  if ((num_threads <= 0) || (num_threads > num_workers)) {
+    num_threads = num_workers;
+  }
+
+  LogMessage("Initializing %i workers on %i threads", num_workers, num_threads);
+  auto t0 = std::chrono::high_resolution_clock::now();
+
+  std::vector<WorkerInterface *> created(num_workers, nullptr);
+  std::vector<std::exception_ptr> errors(num_workers);
+  std::atomic<int> next(0);
+
+  // Each thread takes the next unclaimed worker until none are left.
+  auto init_loop = [&]() {
+    int idx;
+    while ((idx = next++) < num_workers) {
+      try {
+        created[idx] = pending_[idx]();
+      } catch (...) {
+        errors[idx] = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (int i = 0; i < num_threads; ++i) {
+    pool.push_back(std::thread(init_loop));
+  }
+
+  // Single barrier, every device is configured past this point.
+  for (auto &thread : pool) {
+    thread.join();
+  }
+
+  pending_.clear();
+
+  int added = 0;
+  for (int i = 0; i < num_workers; ++i) {
+    if (created[i] != nullptr && PushBack(created[i])) {
+      ++added;
+    }
+  }
+
+  auto dt = std::chrono::high_resolution_clock::now() - t0;
+  int ms = std::chrono::duration_cast<std::chrono::milliseconds>(dt).count();
+  LogMessage("Initialized %i workers in %i ms", Size(), ms);
+
+  // Pass on the first construction failure now that all threads are done.
+  for (auto &error : errors) {
+    if (error) std::rethrow_exception(error);
+  }
+
+  return added;
+}
+
+int WorkerList::ReloadConfig() {
+  int count = 0;
+
+  for (auto &worker : workers_) {
+    if (worker->ReloadConfig()) ++count;
+  }
+
+  LogMessage("Reloaded %i of %i workers", count, Size());
+  return count;
+}
 
 void WorkerList::StartWorkers() {
   // Starts gathering data.
   LogMessage("Starting workers");
 
-  StartWorkersVis vis;
-  for (auto &workervar : workers_) {
-    boost::apply_visitor(vis, workervar);
+  for (auto &worker : workers_) {
+    worker->StartWorker();
   }
 }
 
-struct StartThreadsVis : public boost::static_visitor<> {
-  template <typename T>
-  void operator()(T workerptr) {
-    workerptr->StartThread();
-  }
-};
-
 void WorkerList::StartThreads() {
+  // Finish any deferred initialization before taking data.
+  InitWorkers();
+
   // Launches the data worker threads.
   LogMessage("Launching worker threads");
 
-  StartThreadsVis vis;
-  for (auto &workervar : workers_) {
-    boost::apply_visitor(vis, workervar);
+  for (auto &worker : workers_) {
+    worker->StartThread();
   }
 }
 
-struct StopWorkersVis : public boost::static_visitor<> {
-  template <typename T>
-  void operator()(T workerptr) {
-    workerptr->StopWorker();
-  }
-};
-
 void WorkerList::StopWorkers() {
   // Stop collecting data.
   LogMessage("Stopping workers");
 
-  StopWorkersVis vis;
-  for (auto &workervar : workers_) {
-    boost::apply_visitor(vis, workervar);
+  for (auto &worker : workers_) {
+    worker->StopWorker();
   }
 }
 
-struct StopThreadsVis : public boost::static_visitor<> {
-  template <typename T>
-  void operator()(T workerptr) {
-    workerptr->StopThread();
-  }
-};
-
 void WorkerList::StopThreads() {
   // Stop and rejoin worker threads.
   LogMessage("Stopping worker threads");
 
-  StopThreadsVis vis;
-  for (auto &workervar : workers_) {
-    boost::apply_visitor(vis, workervar);
+  for (auto &worker : workers_) {
+    worker->StopThread();
   }
 }
 
-struct HasEventVis : public boost::static_visitor<bool> {
-  template <typename T>
-  bool operator()(T workerptr) {
-    return workerptr->HasEvent();
+void WorkerList::GetEventCounts(int &min_events, int &max_events) {
+  const int size = workers_.size();
+  const std::atomic<int> *num_events = status_->num_events;
+
+  min_events = size > 0 ? std::numeric_limits<int>::max() : 0;
+  max_events = 0;
+
+  for (int i = 0; i < size; ++i) {
+    int n = num_events[i].load(std::memory_order_acquire);
+    min_events = n < min_events ? n : min_events;
+    max_events = n > max_events ? n : max_events;
   }
-};
+}
 
 bool WorkerList::AllWorkersHaveEvent() {
   // Check each worker for an event.
-  bool has_event = true;
+  int min_events, max_events;
+  GetEventCounts(min_events, max_events);
 
-  HasEventVis vis;
-  for (auto &workervar : workers_) {
-    has_event &= apply_visitor(vis, workervar);
-  }
-
-  return has_event;
+  return min_events > 0;
 }
 
 bool WorkerList::AnyWorkersHaveEvent() {
   // Check each worker for an event.
-  bool any_events = false;
+  int min_events, max_events;
+  GetEventCounts(min_events, max_events);
 
-  HasEventVis vis;
-  for (auto &workervar : workers_) {
-    any_events |= apply_visitor(vis, workervar);
-  }
-
-  return any_events;
+  return max_events > 0;
 }
 
-struct NumEventsVis : public boost::static_visitor<int> {
-  template <typename T>
-  int operator()(T workerptr) {
-    return workerptr->num_events();
-  }
-};
-
 bool WorkerList::AnyWorkersHaveMultiEvent() {
   // Check each worker for more than one event.
-  NumEventsVis vis;
-  for (auto &workervar : workers_) {
-    if (apply_visitor(vis, workervar) > 1) {
-      return true;
-    }
-  }
+  int min_events, max_events;
+  GetEventCounts(min_events, max_events);
 
-  return false;
+  return max_events > 1;
 }
 
-struct GetEventDataVis : public boost::static_visitor<> {
-  void operator()(WorkerBase<sis_3350> *workerptr) {
-    bundle->sis_3350_vec.push_back(workerptr->PopEvent());
-  }
-
-  void operator()(WorkerBase<sis_3302> *workerptr) {
-    bundle->sis_3302_vec.push_back(workerptr->PopEvent());
-  }
-
-  void operator()(WorkerBase<caen_1785> *workerptr) {
-    bundle->caen_1785_vec.push_back(workerptr->PopEvent());
-  }
-
-  void operator()(WorkerBase<caen_6742> *workerptr) {
-    bundle->caen_6742_vec.push_back(workerptr->PopEvent());
-  }
-
-  void operator()(WorkerBase<drs4> *workerptr) {
-    bundle->drs4_vec.push_back(workerptr->PopEvent());
-  }
-
-  void operator()(WorkerBase<caen_1742> *workerptr) {
-    bundle->caen_1742_vec.push_back(workerptr->PopEvent());
-  }
-
-  void operator()(WorkerBase<sis_3316> *workerptr) {
-    bundle->sis_3316_vec.push_back(workerptr->PopEvent());
-  }
-
-  void operator()(WorkerBase<caen_5720> *workerptr) {
-    bundle->caen_5720_vec.push_back(workerptr->PopEvent());
-  }
-
-  void operator()(WorkerBase<caen_5730> *workerptr) {
-    bundle->caen_5730_vec.push_back(workerptr->PopEvent());
-  }
-
-  event_data *bundle;
-};
-
 void WorkerList::GetEventData(event_data &bundle) {
-  GetEventDataVis vis;
-  vis.bundle = &bundle;
-
-  for (auto &workervar : workers_) {
-    boost::apply_visitor(vis, workervar);
+  for (auto &worker : workers_) {
+    worker->PopEventInto(bundle);
   }
 }
 
-struct FlushEventDataVis : public boost::static_visitor<> {
-  template <typename T>
-  void operator()(T workerptr) {
-    workerptr->FlushEvents();
-  }
-};
-
 void WorkerList::FlushEventData() {
   // Drops any stale events when workers should have no events.
-
-  FlushEventDataVis vis;
-  for (auto &workervar : workers_) {
-    boost::apply_visitor(vis, workervar);
+  for (auto &worker : workers_) {
+    worker->FlushEvents();
   }
 }
 
-struct FreeListVis : boost::static_visitor<> {
-  template <typename T>
-  void operator()(T workerptr) {
-    delete workerptr;
-  }
-};
-
 void WorkerList::FreeList() {
   // Delete the allocated workers.
   LogMessage("Freeing workers");
 
-  FreeListVis vis;
-  for (auto &workervar : workers_) {
-    boost::apply_visitor(vis, workervar);
+  for (auto &worker : workers_) {
+    delete worker;
   }
 
   Resize(0);
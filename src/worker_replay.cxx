@@ -0,0 +1,160 @@
+#include "worker_replay.hh"
+#include "worker_factory.hh"
+
+#include <cstring>
+
+namespace daq {
+
+bool RawDecoder<sis_3350>::Decode(const std::vector<char> &payload,
+                                  sis_3350 &bundle) {
+  typedef const uint trace_t[SIS_3350_LN / 2 + 4];
+  if (payload.size() != SIS_3350_CH * sizeof(trace_t)) return false;
+
+  DecodeSis3350((trace_t *)&payload[0], bundle);
+  return true;
+}
+
+bool RawDecoder<sis_3302>::Decode(const std::vector<char> &payload,
+                                  sis_3302 &bundle) {
+  typedef const uint trace_t[SIS_3302_LN / 2];
+  if (payload.size() != SIS_3302_CH * sizeof(trace_t) + 2 * sizeof(uint)) {
+    return false;
+  }
+
+  // The two timestamp words follow the traces.
+  const uint *timestamp = (const uint *)&payload[SIS_3302_CH * sizeof(trace_t)];
+
+  DecodeSis3302((trace_t *)&payload[0], timestamp, bundle);
+  return true;
+}
+
+bool RawDecoder<sis_3316>::Decode(const std::vector<char> &payload,
+                                  sis_3316 &bundle) {
+  typedef const uint trace_t[3 + SIS_3316_LN / 2];
+  if (payload.size() != SIS_3316_CH * sizeof(trace_t)) return false;
+
+  DecodeSis3316((trace_t *)&payload[0], bundle);
+  return true;
+}
+
+void RawDecoder<caen_1785>::Setup(const std::vector<char> &payload) {
+  uint32_t setup = 0;
+  if (payload.size() == sizeof(setup)) {
+    memcpy(&setup, &payload[0], sizeof(setup));
+  }
+
+  read_low_adc_ = setup;
+}
+
+bool RawDecoder<caen_1785>::Decode(const std::vector<char> &payload,
+                                   caen_1785 &bundle) {
+  if (payload.size() % sizeof(uint) != 0) return false;
+
+  DecodeCaen1785((const uint *)payload.data(), payload.size() / sizeof(uint),
+                 read_low_adc_, bundle);
+  return true;
+}
+
+void RawDecoder<caen_1742>::Setup(const std::vector<char> &payload) {
+  has_setup_ = (payload.size() == sizeof(drs_));
+
+  if (has_setup_) {
+    memcpy(&drs_, &payload[0], sizeof(drs_));
+  }
+}
+
+bool RawDecoder<caen_1742>::Decode(const std::vector<char> &payload,
+                                   caen_1742 &bundle) {
+  uint startcells[CAEN_1742_GR] = {0};
+  int num_words = payload.size() / sizeof(uint);
+
+  // Without the calibration the corrections can't be redone.
+  if (!has_setup_) return false;
+
+  if (DecodeCaen1742((const uint *)payload.data(), num_words, bundle,
+                     startcells) < 0) {
+    return false;
+  }
+
+  Drs4ApplyCorrections(bundle, drs_, startcells);
+  return true;
+}
+
+// The tag width the worker recorded, 31 bits if there is none.
+static int CaenUSBTagBits(const std::vector<char> &payload) {
+  uint32_t bits = 31;
+  if (payload.size() == sizeof(bits)) {
+    memcpy(&bits, &payload[0], sizeof(bits));
+  }
+
+  return (bits == 48) ? 48 : 31;
+}
+
+// The event's time tag, with bits 47:32 from the header's pattern bits
+// when the tag was extended.
+static uint64_t CaenUSBTimeTag(const std::vector<char> &payload,
+                               uint64_t tag, bool extended) {
+  if (extended && payload.size() >= 2 * sizeof(uint)) {
+    const uint *event = (const uint *)payload.data();
+    tag |= (uint64_t)((event[1] >> 8) & 0xffff) << 32;
+  }
+
+  return tag;
+}
+
+void RawDecoder<caen_5720>::Setup(const std::vector<char> &payload) {
+  int bits = CaenUSBTagBits(payload);
+  time_tag_.SetTag(bits, time_tag_.tick_ns());
+  extended_time_tag_ = (bits > 31);
+}
+
+bool RawDecoder<caen_5720>::Decode(const std::vector<char> &payload,
+                                   caen_5720 &bundle) {
+  if (DecodeCaenDT5720((const uint *)payload.data(),
+                       payload.size() / sizeof(uint), bundle) < 0) {
+    return false;
+  }
+
+  uint64_t tag = CaenUSBTimeTag(payload, bundle.device_clock,
+                                extended_time_tag_);
+  bundle.device_clock = time_tag_.Extend(tag, 0);
+  bundle.host_clock = 0;
+  return true;
+}
+
+void RawDecoder<caen_5730>::Setup(const std::vector<char> &payload) {
+  int bits = CaenUSBTagBits(payload);
+  time_tag_.SetTag(bits, time_tag_.tick_ns());
+  extended_time_tag_ = (bits > 31);
+}
+
+bool RawDecoder<caen_5730>::Decode(const std::vector<char> &payload,
+                                   caen_5730 &bundle) {
+  if (DecodeCaenDT5730((const uint *)payload.data(),
+                       payload.size() / sizeof(uint), bundle) < 0) {
+    return false;
+  }
+
+  uint64_t tag = CaenUSBTimeTag(payload, bundle.device_clock,
+                                extended_time_tag_);
+  bundle.device_clock = time_tag_.Extend(tag, 0);
+  bundle.host_clock = 0;
+  return true;
+}
+
+static WorkerRegistrar<WorkerReplay<sis_3350>> replay3350_registrar(
+    "replay:sis_3350");
+static WorkerRegistrar<WorkerReplay<sis_3302>> replay3302_registrar(
+    "replay:sis_3302");
+static WorkerRegistrar<WorkerReplay<sis_3316>> replay3316_registrar(
+    "replay:sis_3316");
+static WorkerRegistrar<WorkerReplay<caen_1785>> replay1785_registrar(
+    "replay:caen_1785");
+static WorkerRegistrar<WorkerReplay<caen_1742>> replay1742_registrar(
+    "replay:caen_1742");
+static WorkerRegistrar<WorkerReplay<caen_5720>> replay5720_registrar(
+    "replay:caen_5720");
+static WorkerRegistrar<WorkerReplay<caen_5730>> replay5730_registrar(
+    "replay:caen_5730");
+
+}  // ::daq
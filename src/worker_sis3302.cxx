@@ -1,4 +1,5 @@
 #include "worker_sis3302.hh"
+#include "worker_factory.hh"
 
 namespace daq {
 
@@ -6,6 +7,7 @@ WorkerSis3302::WorkerSis3302(std::string name, std::string conf) :
   WorkerVme<sis_3302>(name, conf)
 {
   LogMessage("worker created");
+  std::fill(trace_words_, trace_words_ + SIS_3302_CH, 0);
   LoadConfig();
 
   num_ch_ = SIS_3302_CH;
@@ -23,12 +25,19 @@ void WorkerSis3302::LoadConfig()
   LogMessage("configuring device with file: %s", conf_file_.c_str());
 
   // Open the configuration file.
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
+  const boost::property_tree::ptree &conf = ReadConfig();
   
   // Get the base address for the device.  Convert from hex.
   base_address_ = std::stoul(conf.get<string>("base_address"), nullptr, 0);
 
+  channel_mask_ = std::stoul(conf.get<string>("channel_mask", "0xff"),
+                             nullptr, 0);
+  channel_mask_ &= (1 << SIS_3302_CH) - 1;
+
+  // The traces are read into the event itself, so it is what gets mapped.
+  AllocateReadoutBuffer((sizeof(sis_3302) + sizeof(uint) - 1) / sizeof(uint),
+                        conf);
+
   // Read the base register.
   rc = Read(CONTROL_STATUS, msg);
   if (rc != 0) {
@@ -248,10 +257,18 @@ void WorkerSis3302::LoadConfig()
 
 void WorkerSis3302::WorkLoop()
 {
+  // Traces are read straight into the bundle, which keeps what the last
+  // event left past this one's length, so it is the same every time.
+  if (readout_buffer_.data() == nullptr) {
+    LogError("no readout buffer");
+    return;
+  }
+
+  sis_3302 &bundle = *(sis_3302 *)readout_buffer_.data();
+
   // Dump first event (they are corrupted).
   if (EventAvailable()) {
-    sis_3302 tmp;
-    GetEvent(tmp);
+    GetEvent(bundle);
   }
 
   t0_ = std::chrono::high_resolution_clock::now();
@@ -260,15 +277,11 @@ void WorkerSis3302::WorkLoop()
 
     while (go_time_) {
 
-      if (EventAvailable()) {
+      if (!QueueBlocked() && EventAvailable()) {
 
-        static sis_3302 bundle;
         GetEvent(bundle);
 
-        queue_mutex_.lock();
-        data_queue_.push(bundle);
-        has_event_ = true;
-        queue_mutex_.unlock();
+        QueueEvent(bundle);
 
       } else {
 
@@ -299,8 +312,8 @@ sis_3302 WorkerSis3302::PopEvent()
   data = data_queue_.front();
   data_queue_.pop();
 
-  // Check if this is that last event.
-  if (data_queue_.size() == 0) has_event_ = false;
+  // Publish the new queue size.
+  UpdateQueueStatus();
 
   queue_mutex_.unlock();
   return data;
@@ -310,9 +323,9 @@ sis_3302 WorkerSis3302::PopEvent()
 bool WorkerSis3302::EventAvailable()
 {
   // Check acq reg.
-  static uint msg = 0;
-  static bool is_event;
-  static int count, rc;
+  uint msg = 0;
+  bool is_event;
+  int count, rc;
 
   count = 0;
   rc = 0;
@@ -353,17 +366,19 @@ void WorkerSis3302::GetEvent(sis_3302 &bundle)
 {
   using namespace std::chrono;
   int ch, offset, rc, count = 0;
+  long long t_start = MetricsNow();
 
-  // Check how long the event is.
-  //expected SIS_3302_LN + 8
-  
-  uint next_sample_address[SIS_3302_CH];
-  static uint trace[SIS_3302_CH][SIS_3302_LN / 2];
-  static uint timestamp[2];
+  uint timestamp[2] = {0, 0};
+
+  uint next_sample_address;
+  VmeBlock blocks[SIS_3302_CH];
+  int num_blocks = 0;
 
   for (ch = 0; ch < SIS_3302_CH; ch++) {
 
-    next_sample_address[ch] = 0;
+    if (!(channel_mask_ & (0x1 << ch))) continue;
+
+    next_sample_address = 0;
 
     offset = 0x02000010;
     offset |= (ch >> 1) << 24;
@@ -372,9 +387,17 @@ void WorkerSis3302::GetEvent(sis_3302 &bundle)
     count = 0;
     rc = 0;
     do {
-      rc = Read(offset, next_sample_address[ch]);
+      rc = Read(offset, next_sample_address);
       ++count;
     } while ((rc < 0) && (count < 100));
+
+    // The address counts the samples taken, two to a word.
+    VmeBlock &block = blocks[num_blocks++];
+    block.addr = (0x8 + ch) << 23;
+    block.data = (uint *)bundle.trace[ch];
+    block.num_words = std::min((next_sample_address + 1) / 2,
+                               (uint)SIS_3302_LN / 2);
+    block.num_got = 0;
   }
 
   // Get the system time
@@ -393,33 +416,52 @@ void WorkerSis3302::GetEvent(sis_3302 &bundle)
     LogError("failed to read second byte of the device timestamp");
   }
 
-  for (ch = 0; ch < SIS_3302_CH; ch++) {
+  // All enabled channels in one chain, each only as long as it was filled.
+  count = 0;
+  do {
 
-    offset = (0x8 + ch) << 23;
-    count = 0;
+    rc = ReadTraceChain(blocks, num_blocks, VmeBlockMode::k2eVme);
+    if (rc != 0) {
+      LogError("failed reading traces");
+    }
+  } while ((rc < 0) && (count++ < kMaxPoll));
 
-    do {
+  long long t_read = MetricsNow();
+  readout_time_.Record(t_read - t_start);
 
-      rc = ReadTrace(offset, trace[ch]);
-      if (rc != 0) {
-        LogError("failed reading trace for channel %i", ch);
-      }
-    } while ((rc < 0) && (count++ < kMaxPoll));
+  // The samples are in place, clear whatever an earlier, longer event
+  // left past this one and set the timestamps.
+  uint num_words[SIS_3302_CH] = {0};
+  for (int i = 0; i < num_blocks; ++i) {
+    num_words[(blocks[i].addr >> 23) - 0x8] = blocks[i].num_got;
   }
 
-  //decode the event (little endian arch)
+  ULong64_t clock = struck::Timestamp12(timestamp[0], timestamp[1]);
+
   for (ch = 0; ch < SIS_3302_CH; ch++) {
+    if (num_words[ch] < trace_words_[ch]) {
+      std::fill(bundle.trace[ch] + 2 * num_words[ch],
+                bundle.trace[ch] + 2 * trace_words_[ch], 0);
+    }
+
+    trace_words_[ch] = num_words[ch];
+    bundle.device_clock[ch] = clock;
+  }
 
-    bundle.device_clock[ch] = 0;
-    bundle.device_clock[ch] = timestamp[1] & 0xfff;
-    bundle.device_clock[ch] |= (timestamp[1] & 0xfff0000) >> 4;
-    bundle.device_clock[ch] |= (timestamp[0] & 0xfffULL) << 24;
-    bundle.device_clock[ch] |= (timestamp[0] & 0xfff0000ULL) << 20;
+  if (raw_out_) {
+    // Recorded as the traces followed by the two timestamp words.
+    std::vector<uint> &raw = raw_record_;
+    raw.resize(SIS_3302_CH * SIS_3302_LN / 2 + 2);
+    std::memcpy(&raw[0], bundle.trace, sizeof(bundle.trace));
+    raw[raw.size() - 2] = timestamp[0];
+    raw[raw.size() - 1] = timestamp[1];
 
-    std::copy((ushort *)trace[ch],
-    	      (ushort *)trace[ch] + SIS_3302_LN,
-    	      bundle.trace[ch]);
+    RecordRaw(&raw[0], raw.size() * sizeof(uint), bundle.system_clock);
   }
+
+  decode_time_.Record(MetricsNow() - t_read);
 }
 
+static WorkerRegistrar<WorkerSis3302> sis3302_registrar("sis_3302");
+
 } // ::daq
@@ -1,9 +1,10 @@
 #include "worker_sis3316.hh"
+#include "worker_factory.hh"
 
 namespace daq {
 
 WorkerSis3316::WorkerSis3316(std::string name, std::string conf) : 
-  WorkerVme<sis_3316>(name, conf)
+  WorkerVme<sis_3316>(name, conf), bundle_()
 {
   LoadConfig();
 
@@ -21,11 +22,14 @@ void WorkerSis3316::LoadConfig()
   uint msg = 0, addr = 0;
   
   // Open the configuration file.
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
+  const boost::property_tree::ptree &conf = ReadConfig();
   
   // Get the base address for the device.  Convert from hex.
   base_address_ = std::stoul(conf.get<string>("base_address"), nullptr, 0);
+
+  // Rows are odd in length but reads even, so the last channel's read
+  // runs one word past the end.
+  AllocateReadoutBuffer(SIS_3316_CH * (3 + SIS_3316_LN / 2) + 1, conf);
   
   // Read the base register.
   rc = Read(CONTROL_STATUS, msg);
@@ -610,15 +614,11 @@ void WorkerSis3316::WorkLoop()
 
     while (go_time_) {
 
-      if (EventAvailable()) {
+      if (!QueueBlocked() && EventAvailable()) {
 
-        static sis_3316 bundle;
-        GetEvent(bundle);
+        GetEvent(bundle_);
 
-        queue_mutex_.lock();
-        data_queue_.push(bundle);
-        has_event_ = true;
-        queue_mutex_.unlock();
+        QueueEvent(bundle_);
 
       } else {
 
@@ -649,8 +649,8 @@ sis_3316 WorkerSis3316::PopEvent()
   data = data_queue_.front();
   data_queue_.pop();
 
-  // Check if this is that last event.
-  if (data_queue_.size() == 0) has_event_ = false;
+  // Publish the new queue size.
+  UpdateQueueStatus();
 
   queue_mutex_.unlock();
   return data;
@@ -660,9 +660,9 @@ sis_3316 WorkerSis3316::PopEvent()
 bool WorkerSis3316::EventAvailable()
 {
   // Check acq reg.
-  static bool is_event;
-  static int count, rc;
-  static uint msg;
+  bool is_event;
+  int count, rc;
+  uint msg;
 
   count = 0;
   msg = 0;
@@ -715,10 +715,17 @@ void WorkerSis3316::GetEvent(sis_3316 &bundle)
   using namespace std::chrono;
   int ch, rc, count = 0;
   uint trace_addr, addr, offset, msg;
+  long long t_start = MetricsNow();
 
   // Check how long the event is.
   uint next_sample_address[SIS_3316_CH];
-  static uint data[SIS_3316_CH][3 + SIS_3316_LN / 2];
+  typedef uint channel_data[3 + SIS_3316_LN / 2];
+  channel_data *data = (channel_data *)readout_buffer_.data();
+
+  if (data == nullptr) {
+    LogError("no readout buffer");
+    return;
+  }
 
   // Get the system time.
   auto t1 = high_resolution_clock::now();
@@ -800,18 +807,13 @@ void WorkerSis3316::GetEvent(sis_3316 &bundle)
     }
   }
 
-  //decode the event (little endian arch)
-  for (ch = 0; ch < SIS_3316_CH; ch++) {
+  long long t_read = MetricsNow();
+  readout_time_.Record(t_read - t_start);
 
-    bundle.device_clock[ch] = 0;
-    bundle.device_clock[ch] = data[ch][1] & 0xffff;
-    bundle.device_clock[ch] |= data[ch][1] & (0xffff << 16);
-    bundle.device_clock[ch] |= (data[ch][0] & 0xffffULL << 16) << 32;
+  RecordRaw(data, SIS_3316_CH * sizeof(channel_data), bundle.system_clock);
 
-    std::copy((ushort *)(data[ch]+3),
-	      (ushort *)(data[ch]+3) + SIS_3316_LN,
-    	      bundle.trace[ch]);
-  }
+  DecodeSis3316(data, bundle);
+  decode_time_.Record(MetricsNow() - t_read);
 
   t1 = high_resolution_clock::now();
   dtn = t1.time_since_epoch() - t0_.time_since_epoch();
@@ -1354,4 +1356,6 @@ int WorkerSis3316::Si5325Write(uint addr, uint msg)
   return 0;
 }
 
+static WorkerRegistrar<WorkerSis3316> sis3316_registrar("sis_3316");
+
 } // ::daq
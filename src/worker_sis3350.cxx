@@ -1,9 +1,10 @@
 #include "worker_sis3350.hh"
+#include "worker_factory.hh"
 
 namespace daq {
 
 WorkerSis3350::WorkerSis3350(std::string name, std::string conf) : 
-  WorkerVme<sis_3350>(name, conf)
+  WorkerVme<sis_3350>(name, conf), bundle_()
 {
   num_ch_ = SIS_3350_CH;
   read_trace_len_ = SIS_3350_LN / 2 + 4;
@@ -17,8 +18,7 @@ void WorkerSis3350::LoadConfig()
   uint msg = 0;
 
   // Open the configuration file.
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
+  const boost::property_tree::ptree &conf = ReadConfig();
 
   // Get the device filestream.  If it isn't open, open it.
   std::string dev_path = conf.get<std::string>("device");
@@ -26,6 +26,14 @@ void WorkerSis3350::LoadConfig()
   // Get the base address.  Needs to be converted from hex.
   base_address_ = std::stoul(conf.get<std::string>("base_address"), nullptr, 0);
 
+  multi_events_ = conf.get<int>("multi_events", 1);
+  if (multi_events_ < 1 || multi_events_ > kMaxEvents) {
+    LogError("multi_events must be in 1 - %i, using 1", kMaxEvents);
+    multi_events_ = 1;
+  }
+
+  max_wait_ns_ = conf.get<long long>("max_wait_ms", 100) * 1000000;
+
   // Check for device.
   rc = Read(0x0, msg);
   if (rc != 0) {
@@ -85,6 +93,10 @@ void WorkerSis3350::LoadConfig()
   // Set to the acquisition register.
   msg = 0x1;//sync ring buffer mode
 
+  if (multi_events_ > 1) {
+    msg |= 0x1 << 5; //multi event mode
+  }
+
   if (conf.get<bool>("enable_ext_lemo")) {
     msg |= 0x1 << 8; //enable EXT LEMO
   }
@@ -107,6 +119,18 @@ void WorkerSis3350::LoadConfig()
     LogMessage("ACQ register set to: 0x%08x", msg);
   }
 
+  if (multi_events_ > 1) {
+    rc = Write(MULTI_EVENT_MAX_NOF_EVENTS, multi_events_);
+    if (rc != 0) {
+      LogError("failed to set multi event max number of events");
+    }
+  }
+
+  // Each channel's events, multi_events_ apart, and in multi event mode
+  // one more event behind them that raw streams gather into.
+  int num_slots = (multi_events_ > 1) ? multi_events_ + 1 : 1;
+  AllocateReadoutBuffer(SIS_3350_CH * num_slots * kEventWords, conf);
+
   // Set the synthesizer register.
   msg = 0x14; //500 MHz
   rc = Write(0x1c, msg);
@@ -295,11 +319,7 @@ void WorkerSis3350::LoadConfig()
     usleep(20000);
   }
 
-  uint armit = 1;
-  rc = Write(0x410, armit);
-  if (rc != 0) {
-    LogError("failure to arm acquisition logic");
-  }
+  Arm();
 } // LoadConfig
 
 void WorkerSis3350::WorkLoop()
@@ -308,28 +328,31 @@ void WorkerSis3350::WorkLoop()
 
   while (thread_live_) {
 
-    // Grab the event if we have one.
-    if (EventAvailable()) {
-      
-      static sis_3350 bundle;
-      GetEvent(bundle);
-      
-      queue_mutex_.lock();
-      data_queue_.push(bundle);
-      has_event_ = true;
+    while (go_time_) {
 
-      // Drop old events
-      if (data_queue_.size() > max_queue_size_)
-	data_queue_.pop();
+      bool got_data = false;
 
-      queue_mutex_.unlock();
-      
-    } else {
-      
-      std::this_thread::yield();
-      usleep(daq::short_sleep);
-    }
+      if (!QueueBlocked()) {
 
+        if (multi_events_ > 1) {
+
+          got_data = (GetEvents() > 0);
+
+        } else if (EventAvailable()) {
+
+          GetEvent(bundle_);
+
+          QueueEvent(bundle_);
+          got_data = true;
+        }
+      }
+
+      if (!got_data) {
+
+        std::this_thread::yield();
+        usleep(daq::short_sleep);
+      }
+    }
 
     std::this_thread::yield();
     usleep(daq::long_sleep);
@@ -353,8 +376,8 @@ sis_3350 WorkerSis3350::PopEvent()
   data = data_queue_.front();
   data_queue_.pop();
 
-  // Check if this is that last event.
-  if (data_queue_.size() == 0) has_event_ = false;
+  // Publish the new queue size.
+  UpdateQueueStatus();
 
   queue_mutex_.unlock();
   return data;
@@ -364,8 +387,8 @@ sis_3350 WorkerSis3350::PopEvent()
 bool WorkerSis3350::EventAvailable()
 {
   // Check acq reg.
-  static uint msg = 0;
-  static bool is_event;
+  uint msg = 0;
+  bool is_event;
   uint count = 0, rc = 0;
 
   do {
@@ -404,6 +427,7 @@ void WorkerSis3350::GetEvent(sis_3350 &bundle)
 
   int ch, offset, rc = 0;
   bool is_event = true;
+  long long t_start = MetricsNow();
 
   // Check how long the event is.
   //expected SIS_3350_LN + 8
@@ -428,7 +452,13 @@ void WorkerSis3350::GetEvent(sis_3350 &bundle)
   bundle.system_clock = duration_cast<milliseconds>(dtn).count();
 
   //todo: check it has the expected length
-  uint trace[4][SIS_3350_LN / 2 + 4];
+  typedef uint channel_data[kEventWords];
+  channel_data *trace = (channel_data *)readout_buffer_.data();
+
+  if (trace == nullptr) {
+    LogError("no readout buffer");
+    return;
+  }
 
   for (ch = 0; ch < SIS_3350_CH; ch++) {
 
@@ -440,21 +470,132 @@ void WorkerSis3350::GetEvent(sis_3350 &bundle)
     }
   }
 
-  //decode the event (little endian arch)
+  long long t_read = MetricsNow();
+  readout_time_.Record(t_read - t_start);
+
+  RecordRaw(trace, SIS_3350_CH * sizeof(channel_data), bundle.system_clock);
+
+  DecodeSis3350(trace, bundle);
+  decode_time_.Record(MetricsNow() - t_read);
+}
+
+int WorkerSis3350::GetEvents()
+{
+  using namespace std::chrono;
+
+  uint msg = 0, num_events = 0;
+  int ch, rc = 0;
+
+  rc = Read(0x10, msg);
+  if (rc != 0) {
+    LogError("failure to read acquisition status register");
+    return 0;
+  }
+
+  // Still armed, wait for more events unless the first has waited long.
+  if (msg & 0x10000) {
+
+    if (MetricsNow() - armed_at_ < max_wait_ns_) return 0;
+
+    rc = Read(MULTI_EVENT_COUNTER, num_events);
+    if (rc != 0 || num_events == 0) return 0;
+
+    rc = Write(0x414, 0x1);
+    if (rc != 0) {
+      LogError("failure to disarm acquisition logic");
+    }
+  }
+
+  long long t_start = MetricsNow();
+
+  rc = Read(MULTI_EVENT_COUNTER, num_events);
+  if (rc != 0) {
+    LogError("failure to read multi event counter");
+  }
+
+  num_events = std::min(num_events, (uint)multi_events_);
+
+  if (num_events == 0) {
+    Arm();
+    return 0;
+  }
+
+  // Get the system time.
+  auto t1 = high_resolution_clock::now();
+  auto dtn = t1.time_since_epoch() - t0_.time_since_epoch();
+  ULong64_t system_clock = duration_cast<milliseconds>(dtn).count();
+
+  uint *block = readout_buffer_.data();
+
+  if (block == nullptr) {
+    LogError("no readout buffer");
+    return 0;
+  }
+
+  // Every channel's events in one chained transfer.
+  VmeBlock blocks[SIS_3350_CH];
+
   for (ch = 0; ch < SIS_3350_CH; ch++) {
+    blocks[ch].addr = (0x4 + ch) << 24;
+    blocks[ch].data = &block[ch * multi_events_ * kEventWords];
+    blocks[ch].num_words = num_events * kEventWords;
+    blocks[ch].num_got = 0;
+  }
 
-    bundle.device_clock[ch] = 0;
-    bundle.device_clock[ch] = trace[ch][1] & 0xfff;
-    bundle.device_clock[ch] |= (trace[ch][1] & 0xfff0000) >> 4;
-    bundle.device_clock[ch] |= (trace[ch][0] & 0xfffULL) << 24;
-    bundle.device_clock[ch] |= (trace[ch][0] & 0xfff0000ULL) << 20;
+  rc = ReadTraceChain(blocks, SIS_3350_CH, VmeBlockMode::k2eVme);
+  if (rc != 0) {
+    LogError("failed to read %u events", num_events);
+  }
+
+  // The board takes the next events while these are decoded.
+  Arm();
+
+  long long t_read = MetricsNow();
+  readout_time_.Record(t_read - t_start);
+
+  typedef uint channel_data[kEventWords];
+  channel_data *trace = (channel_data *)&block[SIS_3350_CH * multi_events_ *
+                                                kEventWords];
+  sis_3350 &bundle = bundle_;
+
+  for (uint i = 0; i < num_events; ++i) {
+
+    // Decoded where they were read to, only raw streams need the event
+    // gathered in one piece.
+    for (ch = 0; ch < SIS_3350_CH; ch++) {
+      const uint *event = &block[(ch * multi_events_ + i) * kEventWords];
+      DecodeSis3350Channel(event, bundle.device_clock[ch], bundle.trace[ch]);
 
-    uint idx;
-    for (idx = 0; idx < SIS_3350_LN / 2; idx++) {
-      bundle.trace[ch][2 * idx] = trace[ch][idx + 4] & 0xfff;
-      bundle.trace[ch][2 * idx + 1] = (trace[ch][idx + 4] >> 16) & 0xfff;
+      if (raw_out_) std::copy(event, event + kEventWords, trace[ch]);
     }
+
+    bundle.system_clock = system_clock;
+    RecordRaw(trace, SIS_3350_CH * sizeof(channel_data), system_clock);
+
+    QueueEvent(bundle);
+
+    long long t_decoded = MetricsNow();
+    decode_time_.Record(t_decoded - t_read);
+    t_read = t_decoded;
   }
+
+  return num_events;
 }
 
+void WorkerSis3350::Arm()
+{
+  uint count = 0, rc = 0;
+
+  do {
+    rc = Write(0x410, 0x1);
+    if (rc != 0) {
+      LogError("failure to arm acquisition logic");
+    }
+  } while ((rc != 0) && (count++ < 100));
+
+  armed_at_ = MetricsNow();
+}
+
+static WorkerRegistrar<WorkerSis3350> sis3350_registrar("sis_3350");
+
 } // ::daq
@@ -0,0 +1,131 @@
+#include "writer_base.hh"
+
+namespace daq {
+
+WriterBase::WriterBase(std::string conf_file, std::string name)
+    : CommonBase(name),
+      conf_file_(conf_file),
+      thread_live_(true),
+      events_written_(Metrics::Instance().GetCounter(name + ".written")),
+      events_dropped_(Metrics::Instance().GetCounter(name + ".dropped")),
+      queue_depth_(Metrics::Instance().GetGauge(name + ".queue_depth")),
+      write_time_(Metrics::Instance().GetHistogram(name + ".write_ns")),
+      num_batches_(0),
+      batches_queued_(
+          Metrics::Instance().GetGauge(name + ".batches_queued")) {
+  max_batches_ = ConfigCache::Instance().LoadRun(conf_file_)->writer_batches;
+
+  // Nothing reaches the derived writer before the first SubmitBatch, so
+  // the thread can start before it is constructed.
+  dispatch_live_ = true;
+  dispatch_thread_ = std::thread(&WriterBase::DispatchLoop, this);
+}
+
+void WriterBase::SubmitBatch(batch_ptr batch) {
+  Task task;
+  task.batch = batch;
+  task.end_of_batch = false;
+  task.bad_data = false;
+
+  QueueTask(task);
+}
+
+void WriterBase::SubmitEndOfBatch(bool bad_data) {
+  Task task;
+  task.end_of_batch = true;
+  task.bad_data = bad_data;
+
+  QueueTask(task);
+}
+
+std::future<void> WriterBase::Flush() {
+  Task task;
+  task.end_of_batch = false;
+  task.bad_data = false;
+  task.done = std::make_shared<std::promise<void>>();
+
+  std::future<void> done = task.done->get_future();
+  QueueTask(task);
+
+  return done;
+}
+
+void WriterBase::QueueTask(const Task &task) {
+  while (dispatch_live_) {
+    {
+      std::lock_guard<std::mutex> lock(task_mutex_);
+
+      // Only batches count against the limit, markers always go in.
+      if (!task.batch || num_batches_ < max_batches_) {
+        tasks_.push_back(task);
+        if (task.batch) batches_queued_.Set(++num_batches_);
+        return;
+      }
+    }
+
+    std::this_thread::yield();
+    usleep(daq::short_sleep);
+  }
+
+  // The writer is shutting down, nothing will be written.
+  if (task.batch) events_dropped_.Add(task.batch->size());
+  if (task.done) task.done->set_value();
+}
+
+void WriterBase::StopDispatch() {
+  dispatch_live_ = false;
+
+  if (dispatch_thread_.joinable()) {
+    try {
+      dispatch_thread_.join();
+    } catch (const std::system_error &e) {
+      LogError("encountered race condition joining dispatch thread");
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(task_mutex_);
+
+  for (auto &task : tasks_) {
+    if (task.batch) events_dropped_.Add(task.batch->size());
+    if (task.done) task.done->set_value();
+  }
+
+  tasks_.clear();
+  num_batches_ = 0;
+  batches_queued_.Set(0);
+}
+
+void WriterBase::DispatchLoop() {
+  while (dispatch_live_) {
+    Task task;
+    bool have_task = false;
+
+    {
+      std::lock_guard<std::mutex> lock(task_mutex_);
+
+      if (!tasks_.empty()) {
+        task = tasks_.front();
+        tasks_.pop_front();
+        if (task.batch) batches_queued_.Set(--num_batches_);
+        have_task = true;
+      }
+    }
+
+    if (!have_task) {
+      std::this_thread::yield();
+      usleep(daq::short_sleep);
+      continue;
+    }
+
+    if (task.batch) {
+      PushData(*task.batch);
+
+    } else if (task.end_of_batch) {
+      EndOfBatch(task.bad_data);
+    }
+
+    if (task.done) task.done->set_value();
+  }
+}
+
+}  // ::daq
@@ -2,8 +2,91 @@
 
 namespace daq {
 
+namespace {
+
+// Scalars are sent as doubles.
+template <typename V>
+inline json11::Json ToJson(const V &value, int) {
+  return static_cast<double>(value);
+}
+
+// Per channel arrays are sent whole.
+template <typename V, size_t N>
+inline json11::Json ToJson(const V (&arr)[N], int) {
+  return std::vector<double>(arr, arr + N);
+}
+
+// Traces are truncated to the configured maximum length.
+template <typename V, size_t N, size_t M>
+inline json11::Json ToJson(const V (&arr)[N][M], int max_len) {
+  size_t len = (max_len < 0 || (size_t)max_len > M) ? M : max_len;
+
+  std::vector<std::vector<double> > trace_vec;
+  for (size_t ch = 0; ch < N; ++ch) {
+    trace_vec.emplace_back(arr[ch], arr[ch] + len);
+  }
+
+  return trace_vec;
+}
+
+// Converts each member of a device struct into a json field.
+template <typename T>
+class FieldPacker {
+ public:
+  FieldPacker(const T &dev, json11::Json::object &map, int max_len)
+      : dev_(dev), map_(map), max_len_(max_len) {}
+
+  template <typename M>
+  void operator()(const char *name, M T::*member) {
+    map_[name] = ToJson(dev_.*member, max_len_);
+  }
+
+ private:
+  const T &dev_;
+  json11::Json::object &map_;
+  int max_len_;
+};
+
+// Adds one json object per device of type T, keyed "<online_name>_<i>".
+class MessagePacker {
+ public:
+  MessagePacker(const event_data &data, json11::Json::object &map, int max_len)
+      : data_(data), map_(map), max_len_(max_len) {}
+
+  template <typename T>
+  void apply() {
+    int count = 0;
+    char str[50];
+
+    for (auto &dev : device_traits<T>::vec(data_)) {
+      json11::Json::object dev_map;
+      FieldPacker<T> packer(dev, dev_map, max_len_);
+      device_traits<T>::fields(packer);
+
+      sprintf(str, "%s_%i", device_traits<T>::online_name(), count++);
+      map_[str] = dev_map;
+    }
+  }
+
+ private:
+  const event_data &data_;
+  json11::Json::object &map_;
+  int max_len_;
+};
+
+}  // ::
+
+std::string PackOnlineEvent(const event_data &data,
+                            json11::Json::object &json_map,
+                            int max_trace_length) {
+  MessagePacker packer(data, json_map, max_trace_length);
+  for_each_device(packer);
+
+  return json11::Json(json_map).dump();
+}
+
 WriterOnline::WriterOnline(std::string conf_file)
-    : WriterBase(conf_file), online_sck_(msg_context, ZMQ_PUSH) {
+    : WriterBase(conf_file, std::string("WriterOnline")), online_sck_(msg_context, ZMQ_PUSH) {
   thread_live_ = true;
   go_time_ = false;
   end_of_batch_ = false;
@@ -14,32 +97,61 @@ WriterOnline::WriterOnline(std::string conf_file)
 }
 
 void WriterOnline::LoadConfig() {
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
+  auto conf = ConfigCache::Instance().LoadRun(conf_file_);
+
+  writer_mutex_.lock();
+  gate_.SetLimits(conf->writer_queue);
+  writer_mutex_.unlock();
+
+  if (conf->online_port.empty()) {
+    LogError("no writers.online.port in %s", conf_file_.c_str());
+    return;
+  }
 
-  int hwm = conf.get<int>("writers.online.high_water_mark", 10);
+  int hwm = conf->online_high_water_mark;
   online_sck_.setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
   int linger = 0;
   online_sck_.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-  online_sck_.connect(conf.get<std::string>("writers.online.port").c_str());
+  online_sck_.connect(conf->online_port.c_str());
 
-  max_trace_length_ = conf.get<int>("writers.online.max_trace_length", -1);
+  max_trace_length_ = conf->online_max_trace_length;
 }
 
 void WriterOnline::PushData(const std::vector<event_data> &data_buffer) {
   LogMessage("Received some data");
 
-  writer_mutex_.lock();
+  std::unique_lock<std::mutex> lock(writer_mutex_);
 
   number_of_events_ += data_buffer.size();
 
-  auto it = data_buffer.begin();
-  while (data_queue_.size() < kMaxQueueSize && it != data_buffer.end()) {
-    data_queue_.push(*it);
-    ++it;
+  for (auto &event : data_buffer) {
+    QueueAction action = gate_.Admit(data_queue_.size());
+
+    // Blocking holds up the builder until the sender makes room.
+    while (action == QueueAction::kWait && go_time_) {
+      lock.unlock();
+      usleep(daq::short_sleep);
+      std::this_thread::yield();
+      lock.lock();
+
+      action = gate_.Admit(data_queue_.size());
+    }
+
+    if (action == QueueAction::kDropNewest || action == QueueAction::kWait) {
+      events_dropped_.Add();
+      continue;
+    }
+
+    if (action == QueueAction::kDropOldest) {
+      data_queue_.pop();
+      events_dropped_.Add();
+    }
+
+    data_queue_.push(event);
+    queue_has_data_ = true;
   }
-  queue_has_data_ = true;
-  writer_mutex_.unlock();
+
+  queue_depth_.Set(data_queue_.size());
 }
 
 void WriterOnline::EndOfBatch(bool bad_data) {
@@ -65,6 +177,8 @@ void WriterOnline::EndOfBatch(bool bad_data) {
 void WriterOnline::SendMessageLoop() {
   while (thread_live_) {
     while (go_time_ && queue_has_data_) {
+      long long t_start = MetricsNow();
+
       if (!message_ready_) {
         PackMessage();
       }
@@ -85,6 +199,9 @@ void WriterOnline::SendMessageLoop() {
         if (rc == true) {
           LogMessage("Sent message successfully");
           message_ready_ = false;
+
+          write_time_.Record(MetricsNow() - t_start);
+          events_written_.Add();
         }
 
         usleep(daq::short_sleep);
@@ -105,9 +222,6 @@ void WriterOnline::PackMessage() {
 
   LogMessage("Packing message.");
 
-  int count = 0;
-  char str[50];
-
   json11::Json::object json_map;
 
   event_data data;
@@ -120,176 +234,13 @@ void WriterOnline::PackMessage() {
 
     data = data_queue_.front();
     data_queue_.pop();
+    queue_depth_.Set(data_queue_.size());
     if (data_queue_.size() == 0) queue_has_data_ = false;
 
     json_map["event_number"] = number_of_events_;
   }
 
-  for (auto sis : data.sis_3350_vec) {
-    json11::Json::object sis_map;
-    auto trace_len = max_trace_length_ < 0 ? SIS_3350_LN : max_trace_length_;
-
-    sis_map["system_clock"] = static_cast<double>(sis.system_clock);
-
-    sis_map["device_clock"] =
-        std::vector<double>(sis.device_clock, sis.device_clock + SIS_3350_CH);
-
-    std::vector<std::vector<double> > trace_vec;
-    for (int ch = 0; ch < SIS_3350_CH; ++ch) {
-      trace_vec.emplace_back(sis.trace[ch], sis.trace[ch] + trace_len);
-    }
-    sis_map["trace"] = trace_vec;
-
-    sprintf(str, "sis_3350_%i", count++);
-    json_map[str] = sis_map;
-  }
-
-  count = 0;
-  for (auto &sis : data.sis_3302_vec) {
-    json11::Json::object sis_map;
-    auto trace_len = max_trace_length_ < 0 ? SIS_3302_LN : max_trace_length_;
-
-    sis_map["system_clock"] = static_cast<double>(sis.system_clock);
-
-    sis_map["device_clock"] =
-        std::vector<double>(sis.device_clock, sis.device_clock + SIS_3302_CH);
-
-    std::vector<std::vector<double> > trace_vec;
-    for (int ch = 0; ch < SIS_3302_CH; ++ch) {
-      trace_vec.emplace_back(sis.trace[ch], sis.trace[ch] + trace_len);
-    }
-    sis_map["trace"] = trace_vec;
-
-    sprintf(str, "sis_3302_%i", count++);
-    json_map[str] = sis_map;
-  }
-
-  count = 0;
-  for (auto &sis : data.sis_3316_vec) {
-    json11::Json::object sis_map;
-    auto trace_len = max_trace_length_ < 0 ? SIS_3316_LN : max_trace_length_;
-
-    sis_map["system_clock"] = static_cast<double>(sis.system_clock);
-
-    sis_map["device_clock"] =
-        std::vector<double>(sis.device_clock, sis.device_clock + SIS_3316_CH);
-
-    std::vector<std::vector<double> > trace_vec;
-    for (int ch = 0; ch < SIS_3316_CH; ++ch) {
-      trace_vec.emplace_back(sis.trace[ch], sis.trace[ch] + trace_len);
-    }
-    sis_map["trace"] = trace_vec;
-
-    sprintf(str, "sis_3316_%i", count++);
-    json_map[str] = sis_map;
-  }
-
-  count = 0;
-  for (auto &caen : data.caen_6742_vec) {
-    json11::Json::object caen_map;
-    auto trace_len = max_trace_length_ < 0 ? CAEN_6742_LN : max_trace_length_;
-
-    caen_map["system_clock"] = static_cast<double>(caen.system_clock);
-
-    caen_map["device_clock"] = std::vector<double>(
-        caen.device_clock, caen.device_clock + CAEN_6742_CH);
-
-    std::vector<std::vector<double> > trace_vec;
-    for (int ch = 0; ch < CAEN_6742_CH; ++ch) {
-      trace_vec.emplace_back(caen.trace[ch], caen.trace[ch] + trace_len);
-    }
-    caen_map["trace"] = trace_vec;
-
-    sprintf(str, "caen_6742_%i", count++);
-    json_map[str] = caen_map;
-  }
-
-  count = 0;
-  for (auto &caen : data.caen_1742_vec) {
-    json11::Json::object caen_map;
-    auto trace_len = max_trace_length_ < 0 ? CAEN_1742_LN : max_trace_length_;
-
-    caen_map["system_clock"] = static_cast<double>(caen.system_clock);
-
-    caen_map["device_clock"] = std::vector<double>(
-        caen.device_clock, caen.device_clock + CAEN_1742_CH);
-
-    std::vector<std::vector<double> > trace_vec;
-    for (int ch = 0; ch < CAEN_1742_CH; ++ch) {
-      trace_vec.emplace_back(caen.trace[ch], caen.trace[ch] + trace_len);
-    }
-    caen_map["trace"] = trace_vec;
-
-    std::vector<std::vector<double> > trig_vec;
-    for (int gr = 0; gr < CAEN_1742_GR; ++gr) {
-      trig_vec.emplace_back(caen.trigger[gr], caen.trigger[gr] + trace_len);
-    }
-    caen_map["trigger"] = trig_vec;
-
-    sprintf(str, "caen_1742_%i", count++);
-    json_map[str] = caen_map;
-  }
-
-  count = 0;
-  for (auto &board : data.drs4_vec) {
-    json11::Json::object drs_map;
-    auto trace_len = max_trace_length_ < 0 ? DRS4_LN : max_trace_length_;
-
-    drs_map["system_clock"] = static_cast<double>(board.system_clock);
-
-    drs_map["device_clock"] =
-        std::vector<double>(board.device_clock, board.device_clock + DRS4_CH);
-
-    std::vector<std::vector<double> > trace_vec;
-    for (int ch = 0; ch < DRS4_CH; ++ch) {
-      trace_vec.emplace_back(board.trace[ch], board.trace[ch] + trace_len);
-    }
-    drs_map["trace"] = trace_vec;
-
-    sprintf(str, "drs4_%i", count++);
-    json_map[str] = drs_map;
-  }
-
-  count = 0;
-  for (auto &caen : data.caen_5720_vec) {
-    json11::Json::object caen_map;
-    auto trace_len = max_trace_length_ < 0 ? CAEN_5720_LN : max_trace_length_;
-
-    caen_map["system_clock"] = static_cast<double>(caen.system_clock);
-
-    caen_map["event_index"] = static_cast<double>(caen.event_index);
-
-    std::vector<std::vector<double> > trace_vec;
-    for (int ch = 0; ch < CAEN_5720_CH; ++ch) {
-      trace_vec.emplace_back(caen.trace[ch], caen.trace[ch] + trace_len);
-    }
-    caen_map["trace"] = trace_vec;
-
-    sprintf(str, "caen5720_%i", count++);
-    json_map[str] = caen_map;
-  }
-
-  count = 0;
-  for (auto &caen : data.caen_5730_vec) {
-    json11::Json::object caen_map;
-    auto trace_len = max_trace_length_ < 0 ? CAEN_5730_LN : max_trace_length_;
-
-    caen_map["system_clock"] = static_cast<double>(caen.system_clock);
-    
-    caen_map["event_index"] = static_cast<double>(caen.event_index);
-    
-    std::vector<std::vector<double> > trace_vec;
-    for (int ch = 0; ch < CAEN_5730_CH; ++ch) {
-      trace_vec.emplace_back(caen.trace[ch], caen.trace[ch] + trace_len);
-    }
-    caen_map["trace"] = trace_vec;
-    
-    sprintf(str, "caen5730_%i", count++);
-    json_map[str] = caen_map;
-  }
-
-
-  std::string buffer = json11::Json(json_map).dump();
+  std::string buffer = PackOnlineEvent(data, json_map, max_trace_length_);
   buffer.append("__EOM__");
 
   message_ = zmq::message_t(buffer.size());
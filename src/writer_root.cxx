@@ -2,280 +2,168 @@
 
 namespace daq {
 
-WriterRoot::WriterRoot(std::string conf_file) : WriterBase(conf_file) {
-  end_of_batch_ = false;
-  LoadConfig();
-}
-
-void WriterRoot::LoadConfig() {
-  boost::property_tree::ptree conf;
-  boost::property_tree::read_json(conf_file_, conf);
-
-  outfile_ = conf.get<std::string>("writers.root.file", "default.root");
-  tree_name_ = conf.get<std::string>("writers.root.tree", "t");
-  need_sync_ = conf.get<bool>("writers.root.sync", false);
-}
-
-void WriterRoot::StartWriter() {
-  using namespace boost::property_tree;
-
-  // Allocate ROOT files
-  pf_ = new TFile(outfile_.c_str(), "RECREATE");
-  pt_ = new TTree(tree_name_.c_str(), tree_name_.c_str());
-
-  // Turn off autoflush, I will check for synchronization then flush.
-  pt_->SetAutoFlush(0);
-
-  // Need to get tree names out of the config file
-  ptree conf;
-  read_json(conf_file_, conf);
-
-  // For each different device we need to loop and assign branches.
-  std::string br_name;
-  char br_vars[100];
-
-  // Count the devices, reserve memory for them, then assign an address.
-  int count = 0;
-  for (auto &v : conf.get_child("devices.sis_3350")) {
-    count++;
-  }
-  for (auto &v : conf.get_child("devices.fake")) {
-    count++;
-  }
-  root_data_.sis_3350_vec.reserve(count + 1);
-
-  count = 0;
-  for (auto &v : conf.get_child("devices.sis_3350")) {
-    root_data_.sis_3350_vec.resize(count + 1);
-
-    br_name = std::string(v.first);
-    sprintf(br_vars, "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s",
-            SIS_3350_CH, SIS_3350_CH, SIS_3350_LN);
-
-    pt_->Branch(br_name.c_str(), &root_data_.sis_3350_vec[count++], br_vars);
-  }
-
-  for (auto &v : conf.get_child("devices.fake")) {
-    root_data_.sis_3350_vec.resize(count);
-
-    br_name = std::string(v.first);
-    sprintf(br_vars, "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s",
-            SIS_3350_CH, SIS_3350_CH, SIS_3350_LN);
-
-    pt_->Branch(br_name.c_str(), &root_data_.sis_3350_vec[count++], br_vars);
-  }
-
-  // Again, count, reserve then assign the slow struck.
-  count = 0;
-  for (auto &v : conf.get_child("devices.sis_3302")) {
-    count++;
-  }
-  root_data_.sis_3302_vec.reserve(count);
-
-  count = 0;
-  for (auto &v : conf.get_child("devices.sis_3302")) {
-    root_data_.sis_3302_vec.resize(count + 1);
-
-    br_name = std::string(v.first);
-    sprintf(br_vars, "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s",
-            SIS_3302_CH, SIS_3302_CH, SIS_3302_LN);
-
-    pt_->Branch(br_name.c_str(), &root_data_.sis_3302_vec[count++], br_vars);
-  }
-
-  // Now handle the SIS3316 devices.
-  count = 0;
-  for (auto &v : conf.get_child("devices.sis_3316")) {
-    count++;
-  }
-  root_data_.sis_3316_vec.reserve(count);
-
-  count = 0;
-  for (auto &v : conf.get_child("devices.sis_3316")) {
-    root_data_.sis_3302_vec.resize(count + 1);
-
-    br_name = std::string(v.first);
-    sprintf(br_vars, "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s",
-            SIS_3316_CH, SIS_3316_CH, SIS_3316_LN);
-
-    pt_->Branch(br_name.c_str(), &root_data_.sis_3302_vec[count++], br_vars);
-  }
-
-  // Now set up the caen adc.
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_1785")) {
-    count++;
-  }
-  root_data_.caen_1785_vec.reserve(count);
-
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_1785")) {
-    root_data_.caen_1785_vec.resize(count + 1);
-
-    br_name = std::string(v.first);
-    sprintf(br_vars, "system_clock/l:device_clock[%i]/l:value[%i]/s",
-            CAEN_1785_CH, CAEN_1785_CH);
-
-    pt_->Branch(br_name.c_str(), &root_data_.caen_1785_vec[count++], br_vars);
-  }
-
-  // Now set up the caen drs.
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_6742")) {
-    count++;
-  }
-  root_data_.caen_6742_vec.reserve(count);
-
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_6742")) {
-    root_data_.caen_6742_vec.resize(count + 1);
+namespace {
+
+// Sizes the branch buffer for device type T and assigns one branch per
+// device listed under its "devices" keys in the run config.
+class BranchAssigner {
+ public:
+  BranchAssigner(TTree *pt, event_data &data,
+                 const boost::property_tree::ptree &conf)
+      : pt_(pt), data_(data), conf_(conf) {}
+
+  template <typename T>
+  void apply() {
+    std::vector<std::string> names;
+
+    for (auto &key : device_traits<T>::config_keys()) {
+      auto devices = conf_.get_child_optional("devices." + key);
+      if (!devices) continue;
+
+      for (auto &v : *devices) {
+        names.push_back(v.first);
+      }
+    }
 
-    br_name = std::string(v.first);
-    sprintf(br_vars, "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s",
-            CAEN_6742_CH, CAEN_6742_CH, CAEN_6742_LN);
+    // Size the vector once so the branch addresses stay valid.
+    auto &vec = device_traits<T>::vec(data_);
+    vec.resize(names.size());
 
-    pt_->Branch(br_name.c_str(), &root_data_.caen_6742_vec[count++], br_vars);
+    std::string br_vars = leaf_list<T>();
+    for (size_t i = 0; i < names.size(); ++i) {
+      pt_->Branch(names[i].c_str(), &vec[i], br_vars.c_str());
+    }
   }
 
-  // Now set up the drs evaluation board.
-  count = 0;
-  for (auto &v : conf.get_child("devices.drs4")) {
-    count++;
-  }
-  root_data_.drs4_vec.reserve(count);
+ private:
+  TTree *pt_;
+  event_data &data_;
+  const boost::property_tree::ptree &conf_;
+};
 
-  count = 0;
-  for (auto &v : conf.get_child("devices.drs4")) {
-    root_data_.drs4_vec.resize(count + 1);
+// Copies device type T of an event into the branch buffers.
+class EventCopier {
+ public:
+  EventCopier(const event_data &src, event_data &dst) : src_(src), dst_(dst) {}
 
-    br_name = std::string(v.first);
-    sprintf(br_vars, "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s",
-            DRS4_CH, DRS4_CH, DRS4_LN);
+  template <typename T>
+  void apply() {
+    const auto &src = device_traits<T>::vec(src_);
+    auto &dst = device_traits<T>::vec(dst_);
 
-    pt_->Branch(br_name.c_str(), &root_data_.drs4_vec[count++], br_vars);
+    std::copy(src.begin(), src.begin() + std::min(src.size(), dst.size()),
+              dst.begin());
   }
 
-  // Now set up the caen drs vme module.
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_1742")) {
-    count++;
-  }
-  root_data_.caen_1742_vec.reserve(count);
+ private:
+  const event_data &src_;
+  event_data &dst_;
+};
 
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_1742")) {
-    root_data_.caen_1742_vec.resize(count + 1);
+}  // ::
 
-    br_name = std::string(v.first);
-    sprintf(
-        br_vars,
-        "system_clock/l:device_clock[%i]/l:trace[%i][%i]/s:trigger[%i][%i]/s",
-        CAEN_1742_CH, CAEN_1742_CH, CAEN_1742_LN, CAEN_1742_GR, CAEN_1742_LN);
+WriterRoot::WriterRoot(std::string conf_file)
+    : WriterBase(conf_file, std::string("WriterRoot")) {
+  end_of_batch_ = false;
 
-    pt_->Branch(br_name.c_str(), &root_data_.caen_1742_vec[count++], br_vars);
-  }
+  // Files are closed on their own thread while the next one fills.
+  ROOT::EnableThreadSafety();
 
-  // now the dt5720
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_5720")) {
-    count++;
-  }
-  root_data_.caen_5720_vec.reserve(count);
+  LoadConfig();
+}
 
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_5720")) {
-    root_data_.caen_5720_vec.resize(count + 1);
+void WriterRoot::LoadConfig() {
+  auto conf = ConfigCache::Instance().LoadRun(conf_file_);
 
-    br_name = std::string(v.first);
-    sprintf(br_vars, "event_index/l:system_clock/l:trace[%i][%i]/s",
-            CAEN_5720_CH, CAEN_5720_LN);
+  outfile_ = conf->root_file;
+  tree_name_ = conf->root_tree;
+  need_sync_ = conf->root_sync;
+}
 
-    pt_->Branch(br_name.c_str(), &root_data_.caen_5720_vec[count++], br_vars);
-  }
+void WriterRoot::StartWriter() {
+  // Pick up the file name of the coming run.
+  LoadConfig();
 
-  // now the dt5730
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_5730")) {
-    count++;
-  }
-  root_data_.caen_5730_vec.reserve(count);
+  // Allocate ROOT files
+  run_.reset(new RunFile);
+  run_->outfile = outfile_;
+  run_->pf = new TFile(outfile_.c_str(), "RECREATE");
+  run_->pt = new TTree(tree_name_.c_str(), tree_name_.c_str());
 
-  count = 0;
-  for (auto &v : conf.get_child("devices.caen_5730")) {
-    root_data_.caen_5730_vec.resize(count + 1);
+  // Turn off autoflush, I will check for synchronization then flush.
+  run_->pt->SetAutoFlush(0);
 
-    br_name = std::string(v.first);
-    sprintf(br_vars, "event_index/l:system_clock/l:trace[%i][%i]/s",
-            CAEN_5730_CH, CAEN_5730_LN);
+  // Need to get tree names out of the config file
+  auto conf = ConfigCache::Instance().LoadRun(conf_file_);
 
-    pt_->Branch(br_name.c_str(), &root_data_.caen_5730_vec[count++], br_vars);
-  }
+  // Assign a branch to every configured device of each type.
+  BranchAssigner assigner(run_->pt, run_->data, *conf->tree);
+  for_each_device(assigner);
 }
 
 void WriterRoot::StopWriter() {
-  pf_->Write();
-  pf_->Close();
-
-  LogMessage("Closed data TFile.");
-  delete pf_;
-
-  std::string cmd("chown newg2:newg2 ");
-  cmd += outfile_.c_str();
-  system((const char *)cmd.c_str());
+  if (run_ == nullptr) return;
+
+  // The livetime normalises the run's rates, store it beside the tree.
+  run_->pf->cd();
+  Livetime live = BusyControl::Instance().GetLivetime();
+  TParameter<Long64_t>("run_ns", live.run_ns).Write();
+  TParameter<Long64_t>("busy_ns", live.busy_ns).Write();
+  TParameter<double>("livetime", live.fraction()).Write();
+
+  // Only one file closes at a time, which bounds the memory it holds.
+  WaitForClose();
+  closer_thread_ = std::thread(&WriterRoot::CloseFile, this, run_.release());
 }
 
-void WriterRoot::PushData(const std::vector<event_data> &data_buffer) {
-  for (auto it = data_buffer.begin(); it != data_buffer.end(); ++it) {
-    int count = 0;
-    for (auto &sis : (*it).sis_3350_vec) {
-      root_data_.sis_3350_vec[count++] = sis;
-    }
+void WriterRoot::CloseFile(RunFile *run) {
+  std::unique_ptr<RunFile> owned(run);
+  long long t_start = MetricsNow();
 
-    count = 0;
-    for (auto &sis : (*it).sis_3302_vec) {
-      root_data_.sis_3302_vec[count++] = sis;
-    }
+  // The file owns the tree, the buffers go only after both.
+  run->pf->Write();
+  run->pf->Close();
+  delete run->pf;
 
-    count = 0;
-    for (auto &sis : (*it).sis_3316_vec) {
-      root_data_.sis_3316_vec[count++] = sis;
-    }
+  LogMessage("Closed data TFile %s in %lli ms.", run->outfile.c_str(),
+             (MetricsNow() - t_start) / 1000000);
 
-    count = 0;
-    for (auto &caen : (*it).caen_1785_vec) {
-      root_data_.caen_1785_vec[count++] = caen;
-    }
+  std::string cmd("chown newg2:newg2 ");
+  cmd += run->outfile.c_str();
+  system((const char *)cmd.c_str());
+}
 
-    count = 0;
-    for (auto &caen : (*it).caen_6742_vec) {
-      root_data_.caen_6742_vec[count++] = caen;
+void WriterRoot::WaitForClose() {
+  if (closer_thread_.joinable()) {
+    try {
+      closer_thread_.join();
+    } catch (const std::system_error &e) {
+      LogError("encountered race condition joining closer thread");
     }
+  }
+}
 
-    count = 0;
-    for (auto &caen : (*it).caen_1742_vec) {
-      root_data_.caen_1742_vec[count++] = caen;
-    }
+void WriterRoot::PushData(const std::vector<event_data> &data_buffer) {
+  // A batch arriving after StopWriter has no file to go to.
+  if (run_ == nullptr) {
+    events_dropped_.Add(data_buffer.size());
+    return;
+  }
 
-    count = 0;
-    for (auto &drs : (*it).drs4_vec) {
-      root_data_.drs4_vec[count++] = drs;
-    }
+  for (auto it = data_buffer.begin(); it != data_buffer.end(); ++it) {
+    long long t_start = MetricsNow();
 
-    count = 0;
-    for (auto &caen : (*it).caen_5720_vec) {
-      root_data_.caen_5720_vec[count++] = caen;
-    }
+    EventCopier copier(*it, run_->data);
+    for_each_device(copier);
 
-    count = 0;
-    for (auto &caen : (*it).caen_5730_vec) {
-      root_data_.caen_5730_vec[count++] = caen;
-    }
+    run_->pt->Fill();
 
-    pt_->Fill();
+    write_time_.Record(MetricsNow() - t_start);
+    events_written_.Add();
 
     // Manually flush the baskets.
-    //    if (pt_->GetEntries() == 1000) {
-    //      pt_->FlushBaskets();
+    //    if (run_->pt->GetEntries() == 1000) {
+    //      run_->pt->FlushBaskets();
     //    }
   }
 }
@@ -283,10 +171,13 @@ void WriterRoot::PushData(const std::vector<event_data> &data_buffer) {
 void WriterRoot::EndOfBatch(bool bad_data) {
   LogMessage("Received EOB with bad_data flag = %i", bad_data);
 
+  // Late markers after StopWriter have nothing left to flush.
+  if (run_ == nullptr) return;
+
   if (need_sync_ && bad_data) {
-    pt_->DropBaskets();
+    run_->pt->DropBaskets();
   } else {
-    pt_->FlushBaskets();
+    run_->pt->FlushBaskets();
   }
 }
 